@@ -0,0 +1,610 @@
+#ifndef BUDDHABROT_HPP
+#define BUDDHABROT_HPP
+
+////////////////////////////////////////////////////////////
+// Headers
+////////////////////////////////////////////////////////////
+#include "Effect.hpp"
+#include "Kernel.hpp"
+#include "Threads.hpp"
+
+#include <SFML/Graphics.hpp>
+
+#include <vector>
+#include <algorithm>
+#include <cmath>
+#include <stdio.h>
+
+////////////////////////////////////////////////////////////
+// Orbit density (Buddhabrot and Nebulabrot) accumulation
+////////////////////////////////////////////////////////////
+
+// Histograms are stored in square tiles so that consecutive orbit
+// points, which are usually close to each other, hit the same lines
+#define HISTOGRAM_TILE 32
+
+// What the engine accumulates
+struct BuddhabrotParams
+{
+    // Same meaning as Effect::frame
+    double x, y, zoom;
+    bool almond;
+
+    // Width of the square histogram in pixels
+    int size;
+
+    // One histogram per channel, a point only counts towards the
+    // channels whose limit is at least its escape time
+    int channels;
+    int limits[3];
+};
+
+inline bool operator==(const BuddhabrotParams& a, const BuddhabrotParams& b)
+{
+    return a.x == b.x && a.y == b.y && a.zoom == b.zoom &&
+           a.almond == b.almond && a.size == b.size &&
+           a.channels == b.channels && a.limits[0] == b.limits[0] &&
+           a.limits[1] == b.limits[1] && a.limits[2] == b.limits[2];
+}
+
+inline bool operator!=(const BuddhabrotParams& a, const BuddhabrotParams& b)
+{
+    return !(a == b);
+}
+
+class BuddhabrotEngine;
+
+// One sampling thread with its own histogram
+class BuddhabrotWorker
+{
+public :
+
+    BuddhabrotWorker(BuddhabrotEngine& engine, sf::Uint64 seed);
+
+    void run();
+
+private :
+
+    void sample(unsigned int generation);
+    double evaluate(double cReal, double cImag, std::vector<double>& orbit,
+                    int& escape);
+    void accumulate(const std::vector<double>& orbit, int escape,
+                    float weight);
+
+    BuddhabrotEngine& m_engine;
+    BuddhabrotParams m_params;
+    Random m_random;
+
+    std::vector<float> m_histogram;
+    sf::Uint64 m_samples;
+};
+
+////////////////////////////////////////////////////////////
+/// Owns the sampling threads and the merged histogram. The
+/// threads live until stop(), a new view is handed to them by
+/// bumping the generation and they drop whatever they sampled
+/// for an older one.
+////////////////////////////////////////////////////////////
+class BuddhabrotEngine
+{
+public :
+
+    BuddhabrotEngine() :
+    m_running(false),
+    m_generation(0),
+    m_samples(0)
+    {
+    }
+
+    ~BuddhabrotEngine()
+    {
+        stop();
+    }
+
+    // Throw away the current histogram and start sampling params,
+    // never waits for the threads
+    void start(const BuddhabrotParams& params)
+    {
+        {
+            sf::Lock lock(m_mutex);
+            m_params = params;
+            ++m_generation;
+            m_samples = 0;
+            m_histogram.assign(getHistogramSize(params), 0.0f);
+            m_running = true;
+        }
+
+        if (!m_threads.empty())
+            return;
+
+        unsigned int count = getCoreCount();
+        for (unsigned int i = 0; i < count; ++i)
+        {
+            BuddhabrotWorker* worker =
+                new BuddhabrotWorker(*this, 0x2545F4914F6CDD1DULL * (i + 1));
+            sf::Thread* thread =
+                new sf::Thread(&BuddhabrotWorker::run, worker);
+
+            m_workers.push_back(worker);
+            m_threads.push_back(thread);
+            thread->launch();
+        }
+    }
+
+    // Wait for the threads to end, they finish their current batch
+    void stop()
+    {
+        {
+            sf::Lock lock(m_mutex);
+            m_running = false;
+        }
+
+        for (std::size_t i = 0; i < m_threads.size(); ++i)
+        {
+            m_threads[i]->wait();
+            delete m_threads[i];
+            delete m_workers[i];
+        }
+
+        m_threads.clear();
+        m_workers.clear();
+    }
+
+    bool isRunning()
+    {
+        sf::Lock lock(m_mutex);
+        return m_running;
+    }
+
+    BuddhabrotParams getParams()
+    {
+        sf::Lock lock(m_mutex);
+        return m_params;
+    }
+
+    sf::Uint64 getSamples()
+    {
+        sf::Lock lock(m_mutex);
+        return m_samples;
+    }
+
+    // Tone map the merged histogram into RGBA pixels
+    void getPixels(std::vector<sf::Uint8>& pixels)
+    {
+        sf::Lock lock(m_mutex);
+
+        int size = m_params.size;
+        int tilesX = getTilesX(m_params);
+        int plane = getPlaneSize(m_params);
+
+        pixels.resize(size * size * 4);
+
+        float maxValue[3] = {0.0f, 0.0f, 0.0f};
+        for (int c = 0; c < m_params.channels; ++c)
+            for (int i = 0; i < plane; ++i)
+                maxValue[c] = fmax(maxValue[c], m_histogram[c * plane + i]);
+
+        for (int y = 0; y < size; ++y)
+        {
+            for (int x = 0; x < size; ++x)
+            {
+                int index = getIndex(x, y, tilesX);
+                sf::Uint8* pixel = &pixels[(y * size + x) * 4];
+
+                for (int c = 0; c < 3; ++c)
+                {
+                    // A single histogram is shown in grey
+                    int channel = c < m_params.channels ? c : 0;
+                    float value = 0.0f;
+                    if (maxValue[channel] > 0.0f)
+                        value = sqrt(m_histogram[channel * plane + index] /
+                                      maxValue[channel]);
+
+                    pixel[c] = static_cast<sf::Uint8>(value * 255.0f);
+                }
+                pixel[3] = 255;
+            }
+        }
+    }
+
+    // Histogram layout, shared with the workers
+    static int getTilesX(const BuddhabrotParams& params)
+    {
+        return (params.size + HISTOGRAM_TILE - 1) / HISTOGRAM_TILE;
+    }
+
+    static int getPlaneSize(const BuddhabrotParams& params)
+    {
+        int tiles = getTilesX(params);
+        return tiles * tiles * HISTOGRAM_TILE * HISTOGRAM_TILE;
+    }
+
+    static int getHistogramSize(const BuddhabrotParams& params)
+    {
+        return getPlaneSize(params) * params.channels;
+    }
+
+    static int getIndex(int x, int y, int tilesX)
+    {
+        int tile = (y / HISTOGRAM_TILE) * tilesX + x / HISTOGRAM_TILE;
+        return tile * HISTOGRAM_TILE * HISTOGRAM_TILE +
+               (y % HISTOGRAM_TILE) * HISTOGRAM_TILE + x % HISTOGRAM_TILE;
+    }
+
+private :
+
+    friend class BuddhabrotWorker;
+
+    // Called by the workers for the view to sample, false once they
+    // are to stop
+    bool getJob(BuddhabrotParams& params, unsigned int& generation)
+    {
+        sf::Lock lock(m_mutex);
+        params = m_params;
+        generation = m_generation;
+
+        return m_running;
+    }
+
+    // Whether the workers should go on sampling generation
+    bool isCurrent(unsigned int generation)
+    {
+        sf::Lock lock(m_mutex);
+        return m_running && generation == m_generation;
+    }
+
+    // Called by the workers, adds their histogram to the shared one
+    // unless it was sampled for an older view
+    void merge(std::vector<float>& histogram, sf::Uint64 samples,
+               unsigned int generation)
+    {
+        sf::Lock lock(m_mutex);
+        if (generation != m_generation)
+            return;
+
+        for (std::size_t i = 0; i < histogram.size(); ++i)
+            m_histogram[i] += histogram[i];
+
+        m_samples += samples;
+    }
+
+    // Guarded by m_mutex, like the histogram
+    BuddhabrotParams m_params;
+    bool m_running;
+    unsigned int m_generation;
+
+    sf::Mutex m_mutex;
+    std::vector<float> m_histogram;
+    sf::Uint64 m_samples;
+
+    std::vector<BuddhabrotWorker*> m_workers;
+    std::vector<sf::Thread*> m_threads;
+};
+
+inline BuddhabrotWorker::BuddhabrotWorker(BuddhabrotEngine& engine,
+                                          sf::Uint64 seed) :
+m_engine(engine),
+m_random(seed),
+m_samples(0)
+{
+}
+
+// Sample every view the engine hands out until it stops
+inline void BuddhabrotWorker::run()
+{
+    unsigned int generation;
+    while (m_engine.getJob(m_params, generation))
+        sample(generation);
+}
+
+////////////////////////////////////////////////////////////
+/// Metropolis-Hastings over c, the target density is the number
+/// of orbit points that land in the view. Each visited c adds its
+/// orbit weighted by 1/density so the result is still the plain
+/// Buddhabrot, only with far less wasted samples near the edge.
+////////////////////////////////////////////////////////////
+inline void BuddhabrotWorker::sample(unsigned int generation)
+{
+    m_samples = 0;
+    m_histogram.assign(BuddhabrotEngine::getHistogramSize(m_params), 0.0f);
+
+    int maxLimit = m_params.limits[0];
+    for (int c = 1; c < m_params.channels; ++c)
+        maxLimit = std::max(maxLimit, m_params.limits[c]);
+
+    std::vector<double> orbit(2 * maxLimit);
+    std::vector<double> proposal(2 * maxLimit);
+
+    // Mutations are a few pixels wide
+    double mutation = m_params.zoom / m_params.size * 4.0;
+
+    double cReal = 0.0, cImag = 0.0;
+    double density = 0.0;
+    int escape = 0;
+
+    sf::Clock mergeClock;
+
+    while (m_engine.isCurrent(generation))
+    {
+        for (int i = 0; i < 1024; ++i)
+        {
+            double newReal, newImag;
+
+            // Occasional uniform jumps keep the chain from getting stuck
+            if (density == 0.0 || m_random.uniform() < 0.2)
+            {
+                newReal = m_random.uniform(-2.0, 2.0);
+                newImag = m_random.uniform(-2.0, 2.0);
+            }
+            else
+            {
+                // Sum of uniforms, close enough to a gaussian
+                newReal = cReal + mutation * (m_random.uniform() +
+                          m_random.uniform() + m_random.uniform() - 1.5);
+                newImag = cImag + mutation * (m_random.uniform() +
+                          m_random.uniform() + m_random.uniform() - 1.5);
+            }
+
+            int newEscape;
+            double newDensity = evaluate(newReal, newImag, proposal,
+                                         newEscape);
+            ++m_samples;
+
+            // Both proposals are symmetric so only the density ratio counts
+            if (newDensity > 0.0 && (newDensity >= density ||
+                 m_random.uniform() * density < newDensity))
+            {
+                cReal = newReal;
+                cImag = newImag;
+                density = newDensity;
+                escape = newEscape;
+                orbit.swap(proposal);
+            }
+
+            if (density > 0.0)
+                accumulate(orbit, escape, 1.0f / density);
+        }
+
+        if (mergeClock.getElapsedTime().asMilliseconds() > 250)
+        {
+            m_engine.merge(m_histogram, m_samples, generation);
+            m_histogram.assign(m_histogram.size(), 0.0f);
+            m_samples = 0;
+            mergeClock.restart();
+        }
+    }
+
+    m_engine.merge(m_histogram, m_samples, generation);
+}
+
+// Iterate c, returns the number of orbit points inside the view
+inline double BuddhabrotWorker::evaluate(double cReal, double cImag,
+                                         std::vector<double>& orbit,
+                                         int& escape)
+{
+    escape = 0;
+
+    // The main cardioid and the period two bulb never escape
+    if (!m_params.almond && getMainComponentPeriod(cReal, cImag) != 0)
+        return 0.0;
+
+    int limit = orbit.size() / 2;
+    double real = 0.0, imag = 0.0;
+    double r2 = 0.0;
+    int iter;
+
+    for (iter = 0; iter < limit && r2 < 4.0; ++iter)
+    {
+        iterateStep(real, imag, cReal, cImag, m_params.almond);
+        orbit[2 * iter] = real;
+        orbit[2 * iter + 1] = imag;
+        r2 = real * real + imag * imag;
+    }
+
+    if (r2 < 4.0)
+        return 0.0;
+
+    escape = iter;
+
+    int hits = 0;
+    for (int i = 0; i < iter; ++i)
+    {
+        double u = (orbit[2 * i] + m_params.x) / m_params.zoom + 0.5;
+        double v = 0.5 - (orbit[2 * i + 1] + m_params.y) / m_params.zoom;
+        if (u >= 0.0 && u < 1.0 && v >= 0.0 && v < 1.0)
+            ++hits;
+    }
+
+    return hits;
+}
+
+inline void BuddhabrotWorker::accumulate(const std::vector<double>& orbit,
+                                         int escape, float weight)
+{
+    int size = m_params.size;
+    int tilesX = BuddhabrotEngine::getTilesX(m_params);
+    int plane = BuddhabrotEngine::getPlaneSize(m_params);
+
+    for (int i = 0; i < escape; ++i)
+    {
+        // Inverse of the pixel mapping in Kernel.hpp
+        double u = (orbit[2 * i] + m_params.x) / m_params.zoom + 0.5;
+        double v = 0.5 - (orbit[2 * i + 1] + m_params.y) / m_params.zoom;
+        if (u < 0.0 || u >= 1.0 || v < 0.0 || v >= 1.0)
+            continue;
+
+        int index = BuddhabrotEngine::getIndex(static_cast<int>(u * size),
+                                               static_cast<int>(v * size),
+                                               tilesX);
+
+        for (int c = 0; c < m_params.channels; ++c)
+            if (escape <= m_params.limits[c])
+                m_histogram[c * plane + index] += weight;
+    }
+}
+
+////////////////////////////////////////////////////////////
+// "Buddhabrot" CPU effect, shown in the right pane
+////////////////////////////////////////////////////////////
+class Buddhabrot : public Effect
+{
+public :
+
+    Buddhabrot() :
+    Effect("buddhabrot"),
+    m_nebulabrot(false),
+    m_shownCurrent(false)
+    {
+        m_panePosition = sf::Vector2f(PANE_SIZE, 0);
+    }
+
+    ~Buddhabrot()
+    {
+        m_engine.stop();
+    }
+
+    bool onLoad()
+    {
+        if (!m_texture.create(PANE_SIZE, PANE_SIZE))
+            return false;
+
+        m_sprite.setTexture(m_texture, true);
+        m_sprite.setPosition(PANE_SIZE, 0);
+
+        m_status.setFont(getFont());
+        m_status.setCharacterSize(20);
+        m_status.setColor(sf::Color(80, 80, 80));
+        m_status.setPosition(970, 930);
+
+        return true;
+    }
+
+    void onUpdate()
+    {
+        // Update the frame if we are panning
+        if (m_panning)
+        {
+            frame.x += m_panVelocity * cos(m_panAngle);
+            frame.y += m_panVelocity * sin(m_panAngle);
+        }
+
+        BuddhabrotParams params;
+        params.x = frame.x;
+        params.y = frame.y;
+        params.zoom = frame.z;
+        params.almond = m_almond;
+        params.size = PANE_SIZE;
+
+        if (m_nebulabrot)
+        {
+            params.channels = 3;
+            params.limits[0] = 5000;
+            params.limits[1] = 500;
+            params.limits[2] = 50;
+        }
+        else
+        {
+            params.channels = 1;
+            params.limits[0] = params.limits[1] = params.limits[2] = 1000;
+        }
+
+        // Any change to the view starts the accumulation over
+        if (!m_engine.isRunning() || params != m_engine.getParams())
+        {
+            m_engine.start(params);
+            m_refreshClock.restart();
+            m_shownCurrent = false;
+        }
+
+        // Stream the progress in without stalling the UI thread
+        if (m_refreshClock.getElapsedTime().asMilliseconds() > 250)
+        {
+            m_engine.getPixels(m_pixels);
+            m_texture.update(&m_pixels[0]);
+
+            char temp[64];
+            sprintf(temp, "Samples: %llu",
+                    static_cast<unsigned long long>(m_engine.getSamples()));
+            m_status.setString(temp);
+
+            m_refreshClock.restart();
+            m_shownCurrent = true;
+        }
+
+        // Are we currently interacting with this fractal
+        m_interacting = m_panning || m_zooming;
+    }
+
+    void onDraw(sf::RenderTarget& target, sf::RenderStates states) const
+    {
+        target.draw(m_sprite, states);
+        target.draw(m_status, states);
+
+        if (m_zooming)
+        {
+            // Draw the box for zooming
+            target.draw(m_zoomBox);
+        }
+    }
+
+    void setNebulabrot(bool nebulabrot)
+    {
+        m_nebulabrot = nebulabrot;
+    }
+
+    bool getNebulabrot()
+    {
+        return m_nebulabrot;
+    }
+
+    // The histogram only ever gets smoother, the view counts as done
+    // once samples of it are shown
+    bool isComplete()
+    {
+        return m_shownCurrent;
+    }
+
+    // Stop the sampling threads while the pane is hidden
+    void pause()
+    {
+        m_engine.stop();
+    }
+
+    // Mouse button events
+    void onMouseButtonRelease(sf::Event event)
+    {
+        if (event.mouseButton.button == sf::Mouse::Right)
+        {
+            m_zooming = false;
+            sf::Vector2f position = m_zoomBox.getPosition() -
+                                        m_panePosition;
+
+            float mouseX = fmin(event.mouseButton.x - m_panePosition.x,
+                                PANE_SIZE);
+            float mouseY = fmin(event.mouseButton.y - m_panePosition.y,
+                                PANE_SIZE);
+            float newSize = fmax(mouseX-position.x, mouseY-position.y);
+
+            setFrame(getFrame(position.x, position.y, newSize));
+        }
+        else if (event.mouseButton.button == sf::Mouse::Middle)
+        {
+            m_panning = false;
+            m_panVelocity = 0.0;
+        }
+    }
+
+private:
+
+    BuddhabrotEngine m_engine;
+    bool m_nebulabrot;
+    bool m_shownCurrent;
+
+    std::vector<sf::Uint8> m_pixels;
+    sf::Texture m_texture;
+    sf::Sprite m_sprite;
+    sf::Text m_status;
+    sf::Clock m_refreshClock;
+};
+
+#endif // BUDDHABROT_HPP
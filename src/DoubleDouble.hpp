@@ -0,0 +1,104 @@
+#ifndef DOUBLEDOUBLE_HPP
+#define DOUBLEDOUBLE_HPP
+
+////////////////////////////////////////////////////////////
+// Unevaluated sum of two doubles, about 106 bits of mantissa.
+// The CPU version of the double-single math in the emulated
+// shader, built on the error free sum and product of Dekker
+// and Knuth so it does not need hardware FMA.
+////////////////////////////////////////////////////////////
+struct DoubleDouble
+{
+    DoubleDouble() :
+    hi(0.0),
+    lo(0.0)
+    {
+    }
+
+    DoubleDouble(double value) :
+    hi(value),
+    lo(0.0)
+    {
+    }
+
+    DoubleDouble(double high, double low) :
+    hi(high),
+    lo(low)
+    {
+    }
+
+    // |lo| is at most half an ulp of hi
+    double hi, lo;
+};
+
+// a + b exactly, as long as |a| >= |b|
+inline DoubleDouble quickTwoSum(double a, double b)
+{
+    double sum = a + b;
+    return DoubleDouble(sum, b - (sum - a));
+}
+
+// a + b exactly
+inline DoubleDouble twoSum(double a, double b)
+{
+    double sum = a + b;
+    double virtualB = sum - a;
+    return DoubleDouble(sum, (a - (sum - virtualB)) + (b - virtualB));
+}
+
+// a * b exactly, the factors are split into 26 bit halves
+inline DoubleDouble twoProduct(double a, double b)
+{
+    static const double split = 134217729.0; // 2^27 + 1
+
+    double t = split * a;
+    double aHigh = t - (t - a);
+    double aLow = a - aHigh;
+
+    t = split * b;
+    double bHigh = t - (t - b);
+    double bLow = b - bHigh;
+
+    double product = a * b;
+    double error = ((aHigh * bHigh - product) + aHigh * bLow + aLow * bHigh) +
+                   aLow * bLow;
+
+    return DoubleDouble(product, error);
+}
+
+inline DoubleDouble operator-(const DoubleDouble& a)
+{
+    return DoubleDouble(-a.hi, -a.lo);
+}
+
+inline DoubleDouble operator+(const DoubleDouble& a, const DoubleDouble& b)
+{
+    DoubleDouble high = twoSum(a.hi, b.hi);
+    DoubleDouble low = twoSum(a.lo, b.lo);
+
+    high.lo += low.hi;
+    high = quickTwoSum(high.hi, high.lo);
+    high.lo += low.lo;
+
+    return quickTwoSum(high.hi, high.lo);
+}
+
+inline DoubleDouble operator-(const DoubleDouble& a, const DoubleDouble& b)
+{
+    return a + -b;
+}
+
+inline DoubleDouble operator*(const DoubleDouble& a, const DoubleDouble& b)
+{
+    DoubleDouble product = twoProduct(a.hi, b.hi);
+    product.lo += a.hi * b.lo + a.lo * b.hi;
+
+    return quickTwoSum(product.hi, product.lo);
+}
+
+inline double toDouble(const DoubleDouble& value)
+{
+    return value.hi + value.lo;
+}
+
+#endif // DOUBLEDOUBLE_HPP
@@ -4,13 +4,53 @@
 ////////////////////////////////////////////////////////////
 // Headers
 ////////////////////////////////////////////////////////////
+#include "Kernel.hpp"
+#include "Palette.hpp"
+#include "IterationMap.hpp"
+#include "Renderer.hpp"
+#include "ViewCache.hpp"
+#include "PngWriter.hpp"
+#include "Precision.hpp"
+
 #include <SFML/Graphics.hpp>
 #include <cassert>
 #include <string>
+#include <vector>
+#include <algorithm>
 #include <cmath>
 
 #define PI 3.14159265
 
+// Width of the coarse render used to equalize the palette
+#define PALETTE_SAMPLES 64
+
+// Width of a fractal pane on the window, the menu is below the panes
+#define PANE_SIZE 960
+#define MENU_HEIGHT 120
+
+// Width of the offscreen tiles of renderImage
+#define IMAGE_TILE 512
+
+// Share of a cancelled refinement that has to be done for it to be
+// kept as a placeholder, less is not worth filling in
+#define PLACEHOLDER_PROGRESS 0.1f
+
+////////////////////////////////////////////////////////////
+// Names of the shader uniforms, made once (Shader.cpp).
+// setParameter takes a std::string, so a literal would build a
+// new string on every call of every frame.
+////////////////////////////////////////////////////////////
+struct Uniform
+{
+    static const std::string Palette, ColorRange, ColorMode;
+    static const std::string InteriorDetection, ComponentCount, OrbitTraps;
+    static const std::string MaxIterations, LogShading, Zoom, Almond;
+    static const std::string DistanceEstimation, Julia, JuliaA, JuliaB;
+    static const std::string Xcenter, Ycenter, CenterLow, JuliaLow;
+    static const std::string TrapRadius, TrapCenter;
+    static const std::string PaneOrigin, PaneSize;
+};
+
 ////////////////////////////////////////////////////////////
 // Base class for effects
 ////////////////////////////////////////////////////////////
@@ -20,6 +60,12 @@ public :
 
     virtual ~Effect()
     {
+        // A refine or save in progress is of no use any more
+        m_renderer.cancel();
+        m_renderer.wait();
+        delete m_map;
+        delete m_pendingMap;
+        delete m_placeholder;
     }
 
     static void setFont(const sf::Font& font)
@@ -27,6 +73,21 @@ public :
         s_font = &font;
     }
 
+    // Mouse buttons are followed through the events rather than asked
+    // of the system, so replayed input drags the same way
+    static void trackButtons(const sf::Event& event)
+    {
+        if (event.type == sf::Event::MouseButtonPressed ||
+             event.type == sf::Event::MouseButtonReleased)
+            s_buttons[event.mouseButton.button] =
+                event.type == sf::Event::MouseButtonPressed;
+    }
+
+    static bool isButtonDown(sf::Mouse::Button button)
+    {
+        return s_buttons[button];
+    }
+
     const std::string& getName() const
     {
         return m_name;
@@ -34,22 +95,51 @@ public :
 
     void load()
     {
-        m_isLoaded = sf::Shader::isAvailable() && onLoad();
-        frame = sf::Vector3f(0.0, 0.0, 4.0);
+        m_isLoaded = sf::Shader::isAvailable() && m_palette.create() &&
+                     onLoad();
+        frame = sf::Vector3<double>(0.0, 0.0, 4.0);
         m_logShading = true;
         m_almond = false;
+        m_distanceEstimation = false;
+        m_interiorDetection = false;
+        m_autoPrecision = true;
         m_coloring = sf::Vector3f(0.0, 0.0, 0.0);
+
+        // The legend of the precision view never changes
+        for (int i = 0; i < PrecisionCount; ++i)
+        {
+            sf::Color color = getPrecisionColor(i);
+            color.a = 255;
+
+            sf::Text& label = m_precisionLabels[i];
+            label.setString(getPrecisionName(i));
+            label.setFont(getFont());
+            label.setCharacterSize(16);
+            label.setColor(color);
+            label.setPosition(m_panePosition + sf::Vector2f(8, 8 + 20 * i));
+        }
     }
 
     void update()
     {
         if (m_isLoaded)
+        {
             onUpdate();
+            updateIterationMap();
+        }
     }
 
     void draw(sf::RenderTarget& target, sf::RenderStates states) const
     {
-        if (m_isLoaded)
+        if (m_isLoaded && m_showMap)
+        {
+            // A loaded iteration map replaces the shader
+            target.draw(m_mapSprite, states);
+
+            if (m_zooming)
+                target.draw(m_zoomBox);
+        }
+        else if (m_isLoaded)
         {
             onDraw(target, states);
         }
@@ -60,6 +150,10 @@ public :
             error.setCharacterSize(36);
             target.draw(error, states);
         }
+
+        // Debug view on top of whatever is shown
+        if (m_isLoaded && m_showPrecision)
+            drawPrecision(target, states);
     }
 
     void mouseButtonPressed(sf::Event event)
@@ -103,9 +197,9 @@ public :
         m_logShading = logShading;
     }
 
-    void setFrame(sf::Vector3f newFrame)
+    void setFrame(sf::Vector3<double> newFrame)
     {
-        frame = sf::Vector3f(newFrame.x, newFrame.y, newFrame.z);
+        frame = newFrame;
     }
 
     void setIterationScaling(bool scale)
@@ -113,7 +207,7 @@ public :
         m_iterationsScaing = scale;        
     }
 
-    sf::Vector3f getFrame()
+    sf::Vector3<double> getFrame()
     {
         return frame;
     }
@@ -133,27 +227,381 @@ public :
         m_emulated = emulated;
     }
 
-    sf::Vector3f getFrame(int left, int right, int width)
+    // Pick float or emulated double per tile, m_emulated still forces
+    // the emulated shader everywhere
+    void setAutoPrecision(bool autoPrecision)
+    {
+        m_autoPrecision = autoPrecision;
+    }
+
+    // Debug view of the precision each tile is rendered in
+    void setShowPrecision(bool showPrecision)
+    {
+        m_showPrecision = showPrecision;
+    }
+
+    bool getShowPrecision()
+    {
+        return m_showPrecision;
+    }
+
+    void setDistanceEstimation(bool distanceEstimation)
+    {
+        m_distanceEstimation = distanceEstimation;
+    }
+
+    bool getDistanceEstimation()
+    {
+        return m_distanceEstimation;
+    }
+
+    void setInteriorDetection(bool interiorDetection)
+    {
+        m_interiorDetection = interiorDetection;
+    }
+
+    bool getInteriorDetection()
+    {
+        return m_interiorDetection;
+    }
+
+    void setColorMode(int mode)
+    {
+        m_palette.setColorMode(mode);
+    }
+
+    int getColorMode()
+    {
+        return m_palette.getColorMode();
+    }
+
+    // Kernel variant matching the shader options, atom domains need
+    // the interior kernel even when the checks themselves are off and
+    // the stripe and trap colorings need the trap kernel. The almond
+    // transform is not analytic, so it has no distance estimate.
+    int getFeatures()
+    {
+        int mode = m_palette.getColorMode();
+
+        int features = KernelPlain;
+        if (m_distanceEstimation && !m_almond)
+            features |= KernelDistance;
+        if (m_interiorDetection || mode == ColorAtomDomain ||
+             mode == ColorPeriod)
+            features |= KernelInterior;
+        if (mode >= ColorStripes)
+            features |= KernelTraps;
+
+        return features;
+    }
+
+    void setPalettePreset(int preset)
+    {
+        m_palette.setPreset(preset);
+    }
+
+    int getPalettePreset()
+    {
+        return m_palette.getPreset();
+    }
+
+    void setEqualize(bool equalize)
+    {
+        m_palette.setEqualize(equalize);
+    }
+
+    const Palette& getPalette()
+    {
+        return m_palette;
+    }
+
+    // The iteration cap used by the shaders and the CPU kernels
+    float getMaxIterations()
+    {
+        float maxItValue = 70.0;
+        if (m_iterationsScaing)
+            maxItValue = sqrt(2.*sqrt(fabs(1.-sqrt(5./frame.z))))*66.5;
+
+        return maxItValue;
+    }
+
+    bool getAlmond()
+    {
+        return m_almond;
+    }
+
+    // Move to the view a map or bookmark was rendered from
+    virtual void setKernelParams(const KernelParams& params)
+    {
+        frame = sf::Vector3<double>(params.x, params.y, params.zoom);
+        m_almond = params.almond;
+        m_logShading = params.logShading;
+    }
+
+    ////////////////////////////////////////////////////////////
+    /// Render the current view on the CPU in the background and
+    /// write it to path once it is done, size is the width of the
+    /// map and defaults to the pane
+    ////////////////////////////////////////////////////////////
+    bool saveIterationMap(const std::string& path, int size = 0)
+    {
+        // The map on screen is the current view already
+        if (m_showMap && !m_mapIsPreview &&
+             (size == 0 || size == m_map->getWidth()))
+            return m_map->saveToFile(path);
+
+        // A refinement gives way and starts over after the save, the
+        // map it was to replace is shown as a preview until then
+        if (m_job == JobRefine)
+        {
+            cancelRefine();
+            m_mapIsPreview = m_showMap;
+        }
+
+        // Only a save already running keeps this one from starting
+        if (m_job != JobNone)
+            return false;
+
+        startJob(JobSave, size);
+        m_pendingPath = path;
+
+        return true;
+    }
+
+    ////////////////////////////////////////////////////////////
+    /// Show a saved map instead of the shader, the view jumps to
+    /// the one it was rendered from and it stays up until the
+    /// view changes again. Maps smaller than the pane are scaled
+    /// up, refine() replaces them with a full render.
+    ////////////////////////////////////////////////////////////
+    bool loadIterationMap(const std::string& path)
+    {
+        m_showMap = false;
+        m_mapIsPreview = false;
+        if (!m_map->loadFromFile(path) || m_map->getLayout() != LayoutGrid)
+            return false;
+
+        setKernelParams(m_map->getParams());
+        return showMap();
+    }
+
+    ////////////////////////////////////////////////////////////
+    /// Render the shown view at full size and swap it in when
+    /// done. A refinement of another view is cancelled, during a
+    /// save the shown map becomes a preview so the refinement
+    /// starts once the renderer is free. False when the view
+    /// needs none.
+    ////////////////////////////////////////////////////////////
+    bool refine()
+    {
+        if (m_showMap && m_map->getWidth() >= PANE_SIZE)
+            return false;
+
+        if (m_job == JobRefine)
+        {
+            if (isSameView(getKernelParams(), m_pendingMap->getParams()))
+                return true;
+
+            cancelRefine();
+        }
+
+        if (m_job == JobSave)
+        {
+            m_mapIsPreview = m_showMap;
+            return m_showMap;
+        }
+
+        startJob(JobRefine, 0);
+        return true;
+    }
+
+    ////////////////////////////////////////////////////////////
+    /// Go back to the cached render the shown map was zoomed into
+    /// from, without iterating. Zooming in again finds the render
+    /// that is left now in the cache too.
+    ////////////////////////////////////////////////////////////
+    bool zoomOut()
+    {
+        if (!m_showMap)
+            return false;
+
+        IterationMap* outer = m_cache.takeOuter(getKernelParams());
+        if (!outer)
+            return false;
+
+        if (m_mapIsPreview)
+            delete m_map;
+        else
+            m_cache.insert(m_map);
+
+        m_map = outer;
+        m_mapIsPreview = false;
+        setKernelParams(m_map->getParams());
+
+        return showMap();
+    }
+
+    // Write the loaded map as an image with the current palette
+    bool exportImage(const std::string& path)
+    {
+        if (!m_showMap)
+            return false;
+
+        sf::Image image;
+        image.create(m_map->getWidth(), m_map->getHeight(), &m_mapPixels[0]);
+        return image.saveToFile(path);
+    }
+
+    ////////////////////////////////////////////////////////////
+    /// Render the current view with the shaders into a PNG of
+    /// any size. The image is drawn IMAGE_TILE pixels at a time
+    /// offscreen and encoded a row of tiles at a time, each tile
+    /// in the precision the window would use for it.
+    ////////////////////////////////////////////////////////////
+    bool renderImage(const std::string& path, int size)
+    {
+        sf::Shader* normal = getShader(false);
+        sf::Shader* emulated = getShader(true);
+        if (!m_isLoaded || !normal || !emulated)
+            return false;
+
+        sf::RenderTexture target;
+        if (!target.create(IMAGE_TILE, IMAGE_TILE))
+            return false;
+
+        PngWriter png;
+        if (!png.open(path, size, size))
+            return false;
+
+        KernelParams params = getKernelParams();
+        params.size = size;
+
+        std::vector<sf::Uint8> band(size * IMAGE_TILE * 4);
+        for (int top = 0; top < size; top += IMAGE_TILE)
+        {
+            int height = std::min(IMAGE_TILE, size - top);
+            for (int left = 0; left < size; left += IMAGE_TILE)
+            {
+                int width = std::min(IMAGE_TILE, size - left);
+
+                bool useEmulated = m_emulated ||
+                    (m_autoPrecision && choosePrecision(params, left, top,
+                                                        width, height) !=
+                                        PrecisionFloat);
+                sf::Shader* shader = useEmulated ? emulated : normal;
+
+                drawImageTile(target, shader, size, left, top, width,
+                              height, &band[left * 4], size);
+            }
+
+            if (!png.write(&band[0], height))
+                return false;
+        }
+
+        // The next update puts the shaders back on the pane
+        return png.close();
+    }
+
+    ////////////////////////////////////////////////////////////
+    /// Render the current view with one of the shaders into RGBA
+    /// pixels, size is at most IMAGE_TILE. The golden check holds
+    /// the shaders to the CPU kernels with it.
+    ////////////////////////////////////////////////////////////
+    bool renderShader(bool emulated, int size, std::vector<sf::Uint8>& pixels)
+    {
+        sf::Shader* shader = getShader(emulated);
+        if (!m_isLoaded || !shader || size > IMAGE_TILE)
+            return false;
+
+        sf::RenderTexture target;
+        if (!target.create(IMAGE_TILE, IMAGE_TILE))
+            return false;
+
+        pixels.resize(size * size * 4);
+        drawImageTile(target, shader, size, 0, 0, size, size, &pixels[0],
+                      size);
+
+        return true;
+    }
+
+    bool isShowingMap()
+    {
+        return m_showMap;
+    }
+
+    // Whether the pane shows the current view at full quality, not a
+    // preview or a render that is still refining
+    virtual bool isComplete()
+    {
+        return !m_showMap || (!m_mapIsPreview && m_job != JobRefine);
+    }
+
+    // Sample of the shown map at a point, false when no map covers it
+    // or its cap is too low to tell whether the point escapes within
+    // maxIterations
+    bool findSample(double real, double imag, float maxIterations,
+                    IterationSample& sample)
+    {
+        if (!m_showMap)
+            return false;
+
+        // Inverse of pixelOffset, rounded to the nearest pixel center
+        const KernelParams& params = m_map->getParams();
+        int x = static_cast<int>(floor(((real + params.x) / params.zoom + 0.5)
+                                       * m_map->getWidth()));
+        int y = static_cast<int>(floor((0.5 - (imag + params.y) / params.zoom)
+                                       * m_map->getHeight()));
+
+        if (x < 0 || y < 0 || x >= m_map->getWidth() ||
+             y >= m_map->getHeight())
+            return false;
+
+        // A point inside at a lower cap may still escape below this one
+        sample = m_map->getSample(x, y);
+        return params.maxIterations >= maxIterations ||
+               !isInsideSample(sample, params.maxIterations);
+    }
+
+    // Describe the current view for the CPU kernels
+    virtual KernelParams getKernelParams()
+    {
+        KernelParams params;
+        params.x = frame.x;
+        params.y = frame.y;
+        params.zoom = frame.z;
+        params.juliaA = 0.0;
+        params.juliaB = 0.0;
+        params.julia = false;
+        params.almond = m_almond;
+        params.logShading = m_logShading;
+        params.maxIterations = getMaxIterations();
+        params.size = PANE_SIZE;
+
+        return params;
+    }
+
+    sf::Vector3<double> getFrame(int left, int right, int width)
     {
         // How convienent!
-        float Zoom = frame.z;
+        double Zoom = frame.z;
 
-        float mx = left-1.0;
-        float my = right-1.0;
+        double mx = left-1.0;
+        double my = right-1.0;
 
-        float centerX = mx + width/2.0;
-        float centerY = my + width/2.0;
+        double centerX = mx + width/2.0;
+        double centerY = my + width/2.0;
 
-        float centerA = ((centerX)*Zoom)/960.0 - Zoom/2.0 - frame.x;
-        float centerB = ((960.0-centerY)*Zoom)/960.0 - Zoom/2.0 - frame.y;
+        double centerA = ((centerX)*Zoom)/PANE_SIZE - Zoom/2.0 - frame.x;
+        double centerB = ((PANE_SIZE-centerY)*Zoom)/PANE_SIZE - Zoom/2.0 -
+                         frame.y;
 
-        float newZoom = fabs((width/960.0)*Zoom);
+        double newZoom = fabs((width/(double)PANE_SIZE)*Zoom);
 
-        return sf::Vector3f(-centerA, -centerB, newZoom);
+        return sf::Vector3<double>(-centerA, -centerB, newZoom);
     }
 
-    // Mouse event handlers
-    void onMouseButtonPress(sf::Event event)
+    // Mouse event handlers, the right and middle buttons zoom and pan
+    virtual void onMouseButtonPress(sf::Event event)
     {
         if (event.mouseButton.button == sf::Mouse::Right)
         {
@@ -169,18 +617,19 @@ public :
         }
     }
 
-    void onMouseMove(sf::Event event)
+    virtual void onMouseMove(sf::Event event)
     {
-        if (sf::Mouse::isButtonPressed(sf::Mouse::Right))
+        if (isButtonDown(sf::Mouse::Right))
         {
             sf::Vector2f position = m_zoomBox.getPosition();
             float newSize = fmin(fmax(
                                 event.mouseMove.x-position.x, 
-                                 event.mouseMove.y-position.y),960.0);
+                                 event.mouseMove.y-position.y),
+                                (float)PANE_SIZE);
 
             m_zoomBox.setSize(sf::Vector2f(newSize,newSize));
         } 
-        else if (sf::Mouse::isButtonPressed(sf::Mouse::Middle)&& m_panning)
+        else if (isButtonDown(sf::Mouse::Middle) && m_panning)
         {
             float distance = sqrt(pow(
                 fabs(m_mouseDragCenter.x - event.mouseMove.x), 2.0) + 
@@ -211,8 +660,17 @@ protected :
     m_name(name),
     m_isLoaded(false),
     m_emulated(false),
+    m_showPrecision(false),
     m_panning(false),
-    m_zooming(false)
+    m_zooming(false),
+    m_palettePending(false),
+    m_map(new IterationMap),
+    m_showMap(false),
+    m_mapIsPreview(false),
+    m_mapPaletteVersion(0),
+    m_pendingMap(new IterationMap),
+    m_job(JobNone),
+    m_placeholder(NULL)
     {
         m_zoomBox.setFillColor(sf::Color::Transparent);
         m_zoomBox.setOutlineColor(sf::Color::Green);
@@ -225,10 +683,181 @@ protected :
         return *s_font;
     }
 
-    // Current viewport for this fractal, has a center (X,Y) and a zoom (Z)
-    sf::Vector3f frame;
+    ////////////////////////////////////////////////////////////
+    /// Split the pane into the quads drawn with the float shader
+    /// and the ones that need the emulated one, and rebuild the
+    /// debug overlay when it is shown
+    ////////////////////////////////////////////////////////////
+    void updateTiles()
+    {
+        KernelParams params = getKernelParams();
+
+        m_floatTiles.clear();
+        m_emulatedTiles.clear();
+        m_floatTiles.setPrimitiveType(sf::Quads);
+        m_emulatedTiles.setPrimitiveType(sf::Quads);
+
+        for (int top = 0; top < params.size; top += PRECISION_TILE)
+        {
+            for (int left = 0; left < params.size; left += PRECISION_TILE)
+            {
+                int width = std::min(PRECISION_TILE, params.size - left);
+                int height = std::min(PRECISION_TILE, params.size - top);
+
+                bool emulated = m_emulated ||
+                    (m_autoPrecision && choosePrecision(params, left, top,
+                                                        width, height) !=
+                                        PrecisionFloat);
+
+                addQuad(emulated ? m_emulatedTiles : m_floatTiles,
+                        sf::FloatRect(left, top, width, height),
+                        sf::Color::White);
+            }
+        }
+
+        m_precisionOverlay.clear();
+        m_precisionOverlay.setPrimitiveType(sf::Quads);
+        if (!m_showPrecision)
+            return;
+
+        // A shown map was rendered by the CPU in its own tiles
+        int tile = PRECISION_TILE;
+        int features = KernelPlain;
+        if (m_showMap)
+        {
+            params = m_map->getParams();
+            tile = RENDER_TILE;
+
+            if (m_map->hasChannel(ChannelDistance))
+                features |= KernelDistance;
+            if (m_map->hasChannel(ChannelAtom))
+                features |= KernelInterior;
+            if (m_map->hasChannel(ChannelStripe))
+                features |= KernelTraps;
+        }
+
+        float scale = (float)PANE_SIZE / params.size;
+        for (int top = 0; top < params.size; top += tile)
+        {
+            for (int left = 0; left < params.size; left += tile)
+            {
+                int width = std::min(tile, params.size - left);
+                int height = std::min(tile, params.size - top);
+                int precision = m_showMap ?
+                    chooseTilePrecision(params, features, left, top,
+                                        width, height) :
+                    choosePrecision(params, left, top, width, height);
+
+                // Inset by a pixel so the tile edges show
+                addQuad(m_precisionOverlay,
+                        sf::FloatRect(left * scale + 1, top * scale + 1,
+                                      width * scale - 2, height * scale - 2),
+                        getPrecisionColor(precision));
+            }
+        }
+    }
+
+    // Draw the pane tiles, each with the shader it needs
+    void drawTiles(sf::RenderTarget& target, sf::RenderStates states,
+                   const sf::Shader* normal, const sf::Shader* emulated) const
+    {
+        states.shader = normal;
+        target.draw(m_floatTiles, states);
+
+        states.shader = emulated;
+        target.draw(m_emulatedTiles, states);
+    }
+
+    // Tell the shader where the pane is on the window
+    void updatePane(sf::Shader& shader)
+    {
+        // gl_FragCoord counts up from the bottom of the window, which
+        // is the bottom of the menu
+        shader.setParameter(Uniform::PaneOrigin, m_panePosition.x,
+                            MENU_HEIGHT - m_panePosition.y);
+        shader.setParameter(Uniform::PaneSize,
+                            static_cast<float>(PANE_SIZE));
+    }
+
+    // The center goes to the shaders in float, the emulated one also
+    // gets what float rounding lost so it keeps the double frame
+    void updateCenter(sf::Shader& shader)
+    {
+        float x = static_cast<float>(frame.x);
+        float y = static_cast<float>(frame.y);
+
+        shader.setParameter(Uniform::Xcenter, x);
+        shader.setParameter(Uniform::Ycenter, y);
+        if (&shader == getShader(true))
+            shader.setParameter(Uniform::CenterLow,
+                                static_cast<float>(frame.x - x),
+                                static_cast<float>(frame.y - y));
+    }
+
+    // Bake this frame's palette and hand it to the shader
+    void updatePalette(sf::Shader& shader)
+    {
+        m_palette.setCoefficients(m_coloring);
+
+        // The largest color value is about two past the iteration cap
+        float maxIterations = m_showMap ? m_map->getParams().maxIterations :
+                                          getMaxIterations();
+        m_palette.setRange(maxIterations + 2.0);
+
+        if (m_palette.getEqualize())
+        {
+            // A coarse CPU render is enough to know the distribution,
+            // and it only has to be redone when the view changes. It
+            // runs in the background in the precision the view needs,
+            // the palette keeps the last distribution until it is done.
+            KernelParams params = getKernelParams();
+            params.size = PALETTE_SAMPLES;
+
+            if (params != m_paletteParams)
+            {
+                m_paletteRenderer.cancel();
+                m_paletteMap.create(params, PALETTE_SAMPLES, PALETTE_SAMPLES,
+                                    getFeatureChannels(KernelPlain));
+                m_paletteRenderer.start(params, KernelPlain, m_paletteMap);
+                m_paletteParams = params;
+                m_palettePending = true;
+            }
+
+            if (m_palettePending && m_paletteRenderer.isDone())
+            {
+                m_paletteMap.fillHistogram(m_palette, 1);
+                m_palettePending = false;
+            }
+        }
+
+        m_palette.bake();
+
+        shader.setParameter(Uniform::Palette, m_palette.getTexture());
+        shader.setParameter(Uniform::ColorRange, m_palette.getRange());
+        shader.setParameter(Uniform::ColorMode,
+                            m_palette.getColorMode());
+        shader.setParameter(Uniform::InteriorDetection,
+                            (getFeatures() & KernelInterior) != 0);
+        shader.setParameter(Uniform::OrbitTraps,
+                            (getFeatures() & KernelTraps) != 0);
+    }
+
+    // Current viewport for this fractal, has a center (X,Y) and a zoom (Z),
+    // in double so the CPU kernels can be steered past float precision
+    sf::Vector3<double> frame;
 
     sf::Vector3f m_coloring;
+    Palette m_palette;
+
+    // Coarse render the palette histogram is built from, the
+    // renderer is declared last so it stops before the map goes
+    KernelParams m_paletteParams;
+    IterationMap m_paletteMap;
+    TileRenderer m_paletteRenderer;
+    bool m_palettePending;
+
+    // Top left corner of the pane on the window
+    sf::Vector2f m_panePosition;
 
     sf::RectangleShape m_zoomBox;    
     sf::Vector2f m_mouseDragCenter;
@@ -237,6 +866,10 @@ protected :
     bool m_almond;
     bool m_iterationsScaing;
     bool m_emulated;
+    bool m_autoPrecision;
+    bool m_showPrecision;
+    bool m_distanceEstimation;
+    bool m_interiorDetection;
 
     bool m_interacting;
     bool m_panning;
@@ -247,6 +880,242 @@ protected :
 
 private :
 
+    enum Job
+    {
+        JobNone,
+        JobSave,
+        JobRefine
+    };
+
+    // Start a background CPU render of the current view
+    void startJob(Job job, int size)
+    {
+        KernelParams params = getKernelParams();
+        if (size > 0)
+            params.size = size;
+
+        int features = getFeatures();
+        m_pendingMap->create(params, params.size, params.size,
+                             getFeatureChannels(features));
+        m_renderer.start(params, features, *m_pendingMap,
+                         m_cache.findParent(params));
+        m_job = job;
+    }
+
+    // Quad covering rect of the pane
+    void addQuad(sf::VertexArray& quads, const sf::FloatRect& rect,
+                 const sf::Color& color)
+    {
+        float left = m_panePosition.x + rect.left;
+        float top = m_panePosition.y + rect.top;
+        float right = left + rect.width;
+        float bottom = top + rect.height;
+
+        quads.append(sf::Vertex(sf::Vector2f(left, top), color));
+        quads.append(sf::Vertex(sf::Vector2f(right, top), color));
+        quads.append(sf::Vertex(sf::Vector2f(right, bottom), color));
+        quads.append(sf::Vertex(sf::Vector2f(left, bottom), color));
+    }
+
+    static sf::Color getPrecisionColor(int precision)
+    {
+        static const sf::Color colors[PrecisionCount] = {
+            sf::Color(0, 200, 0, 70), sf::Color(0, 120, 255, 70),
+            sf::Color(255, 160, 0, 70), sf::Color(255, 0, 0, 70),
+            sf::Color(200, 0, 255, 70)};
+
+        return colors[precision];
+    }
+
+    // Overlay and legend for the precision debug view
+    void drawPrecision(sf::RenderTarget& target, sf::RenderStates states) const
+    {
+        target.draw(m_precisionOverlay, states);
+
+        for (int i = 0; i < PrecisionCount; ++i)
+            target.draw(m_precisionLabels[i], states);
+    }
+
+    // Put m_map on screen, colored on the next update
+    bool showMap()
+    {
+        if (m_mapTexture.getSize() !=
+             sf::Vector2u(m_map->getWidth(), m_map->getHeight()) &&
+             !m_mapTexture.create(m_map->getWidth(), m_map->getHeight()))
+            return false;
+
+        m_mapTexture.setSmooth(true);
+        m_mapSprite.setTexture(m_mapTexture, true);
+        m_mapSprite.setPosition(m_panePosition);
+        m_mapSprite.setScale((float)PANE_SIZE / m_map->getWidth(),
+                             (float)PANE_SIZE / m_map->getHeight());
+
+        m_mapPaletteVersion = m_palette.getVersion() - 1;
+        m_showMap = true;
+
+        return true;
+    }
+
+    // Finish background jobs and keep the shown map in sync
+    void updateIterationMap()
+    {
+        if (m_job != JobNone && m_renderer.isDone())
+        {
+            if (m_job == JobSave)
+            {
+                m_pendingMap->saveToFile(m_pendingPath);
+            }
+            else if (m_showMap && isSameView(getKernelParams(),
+                                             m_pendingMap->getParams()))
+            {
+                std::swap(m_map, m_pendingMap);
+                m_mapIsPreview = false;
+                showMap();
+            }
+            else
+            {
+                // Zoomed on while it rendered, a parent for later views
+                m_cache.insert(m_pendingMap);
+                m_pendingMap = new IterationMap;
+            }
+
+            m_job = JobNone;
+        }
+
+        // CPU time goes to the view on screen only
+        if (m_job == JobRefine && !isSameView(getKernelParams(),
+                                              m_pendingMap->getParams()))
+            cancelRefine();
+
+        if (!m_showMap)
+            return;
+
+        // Other views go back to the shader unless a cached render
+        // covers them
+        if (!isSameView(getKernelParams(), m_map->getParams()) &&
+             !followView())
+        {
+            m_showMap = false;
+            return;
+        }
+
+        // A preview is replaced as soon as the renderer is free
+        if (m_mapIsPreview && m_job == JobNone)
+            startJob(JobRefine, 0);
+
+        // Recolor without iterating when the palette changes
+        if (m_mapPaletteVersion != m_palette.getVersion())
+        {
+            m_map->colorize(m_palette, m_mapPixels);
+            m_mapTexture.update(&m_mapPixels[0]);
+            m_mapPaletteVersion = m_palette.getVersion();
+        }
+    }
+
+    ////////////////////////////////////////////////////////////
+    /// Stop refining a view that was left. The tiles it finished
+    /// over the map shown for that view are kept as a placeholder
+    /// for the views after it, never as a cached render since the
+    /// rest of it is only a preview.
+    ////////////////////////////////////////////////////////////
+    void cancelRefine()
+    {
+        m_renderer.cancel();
+        m_job = JobNone;
+
+        if (!m_showMap ||
+             m_renderer.getProgress() < PLACEHOLDER_PROGRESS ||
+             !isSameView(m_map->getParams(), m_pendingMap->getParams()))
+            return;
+
+        m_renderer.fillCancelled(*m_map);
+        std::swap(m_placeholder, m_pendingMap);
+        if (!m_pendingMap)
+            m_pendingMap = new IterationMap;
+    }
+
+    ////////////////////////////////////////////////////////////
+    /// Show the current view out of the cache. A cached render of
+    /// it comes back as it was, otherwise the part of the finest
+    /// cached render or placeholder around it is scaled up until
+    /// its own render is done. False when none covers the view.
+    ////////////////////////////////////////////////////////////
+    bool followView()
+    {
+        KernelParams params = getKernelParams();
+
+        // Finished renders are kept for zooming back out
+        if (!m_mapIsPreview && !m_map->isEmpty())
+        {
+            m_cache.insert(m_map);
+            m_map = new IterationMap;
+        }
+
+        m_mapIsPreview = false;
+
+        IterationMap* cached = m_cache.take(params,
+                                        getFeatureChannels(getFeatures()));
+        if (cached)
+        {
+            delete m_map;
+            m_map = cached;
+            return showMap();
+        }
+
+        const IterationMap* parent = m_cache.findParent(params);
+        if (m_placeholder && !coversView(m_placeholder->getParams(), params))
+        {
+            delete m_placeholder;
+            m_placeholder = NULL;
+        }
+
+        if (m_placeholder && (!parent || getPixelSpacing(*m_placeholder) <
+                                         getPixelSpacing(*parent)))
+            parent = m_placeholder;
+
+        if (!parent)
+            return false;
+
+        cropView(*parent, params, *m_map);
+        m_mapIsPreview = true;
+
+        return showMap();
+    }
+
+    ////////////////////////////////////////////////////////////
+    /// Draw one tile of a size wide image with shader and copy
+    /// its RGBA pixels to out, rows stride pixels apart
+    ////////////////////////////////////////////////////////////
+    void drawImageTile(sf::RenderTexture& target, sf::Shader* shader,
+                       int size, int left, int top, int width, int height,
+                       sf::Uint8* out, int stride)
+    {
+        // The tile is drawn at the top left of the texture,
+        // gl_FragCoord counts up from its bottom
+        shader->setParameter(Uniform::PaneOrigin, -left,
+                             IMAGE_TILE - size + top);
+        shader->setParameter(Uniform::PaneSize, static_cast<float>(size));
+
+        sf::RectangleShape quad(sf::Vector2f(width, height));
+        target.clear(sf::Color::Black);
+        target.draw(quad, sf::RenderStates(shader));
+        target.display();
+
+        sf::Image tile = target.getTexture().copyToImage();
+        const sf::Uint8* pixels = tile.getPixelsPtr();
+        for (int y = 0; y < height; ++y)
+            std::copy(pixels + y * IMAGE_TILE * 4,
+                      pixels + (y * IMAGE_TILE + width) * 4,
+                      out + y * stride * 4);
+    }
+
+    // The float and emulated shaders for renderImage, NULL for effects
+    // that are not drawn by them
+    virtual sf::Shader* getShader(bool emulated)
+    {
+        return NULL;
+    }
+
     // Virtual functions to be implemented in derived effects
     virtual bool onLoad() = 0;
     virtual void onUpdate() = 0;
@@ -259,7 +1128,36 @@ private :
     std::string m_name;
     bool m_isLoaded;
 
+    // Saved render shown in place of the shader, a preview is a crop
+    // of a cached render waiting for its own
+    IterationMap* m_map;
+    bool m_showMap;
+    bool m_mapIsPreview;
+    std::vector<sf::Uint8> m_mapPixels;
+    sf::Texture m_mapTexture;
+    sf::Sprite m_mapSprite;
+    unsigned int m_mapPaletteVersion;
+
+    // The pane split by the shader it needs, and the debug overlay
+    sf::VertexArray m_floatTiles;
+    sf::VertexArray m_emulatedTiles;
+    sf::VertexArray m_precisionOverlay;
+    sf::Text m_precisionLabels[PrecisionCount];
+
+    // Recent renders to zoom into and back out to
+    ViewCache m_cache;
+
+    // Background render for saves and refinement
+    TileRenderer m_renderer;
+    IterationMap* m_pendingMap;
+    std::string m_pendingPath;
+    Job m_job;
+
+    // What a cancelled refinement finished, over the preview it had
+    IterationMap* m_placeholder;
+
     static const sf::Font* s_font;
+    static bool s_buttons[sf::Mouse::ButtonCount];
 };
 
 #endif // EFFECT_HPP
@@ -0,0 +1,397 @@
+#ifndef EVENTLOG_HPP
+#define EVENTLOG_HPP
+
+////////////////////////////////////////////////////////////
+// Headers
+////////////////////////////////////////////////////////////
+#include <SFML/Graphics.hpp>
+
+#include <string>
+#include <vector>
+#include <sstream>
+#include <fstream>
+#include <ostream>
+#include <algorithm>
+#include <stdio.h>
+
+////////////////////////////////////////////////////////////
+// Recorded input, for measuring how long the explorer takes to
+// answer it. A log is a text file with one event per line, its
+// time in microseconds since the start, a name and the fields
+// the main loop reads:
+//
+//   1520331 mouse-moved 1210 433
+//   1520947 button-pressed 2 1210 433
+//
+// Replaying feeds the events back at the same times and notes
+// when each one first shows on screen and when the panes are
+// at full quality again.
+////////////////////////////////////////////////////////////
+
+// First line of a log, the number is the format version
+#define EVENT_LOG_HEADER "fractal-events 1"
+
+// How long a replay waits for full quality after the last event,
+// in microseconds
+#define REPLAY_SETTLE_TIME 30000000
+
+struct LoggedEvent
+{
+    sf::Int64 time;
+    sf::Event event;
+};
+
+// Name of the event types a log can hold, NULL for the others
+inline const char* getEventName(sf::Event::EventType type)
+{
+    switch (type)
+    {
+        case sf::Event::KeyPressed:          return "key-pressed";
+        case sf::Event::KeyReleased:         return "key-released";
+        case sf::Event::MouseWheelMoved:     return "wheel";
+        case sf::Event::MouseButtonPressed:  return "button-pressed";
+        case sf::Event::MouseButtonReleased: return "button-released";
+        case sf::Event::MouseMoved:          return "mouse-moved";
+        default:                             return NULL;
+    }
+}
+
+inline bool getEventType(const std::string& name, sf::Event::EventType& type)
+{
+    static const sf::Event::EventType types[] =
+        {sf::Event::KeyPressed, sf::Event::KeyReleased,
+         sf::Event::MouseWheelMoved, sf::Event::MouseButtonPressed,
+         sf::Event::MouseButtonReleased, sf::Event::MouseMoved};
+
+    for (std::size_t i = 0; i < sizeof(types) / sizeof(types[0]); ++i)
+    {
+        if (name == getEventName(types[i]))
+        {
+            type = types[i];
+            return true;
+        }
+    }
+
+    return false;
+}
+
+////////////////////////////////////////////////////////////
+/// Writes the events of a session as they are handled. Closing
+/// the window is left out, a replay ends once it has settled.
+////////////////////////////////////////////////////////////
+class EventRecorder
+{
+public :
+
+    bool open(const std::string& path)
+    {
+        m_file.open(path.c_str());
+        m_file << EVENT_LOG_HEADER << "\n";
+        return m_file.good();
+    }
+
+    bool isOpen() const
+    {
+        return m_file.is_open();
+    }
+
+    void write(sf::Int64 time, const sf::Event& event)
+    {
+        const char* name = getEventName(event.type);
+        if (!name || !m_file.is_open())
+            return;
+
+        // The key that quits is not part of the session
+        if (event.type == sf::Event::KeyPressed &&
+             event.key.code == sf::Keyboard::Escape)
+            return;
+
+        m_file << time << " " << name;
+
+        switch (event.type)
+        {
+            case sf::Event::KeyPressed:
+            case sf::Event::KeyReleased:
+                m_file << " " << event.key.code << " " << event.key.alt
+                       << " " << event.key.control << " " << event.key.shift
+                       << " " << event.key.system;
+                break;
+
+            case sf::Event::MouseWheelMoved:
+                m_file << " " << event.mouseWheel.delta << " "
+                       << event.mouseWheel.x << " " << event.mouseWheel.y;
+                break;
+
+            case sf::Event::MouseButtonPressed:
+            case sf::Event::MouseButtonReleased:
+                m_file << " " << event.mouseButton.button << " "
+                       << event.mouseButton.x << " " << event.mouseButton.y;
+                break;
+
+            default:
+                m_file << " " << event.mouseMove.x << " "
+                       << event.mouseMove.y;
+                break;
+        }
+
+        // Flushed so a crash keeps the events that led to it
+        m_file << std::endl;
+    }
+
+private :
+
+    std::ofstream m_file;
+};
+
+////////////////////////////////////////////////////////////
+/// Hands the events of a log back once their time has come
+////////////////////////////////////////////////////////////
+class EventPlayer
+{
+public :
+
+    EventPlayer() :
+    m_next(0)
+    {
+    }
+
+    bool loadFromFile(const std::string& path)
+    {
+        std::ifstream file(path.c_str());
+        std::string line;
+        if (!std::getline(file, line) || line != EVENT_LOG_HEADER)
+            return false;
+
+        m_events.clear();
+        m_next = 0;
+
+        while (std::getline(file, line))
+        {
+            std::istringstream stream(line);
+            std::string name;
+
+            LoggedEvent logged;
+            if (!(stream >> logged.time >> name) ||
+                 !getEventType(name, logged.event.type))
+                return false;
+
+            sf::Event& event = logged.event;
+            int code, button;
+            bool ok;
+            switch (event.type)
+            {
+                case sf::Event::KeyPressed:
+                case sf::Event::KeyReleased:
+                    ok = !(stream >> code >> event.key.alt
+                                  >> event.key.control >> event.key.shift
+                                  >> event.key.system).fail();
+                    event.key.code = static_cast<sf::Keyboard::Key>(code);
+                    break;
+
+                case sf::Event::MouseWheelMoved:
+                    ok = !(stream >> event.mouseWheel.delta
+                                  >> event.mouseWheel.x
+                                  >> event.mouseWheel.y).fail();
+                    break;
+
+                case sf::Event::MouseButtonPressed:
+                case sf::Event::MouseButtonReleased:
+                    ok = !(stream >> button >> event.mouseButton.x
+                                  >> event.mouseButton.y).fail();
+                    event.mouseButton.button =
+                        static_cast<sf::Mouse::Button>(button);
+                    break;
+
+                default:
+                    ok = !(stream >> event.mouseMove.x
+                                  >> event.mouseMove.y).fail();
+                    break;
+            }
+
+            if (!ok)
+                return false;
+
+            m_events.push_back(logged);
+        }
+
+        return true;
+    }
+
+    // The next event due by time, false when none is
+    bool poll(sf::Int64 time, LoggedEvent& logged)
+    {
+        if (m_next >= m_events.size() || m_events[m_next].time > time)
+            return false;
+
+        logged = m_events[m_next++];
+        return true;
+    }
+
+    bool isFinished() const
+    {
+        return m_next >= m_events.size();
+    }
+
+    // Time of the last event, 0 for an empty log
+    sf::Int64 getEndTime() const
+    {
+        return m_events.empty() ? 0 : m_events.back().time;
+    }
+
+private :
+
+    std::vector<LoggedEvent> m_events;
+    std::size_t m_next;
+};
+
+////////////////////////////////////////////////////////////
+/// Latency of every replayed event, to the end of the first
+/// frame drawn after it was handled and to the end of the first
+/// frame after that where every shown pane was at full quality.
+/// Frames are timed when display() returns, GPU work that is
+/// still queued then is not counted.
+////////////////////////////////////////////////////////////
+class LatencyMeter
+{
+public :
+
+    LatencyMeter() :
+    m_settled(0)
+    {
+    }
+
+    // An event was handled, time is when it was due
+    void onEvent(const LoggedEvent& logged)
+    {
+        Sample sample;
+        sample.type = logged.event.type;
+        sample.time = logged.time;
+        sample.firstFrame = -1;
+        sample.fullQuality = -1;
+
+        m_samples.push_back(sample);
+    }
+
+    // A frame was shown at time, complete when no pane is still
+    // refining
+    void onFrame(sf::Int64 time, bool complete)
+    {
+        for (std::size_t i = m_settled; i < m_samples.size(); ++i)
+        {
+            Sample& sample = m_samples[i];
+            if (sample.firstFrame < 0)
+                sample.firstFrame = time - sample.time;
+            if (complete && sample.fullQuality < 0)
+                sample.fullQuality = time - sample.time;
+        }
+
+        // Events are settled in order
+        while (m_settled < m_samples.size() &&
+                m_samples[m_settled].fullQuality >= 0)
+            ++m_settled;
+    }
+
+    bool isSettled() const
+    {
+        return m_settled == m_samples.size();
+    }
+
+    // Every event as CSV, times in milliseconds, -1 if never reached
+    void writeEvents(std::ostream& out) const
+    {
+        out << "time,event,first_frame_ms,full_quality_ms\n";
+
+        char temp[128];
+        for (std::size_t i = 0; i < m_samples.size(); ++i)
+        {
+            const Sample& sample = m_samples[i];
+            sprintf(temp, "%.3f,%s,%.3f,%.3f\n", sample.time / 1000.0,
+                    getEventName(sample.type), toMilliseconds(
+                    sample.firstFrame), toMilliseconds(sample.fullQuality));
+            out << temp;
+        }
+    }
+
+    // Median, 95th percentile and worst of each kind of event
+    void writeSummary(std::ostream& out) const
+    {
+        static const sf::Event::EventType types[] =
+            {sf::Event::MouseMoved, sf::Event::MouseButtonPressed,
+             sf::Event::MouseButtonReleased, sf::Event::MouseWheelMoved,
+             sf::Event::KeyPressed, sf::Event::KeyReleased};
+
+        out << "event            count   first frame ms (50/95/max)"
+            << "   full quality ms (50/95/max)\n";
+
+        for (std::size_t t = 0; t < sizeof(types) / sizeof(types[0]); ++t)
+        {
+            std::vector<sf::Int64> first, full;
+            int missing = 0;
+            for (std::size_t i = 0; i < m_samples.size(); ++i)
+            {
+                if (m_samples[i].type != types[t])
+                    continue;
+
+                first.push_back(m_samples[i].firstFrame);
+                if (m_samples[i].fullQuality >= 0)
+                    full.push_back(m_samples[i].fullQuality);
+                else
+                    ++missing;
+            }
+
+            if (first.empty())
+                continue;
+
+            char temp[256];
+            sprintf(temp, "%-16s %5d   %8.1f %8.1f %8.1f   %8.1f %8.1f %8.1f",
+                    getEventName(types[t]), static_cast<int>(first.size()),
+                    getPercentile(first, 0.5), getPercentile(first, 0.95),
+                    getPercentile(first, 1.0), getPercentile(full, 0.5),
+                    getPercentile(full, 0.95), getPercentile(full, 1.0));
+            out << temp;
+
+            if (missing > 0)
+                out << "   (" << missing << " never at full quality)";
+            out << "\n";
+        }
+    }
+
+private :
+
+    struct Sample
+    {
+        sf::Event::EventType type;
+        sf::Int64 time;
+
+        // Microseconds after time, -1 until reached
+        sf::Int64 firstFrame;
+        sf::Int64 fullQuality;
+    };
+
+    static double toMilliseconds(sf::Int64 time)
+    {
+        return time < 0 ? -1.0 : time / 1000.0;
+    }
+
+    // Nearest rank percentile in milliseconds, -1 for no values
+    static double getPercentile(std::vector<sf::Int64> values,
+                                double percentile)
+    {
+        if (values.empty())
+            return -1.0;
+
+        std::size_t rank = static_cast<std::size_t>(
+            percentile * (values.size() - 1) + 0.5);
+        std::nth_element(values.begin(), values.begin() + rank,
+                         values.end());
+
+        return values[rank] / 1000.0;
+    }
+
+    std::vector<Sample> m_samples;
+
+    // Events before this one are at full quality
+    std::size_t m_settled;
+};
+
+#endif // EVENTLOG_HPP
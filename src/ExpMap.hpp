@@ -0,0 +1,302 @@
+#ifndef EXPMAP_HPP
+#define EXPMAP_HPP
+
+////////////////////////////////////////////////////////////
+// Headers
+////////////////////////////////////////////////////////////
+#include "Kernel.hpp"
+#include "Precision.hpp"
+#include "IterationMap.hpp"
+#include "Threads.hpp"
+
+#include <SFML/System.hpp>
+
+#include <vector>
+#include <algorithm>
+#include <cmath>
+
+////////////////////////////////////////////////////////////
+// Exponential map of a zoom, a strip in log-polar coordinates
+// around the center of the view. Columns go once around the
+// center and every row is a step of 2*pi / width further in, so
+// the pixels stay square and every scale of the zoom costs the
+// same number of rows. Any frame of the zoom is resampled out
+// of the strip instead of being rendered.
+//
+// The params of a strip are the outermost frame: x and y are
+// the center, zoom its width and size the width of the strip.
+// Row 0 starts at the corners of that frame.
+////////////////////////////////////////////////////////////
+
+// Rows handed to a thread at a time
+#define EXPMAP_BAND 16
+
+#define EXPMAP_TWO_PI 6.28318530717958647692
+
+// Radius of the outer edge of the strip
+inline double getExpMapRadius(const KernelParams& params)
+{
+    return params.zoom * sqrt(0.5);
+}
+
+// Rows needed to go from the outer frame to a frame of endZoom
+// shown frameSize pixels wide, down to half of its pixels
+inline int getExpMapRows(const KernelParams& params, double endZoom,
+                         int frameSize)
+{
+    double inner = endZoom / frameSize * 0.5;
+    double rows = log(getExpMapRadius(params) / inner) * params.size /
+                  EXPMAP_TWO_PI;
+
+    return std::max(1, static_cast<int>(ceil(rows)));
+}
+
+// Distance from the center of the middle of a row
+inline double getExpMapRowRadius(const KernelParams& params, double row)
+{
+    return getExpMapRadius(params) *
+           exp(-(row + 0.5) * EXPMAP_TWO_PI / params.size);
+}
+
+////////////////////////////////////////////////////////////
+/// Fills a strip on every core, each row in the precision its
+/// own pixel spacing needs. Rows past double all perturb one
+/// double-double orbit of the center.
+////////////////////////////////////////////////////////////
+class ExpMapRenderer : sf::NonCopyable
+{
+public :
+
+    ExpMapRenderer() :
+    m_strip(NULL),
+    m_nextRow(0)
+    {
+    }
+
+    // strip must already be created for params, blocks until done
+    void render(const KernelParams& params, int features,
+                IterationMap& strip)
+    {
+        m_params = params;
+        m_features = features;
+        m_strip = &strip;
+        m_nextRow = 0;
+
+        strip.setLayout(LayoutExponential);
+
+        if (!params.almond)
+            m_orbit.compute(params, DoubleDouble(-params.x),
+                            DoubleDouble(-params.y));
+
+        std::vector<sf::Thread*> threads;
+        for (unsigned int i = 0; i < getCoreCount(); ++i)
+        {
+            threads.push_back(new sf::Thread(&ExpMapRenderer::work, this));
+            threads.back()->launch();
+        }
+
+        for (std::size_t i = 0; i < threads.size(); ++i)
+        {
+            threads[i]->wait();
+            delete threads[i];
+        }
+    }
+
+private :
+
+    void work()
+    {
+        std::vector<IterationSample> scratch(m_strip->getWidth());
+
+        int first;
+        while (nextBand(first))
+        {
+            int last = std::min(first + EXPMAP_BAND, m_strip->getHeight());
+            for (int row = first; row < last; ++row)
+            {
+                if (m_features & KernelTraps)
+                    renderRowVariant<KernelTraps>(row, &scratch[0]);
+                else
+                    renderRowVariant<KernelPlain>(row, &scratch[0]);
+
+                // Rows never overlap so the strip needs no lock
+                m_strip->store(0, row, m_strip->getWidth(), 1, &scratch[0],
+                               m_strip->getWidth());
+            }
+        }
+    }
+
+    // The compiled variant for the distance and interior bits, Traps
+    // is KernelTraps or KernelPlain and goes with all
+    template <int Traps>
+    void renderRowVariant(int row, IterationSample* out)
+    {
+        switch (m_features & (KernelDistance | KernelInterior))
+        {
+            case KernelDistance:
+                renderRow<KernelDistance | Traps>(row, out);
+                break;
+
+            case KernelInterior:
+                renderRow<KernelInterior | Traps>(row, out);
+                break;
+
+            case KernelDistance | KernelInterior:
+                renderRow<KernelDistance | KernelInterior | Traps>(row, out);
+                break;
+
+            default:
+                renderRow<KernelPlain | Traps>(row, out);
+                break;
+        }
+    }
+
+    template <int Features>
+    void renderRow(int row, IterationSample* out)
+    {
+        int width = m_strip->getWidth();
+        double radius = getExpMapRowRadius(m_params, row);
+        double spacing = radius * EXPMAP_TWO_PI / width;
+
+        // The kernels read the pixel size from the params
+        KernelParams params = m_params;
+        params.zoom = spacing * params.size;
+
+        double magnitude = std::max(fabs(m_params.x), fabs(m_params.y)) +
+                           radius;
+        int precision = choosePrecision(magnitude, spacing, m_params.almond);
+
+        for (int column = 0; column < width; ++column)
+        {
+            double angle = (column + 0.5) * EXPMAP_TWO_PI / width;
+            double offsetReal = radius * cos(angle);
+            double offsetImag = radius * sin(angle);
+
+            if (precision <= PrecisionDouble)
+            {
+                out[column] = iteratePoint<double, Features>(params,
+                                    -m_params.x + offsetReal,
+                                    -m_params.y + offsetImag);
+            }
+            else if (precision == PrecisionDoubleDouble ||
+                      !iteratePerturbed<Features>(params, m_orbit, offsetReal,
+                                                  offsetImag, out[column]))
+            {
+                out[column] = iteratePoint<DoubleDouble, Features>(params,
+                                    DoubleDouble(-m_params.x) + offsetReal,
+                                    DoubleDouble(-m_params.y) + offsetImag);
+            }
+        }
+    }
+
+    bool nextBand(int& first)
+    {
+        sf::Lock lock(m_mutex);
+        if (m_nextRow >= m_strip->getHeight())
+            return false;
+
+        first = m_nextRow;
+        m_nextRow += EXPMAP_BAND;
+        return true;
+    }
+
+    KernelParams m_params;
+    int m_features;
+    IterationMap* m_strip;
+    ReferenceOrbit m_orbit;
+
+    sf::Mutex m_mutex;
+    int m_nextRow;
+};
+
+////////////////////////////////////////////////////////////
+/// Resample the frame of the given zoom out of a strip, frame
+/// is created size pixels wide with the channels of the strip.
+/// Color and distance are interpolated between the four strip
+/// pixels around each frame pixel unless one of them is inside,
+/// the rest are taken from the nearest one.
+////////////////////////////////////////////////////////////
+inline void resampleExpMap(const IterationMap& strip, double zoom, int size,
+                           IterationMap& frame)
+{
+    const KernelParams& stripParams = strip.getParams();
+
+    KernelParams params = stripParams;
+    params.zoom = zoom;
+    params.size = size;
+
+    int channels = 0;
+    for (int c = ChannelDistance; c < ChannelCount; ++c)
+        if (strip.hasChannel(c))
+            channels |= 1 << c;
+
+    frame.create(params, size, size, channels);
+
+    int width = strip.getWidth();
+    int height = strip.getHeight();
+    double logOuter = log(getExpMapRadius(stripParams));
+    double scale = width / EXPMAP_TWO_PI;
+
+    std::vector<IterationSample> row(size);
+    for (int y = 0; y < size; ++y)
+    {
+        double offsetImag = -pixelOffset(params, y);
+
+        for (int x = 0; x < size; ++x)
+        {
+            double offsetReal = pixelOffset(params, x);
+            double radius = sqrt(offsetReal * offsetReal +
+                                 offsetImag * offsetImag);
+            double angle = atan2(offsetImag, offsetReal);
+            if (angle < 0.0)
+                angle += EXPMAP_TWO_PI;
+
+            // Strip coordinates relative to the pixel centers
+            double u = angle * scale - 0.5;
+            double v = (logOuter - log(std::max(radius, 1e-300))) * scale - 0.5;
+            v = std::min(std::max(v, 0.0), height - 1.0);
+
+            int u0 = static_cast<int>(floor(u));
+            int v0 = static_cast<int>(floor(v));
+            double fu = u - u0;
+            double fv = v - v0;
+
+            // Angles wrap around, radii stop at the ends of the strip
+            int columns[2] = {(u0 + width) % width, (u0 + 1) % width};
+            int rows[2] = {v0, std::min(v0 + 1, height - 1)};
+
+            IterationSample corners[4];
+            bool inside = false;
+            for (int i = 0; i < 4; ++i)
+            {
+                corners[i] = strip.getSample(columns[i & 1], rows[i >> 1]);
+                inside |= isInsideSample(corners[i],
+                                         stripParams.maxIterations);
+            }
+
+            int nearest = (fu < 0.5 ? 0 : 1) + (fv < 0.5 ? 0 : 2);
+            IterationSample& sample = row[x];
+            sample = corners[nearest];
+
+            if (!inside)
+            {
+                double weights[4] = {(1 - fu) * (1 - fv), fu * (1 - fv),
+                                     (1 - fu) * fv, fu * fv};
+
+                double color = 0.0, distance = 0.0;
+                for (int i = 0; i < 4; ++i)
+                {
+                    color += weights[i] * corners[i].color;
+                    distance += weights[i] * corners[i].distance;
+                }
+
+                sample.color = color;
+                sample.distance = distance;
+            }
+        }
+
+        frame.store(0, y, size, 1, &row[0], size);
+    }
+}
+
+#endif // EXPMAP_HPP
@@ -0,0 +1,386 @@
+#ifndef FIXEDPOINT_HPP
+#define FIXEDPOINT_HPP
+
+////////////////////////////////////////////////////////////
+// Headers
+////////////////////////////////////////////////////////////
+#include "Kernel.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+    #define FIXED_POINT_AVX2
+    #include <immintrin.h>
+#endif
+
+////////////////////////////////////////////////////////////
+// Fixed point kernel, integers only so every x86-64 machine and
+// every compiler produces the same bits. Floating point results
+// change with the compiler, its flags and the driver, which shows
+// up as seams between the tiles of a render spread over machines.
+//
+// Numbers are Q5.58 in a 64 bit integer: a sign, 5 integer bits
+// and 58 fraction bits. That is 5 bits more than a double has for
+// coordinates around 1, enough for the depths the GPU does in
+// emulated double. Products are taken to 128 bits and rounded
+// down, with __int128 one lane at a time or with four 32 bit
+// multiplies per product on four AVX2 lanes, both give the same
+// bits. The 5 integer bits hold every value one step can produce
+// from |z| < 2 and components of c within 2.
+////////////////////////////////////////////////////////////
+
+#define FIXED_FRACTION_BITS 58
+
+// Lanes iterated together, one AVX2 register of 64 bit integers
+#define FIXED_LANES 4
+
+// Largest coordinate the kernel takes, see above
+#define FIXED_MAX_COORDINATE 2.0
+
+typedef long long Fixed;
+
+static const Fixed FIXED_ONE = 1LL << FIXED_FRACTION_BITS;
+
+// Truncates towards 0, the same everywhere for the same double
+inline Fixed toFixed(double value)
+{
+    return static_cast<Fixed>(value * static_cast<double>(FIXED_ONE));
+}
+
+inline double fixedToDouble(Fixed value)
+{
+    return static_cast<double>(value) / static_cast<double>(FIXED_ONE);
+}
+
+// a * b rounded down
+inline Fixed mulFixed(Fixed a, Fixed b)
+{
+#ifdef __SIZEOF_INT128__
+    return static_cast<Fixed>((static_cast<__int128>(a) * b) >>
+                              FIXED_FRACTION_BITS);
+#else
+    // Same 32 bit halves as the AVX2 version
+    typedef unsigned long long Unsigned;
+    const Unsigned low32 = 0xffffffffULL;
+
+    Unsigned ua = a, ub = b;
+    Unsigned ll = (ua & low32) * (ub & low32);
+    Unsigned lh = (ua & low32) * (ub >> 32);
+    Unsigned hl = (ua >> 32) * (ub & low32);
+    Unsigned hh = (ua >> 32) * (ub >> 32);
+
+    Unsigned mid = (ll >> 32) + (lh & low32) + (hl & low32);
+    Unsigned lo = (ll & low32) | (mid << 32);
+    Unsigned hi = hh + (lh >> 32) + (hl >> 32) + (mid >> 32);
+
+    // The unsigned product read a negative factor as 2^64 too much
+    if (a < 0)
+        hi -= ub;
+    if (b < 0)
+        hi -= ua;
+
+    return static_cast<Fixed>((hi << (64 - FIXED_FRACTION_BITS)) |
+                              (lo >> FIXED_FRACTION_BITS));
+#endif
+}
+
+////////////////////////////////////////////////////////////
+/// log2 out of + - * / alone, which IEEE rounds the same on
+/// every machine unlike the log of the C library. Good to an
+/// ulp or two, the shading only needs it to be repeatable.
+////////////////////////////////////////////////////////////
+inline double portableLog2(double value)
+{
+    // 2^exponent * mantissa with the mantissa in [sqrt(0.5), sqrt(2))
+    int exponent;
+    double mantissa = frexp(value, &exponent);
+    if (mantissa < 0.70710678118654752440)
+    {
+        mantissa *= 2.0;
+        --exponent;
+    }
+
+    // ln(m) = 2 * atanh(s), |s| < 0.172 so 12 terms reach 1e-20
+    double s = (mantissa - 1.0) / (mantissa + 1.0);
+    double s2 = s * s;
+    double term = s;
+    double sum = 0.0;
+    for (int k = 1; k <= 23; k += 2)
+    {
+        sum += term / k;
+        term *= s2;
+    }
+
+    // 2 / ln(2)
+    return exponent + sum * 2.88539008177792681472;
+}
+
+// The escape test of the kernels, on the point after a step
+inline bool isFixedEscaped(Fixed real, Fixed imag)
+{
+    const Fixed two = 2 * FIXED_ONE;
+    if (real >= two || real <= -two || imag >= two || imag <= -two)
+        return true;
+
+    return mulFixed(real, real) + mulFixed(imag, imag) >= 4 * FIXED_ONE;
+}
+
+// Lane state of the fixed point kernel, each lane is one pixel
+struct FixedPacket
+{
+    Fixed real[FIXED_LANES], imag[FIXED_LANES];
+    Fixed cReal[FIXED_LANES], cImag[FIXED_LANES];
+
+    // Steps taken, stops at the first z outside the radius 2 circle
+    Fixed iter[FIXED_LANES];
+};
+
+////////////////////////////////////////////////////////////
+/// One lane at a time. Escapes are decided on the components
+/// first so |z|^2 is only formed when it can not overflow.
+////////////////////////////////////////////////////////////
+inline void iterateFixedScalar(FixedPacket& packet, bool almond,
+                               Fixed maxIterations)
+{
+    const Fixed two = 2 * FIXED_ONE;
+    const Fixed four = 4 * FIXED_ONE;
+    const Fixed tenth = toFixed(0.1);
+
+    for (int i = 0; i < FIXED_LANES; ++i)
+    {
+        Fixed real = packet.real[i], imag = packet.imag[i];
+        Fixed real2 = mulFixed(real, real), imag2 = mulFixed(imag, imag);
+        Fixed iter = 0;
+
+        while (iter < maxIterations)
+        {
+            Fixed product = mulFixed(real, imag);
+            Fixed nextReal = real2 - imag2 + packet.cReal[i];
+            Fixed nextImag = 2 * product + packet.cImag[i];
+
+            if (almond)
+            {
+                Fixed temp = nextReal;
+                nextReal = mulFixed(tenth, nextReal) - nextImag;
+                nextImag = FIXED_ONE + temp + nextImag;
+            }
+
+            real = nextReal;
+            imag = nextImag;
+            ++iter;
+
+            if (real >= two || real <= -two || imag >= two || imag <= -two)
+                break;
+
+            real2 = mulFixed(real, real);
+            imag2 = mulFixed(imag, imag);
+            if (real2 + imag2 >= four)
+                break;
+        }
+
+        packet.real[i] = real;
+        packet.imag[i] = imag;
+        packet.iter[i] = iter;
+    }
+}
+
+#ifdef FIXED_POINT_AVX2
+
+// mulFixed on four lanes, the 64x64 bit product out of four 32x32
+__attribute__((target("avx2")))
+inline __m256i mulFixedAvx2(__m256i a, __m256i b)
+{
+    const __m256i low32 = _mm256_set1_epi64x(0xffffffffLL);
+    const __m256i zero = _mm256_setzero_si256();
+
+    __m256i aHigh = _mm256_srli_epi64(a, 32);
+    __m256i bHigh = _mm256_srli_epi64(b, 32);
+
+    __m256i ll = _mm256_mul_epu32(a, b);
+    __m256i lh = _mm256_mul_epu32(a, bHigh);
+    __m256i hl = _mm256_mul_epu32(aHigh, b);
+    __m256i hh = _mm256_mul_epu32(aHigh, bHigh);
+
+    __m256i mid = _mm256_add_epi64(_mm256_srli_epi64(ll, 32),
+                  _mm256_add_epi64(_mm256_and_si256(lh, low32),
+                                   _mm256_and_si256(hl, low32)));
+    __m256i lo = _mm256_or_si256(_mm256_and_si256(ll, low32),
+                                 _mm256_slli_epi64(mid, 32));
+    __m256i hi = _mm256_add_epi64(
+                 _mm256_add_epi64(hh, _mm256_srli_epi64(lh, 32)),
+                 _mm256_add_epi64(_mm256_srli_epi64(hl, 32),
+                                  _mm256_srli_epi64(mid, 32)));
+
+    // Signed correction, as in the portable mulFixed
+    hi = _mm256_sub_epi64(hi,
+                          _mm256_and_si256(_mm256_cmpgt_epi64(zero, a), b));
+    hi = _mm256_sub_epi64(hi,
+                          _mm256_and_si256(_mm256_cmpgt_epi64(zero, b), a));
+
+    return _mm256_or_si256(_mm256_slli_epi64(hi, 64 - FIXED_FRACTION_BITS),
+                           _mm256_srli_epi64(lo, FIXED_FRACTION_BITS));
+}
+
+////////////////////////////////////////////////////////////
+/// All lanes in lock step. Finished lanes are masked out, so
+/// whatever overflows in them is never kept.
+////////////////////////////////////////////////////////////
+__attribute__((target("avx2")))
+inline void iterateFixedAvx2(FixedPacket& packet, bool almond,
+                             Fixed maxIterations)
+{
+    // Compares are strict, x >= 2 is x > 2 - 1
+    const __m256i twoBelow = _mm256_set1_epi64x(2 * FIXED_ONE - 1);
+    const __m256i twoAbove = _mm256_set1_epi64x(-2 * FIXED_ONE + 1);
+    const __m256i fourBelow = _mm256_set1_epi64x(4 * FIXED_ONE - 1);
+    const __m256i one = _mm256_set1_epi64x(FIXED_ONE);
+    const __m256i tenth = _mm256_set1_epi64x(toFixed(0.1));
+    const __m256i cap = _mm256_set1_epi64x(maxIterations);
+
+    __m256i real = _mm256_loadu_si256((const __m256i*)packet.real);
+    __m256i imag = _mm256_loadu_si256((const __m256i*)packet.imag);
+    __m256i cReal = _mm256_loadu_si256((const __m256i*)packet.cReal);
+    __m256i cImag = _mm256_loadu_si256((const __m256i*)packet.cImag);
+
+    __m256i real2 = mulFixedAvx2(real, real);
+    __m256i imag2 = mulFixedAvx2(imag, imag);
+    __m256i iter = _mm256_setzero_si256();
+
+    // All ones while a lane still runs
+    __m256i active = _mm256_cmpgt_epi64(cap, iter);
+
+    while (!_mm256_testz_si256(active, active))
+    {
+        __m256i product = mulFixedAvx2(real, imag);
+        __m256i nextReal = _mm256_add_epi64(_mm256_sub_epi64(real2, imag2),
+                                            cReal);
+        __m256i nextImag = _mm256_add_epi64(_mm256_add_epi64(product, product),
+                                            cImag);
+
+        if (almond)
+        {
+            __m256i temp = nextReal;
+            nextReal = _mm256_sub_epi64(mulFixedAvx2(tenth, nextReal),
+                                        nextImag);
+            nextImag = _mm256_add_epi64(_mm256_add_epi64(one, temp),
+                                        nextImag);
+        }
+
+        real = _mm256_blendv_epi8(real, nextReal, active);
+        imag = _mm256_blendv_epi8(imag, nextImag, active);
+        iter = _mm256_sub_epi64(iter, active);
+
+        __m256i escaped = _mm256_or_si256(
+            _mm256_or_si256(_mm256_cmpgt_epi64(real, twoBelow),
+                            _mm256_cmpgt_epi64(twoAbove, real)),
+            _mm256_or_si256(_mm256_cmpgt_epi64(imag, twoBelow),
+                            _mm256_cmpgt_epi64(twoAbove, imag)));
+
+        real2 = mulFixedAvx2(real, real);
+        imag2 = mulFixedAvx2(imag, imag);
+        escaped = _mm256_or_si256(escaped,
+            _mm256_cmpgt_epi64(_mm256_add_epi64(real2, imag2), fourBelow));
+
+        active = _mm256_andnot_si256(escaped,
+                                     _mm256_cmpgt_epi64(cap, iter));
+    }
+
+    _mm256_storeu_si256((__m256i*)packet.real, real);
+    _mm256_storeu_si256((__m256i*)packet.imag, imag);
+    _mm256_storeu_si256((__m256i*)packet.iter, iter);
+}
+
+#endif // FIXED_POINT_AVX2
+
+// Whether this machine runs the AVX2 lanes, checked once
+inline bool hasFixedPointAvx2()
+{
+#ifdef FIXED_POINT_AVX2
+    static const bool avx2 = __builtin_cpu_supports("avx2");
+    return avx2;
+#else
+    return false;
+#endif
+}
+
+////////////////////////////////////////////////////////////
+/// Same as renderTile<double, KernelPlain> in fixed point. The
+/// coordinates of the tile must fit, see canUseFixedPoint. The
+/// shading goes through portableLog2 so the colors are as
+/// repeatable as the iterations, as long as the build does not
+/// contract the double math into FMAs.
+////////////////////////////////////////////////////////////
+inline void renderFixedTile(const KernelParams& params, IterationSample* out,
+                            int stride, int left, int top,
+                            int width, int height)
+{
+    // The center is converted on its own so the offsets keep their bits
+    Fixed centerReal = toFixed(-params.x);
+    Fixed centerImag = toFixed(-params.y);
+    Fixed maxIterations = static_cast<Fixed>(ceil(params.maxIterations));
+
+    bool avx2 = hasFixedPointAvx2();
+    FixedPacket packet;
+
+    for (int y = 0; y < height; ++y)
+    {
+        Fixed rowImag = centerImag - toFixed(pixelOffset(params, top + y));
+
+        for (int x = 0; x < width; x += FIXED_LANES)
+        {
+            // The last packet of a row repeats its final pixel
+            for (int i = 0; i < FIXED_LANES; ++i)
+            {
+                int column = left + std::min(x + i, width - 1);
+                packet.real[i] = centerReal +
+                                 toFixed(pixelOffset(params, column));
+                packet.imag[i] = rowImag;
+                packet.cReal[i] = params.julia ? toFixed(params.juliaA) :
+                                                 packet.real[i];
+                packet.cImag[i] = params.julia ? toFixed(params.juliaB) :
+                                                 packet.imag[i];
+            }
+
+#ifdef FIXED_POINT_AVX2
+            if (avx2)
+                iterateFixedAvx2(packet, params.almond, maxIterations);
+            else
+#endif
+                iterateFixedScalar(packet, params.almond, maxIterations);
+
+            int count = std::min(FIXED_LANES, width - x);
+            for (int i = 0; i < count; ++i)
+            {
+                IterationSample& sample = out[y * stride + x + i];
+                float iter = static_cast<float>(packet.iter[i]);
+
+                sample.iterations = iter;
+                sample.color = 0.0f;
+                sample.distance = 0.0f;
+                sample.atom = 0.0f;
+                sample.period = 0.0f;
+                sample.stripe = 0.0f;
+                sample.trapPoint = 0.0f;
+                sample.trapLine = 0.0f;
+                sample.trapCross = 0.0f;
+
+                if (!isFixedEscaped(packet.real[i], packet.imag[i]))
+                    continue;
+
+                double real = fixedToDouble(packet.real[i]);
+                double imag = fixedToDouble(packet.imag[i]);
+                double r2 = real * real + imag * imag;
+
+                // log(log(r2)) / log(2) as in finishSample
+                if (params.logShading)
+                    sample.color = iter + 1.0 -
+                        portableLog2(portableLog2(r2) * 0.69314718055994530942);
+                else
+                    sample.color = iter;
+            }
+        }
+    }
+}
+
+#endif // FIXEDPOINT_HPP
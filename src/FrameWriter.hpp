@@ -0,0 +1,493 @@
+#ifndef FRAMEWRITER_HPP
+#define FRAMEWRITER_HPP
+
+////////////////////////////////////////////////////////////
+// Headers
+////////////////////////////////////////////////////////////
+#include "Kernel.hpp"
+#include "Palette.hpp"
+#include "IterationMap.hpp"
+#include "RenderFarm.hpp"
+#include "PngWriter.hpp"
+#include "Threads.hpp"
+
+#include <SFML/Graphics.hpp>
+
+#include <vector>
+#include <deque>
+#include <map>
+#include <string>
+#include <algorithm>
+#include <iostream>
+#include <stdio.h>
+
+////////////////////////////////////////////////////////////
+// Output of batch frames in stages, so whoever renders them
+// never waits on encoding or the disk:
+//
+//   render -> color -> encode -> write
+//
+// Bands of rows are passed on by pointer, none of them is
+// copied on the way. Coloring runs on a few threads in any
+// order, encoding puts the bands of a frame back in order and
+// runs on one frame per thread, one thread writes the files.
+// Only so many bands can be on the way, once they are all
+// taken the renderer waits for the slowest stage. A stage with
+// nothing to do sleeps until the stage before it hands it work.
+////////////////////////////////////////////////////////////
+
+// Bands between the renderer and the disk
+#define PIPELINE_BANDS 8
+
+// Threads of the color and encode stages
+#define PIPELINE_COLOR_THREADS 2
+#define PIPELINE_ENCODE_THREADS 2
+
+////////////////////////////////////////////////////////////
+/// Writes batch frames to disk. Images are colored like the
+/// window and encoded band by band as they come in, so their
+/// size is not limited by memory. Maps (.fxim) are collected
+/// whole, their chunk table is written before the chunks.
+////////////////////////////////////////////////////////////
+class FrameWriter : public FrameSink, sf::NonCopyable
+{
+public :
+
+    // compression is the zlib level of images, 0 stores them as is
+    explicit FrameWriter(int compression = Z_DEFAULT_COMPRESSION) :
+    m_compression(compression),
+    m_frame(NULL),
+    m_held(NULL),
+    m_bandsInFlight(0),
+    m_failed(false),
+    m_stopping(false)
+    {
+        for (int i = 0; i < PIPELINE_COLOR_THREADS; ++i)
+            m_threads.push_back(new sf::Thread(&FrameWriter::color, this));
+        for (int i = 0; i < PIPELINE_ENCODE_THREADS; ++i)
+            m_threads.push_back(new sf::Thread(&FrameWriter::encode, this));
+        m_threads.push_back(new sf::Thread(&FrameWriter::writeFiles, this));
+
+        for (std::size_t i = 0; i < m_threads.size(); ++i)
+            m_threads[i]->launch();
+    }
+
+    // Frames not finished by then are dropped
+    ~FrameWriter()
+    {
+        stop();
+
+        delete m_held;
+        for (std::size_t i = 0; i < m_toColor.size(); ++i)
+            delete m_toColor[i];
+
+        for (std::size_t i = 0; i < m_frames.size(); ++i)
+        {
+            Frame* frame = m_frames[i];
+            std::map<int, Band*>::iterator it;
+            for (it = frame->colored.begin(); it != frame->colored.end(); ++it)
+                delete it->second;
+            for (std::size_t j = 0; j < frame->toWrite.size(); ++j)
+                delete frame->toWrite[j];
+
+            if (frame->file)
+                fclose(frame->file);
+            delete frame;
+        }
+    }
+
+    bool begin(const KernelParams& params, int channels,
+               const std::string& path)
+    {
+        Frame* frame = new Frame;
+        frame->path = path;
+        frame->isMap = path.size() > 5 &&
+                       path.substr(path.size() - 5) == ".fxim";
+        frame->bands = 0;
+        frame->nextEncode = 0;
+        frame->encoding = false;
+        frame->file = NULL;
+
+        bool ok = true;
+        if (frame->isMap)
+        {
+            frame->map.create(params, params.size, params.size, channels);
+        }
+        else
+        {
+            // Same defaults as the sliders
+            frame->palette.setCoefficients(sf::Vector3f(0.1, 0.48, 0.32));
+            frame->palette.setRange(params.maxIterations + 2.0);
+            frame->palette.bake();
+
+            ok = frame->png.begin(params.size, params.size, m_compression);
+        }
+
+        sf::Lock lock(m_mutex);
+        m_frames.push_back(frame);
+        m_frame = frame;
+
+        return ok && !m_failed;
+    }
+
+    ////////////////////////////////////////////////////////////
+    /// Hand on the next band of the frame. The newest band is
+    /// held back until the one after it or end() comes in, which
+    /// is how the stages know the last band of a frame.
+    ////////////////////////////////////////////////////////////
+    bool write(IterationMap* map, int top)
+    {
+        Band* band = new Band;
+        band->frame = m_frame;
+        band->index = m_frame->bands++;
+        band->top = top;
+        band->rows = map->getHeight();
+        band->map = map;
+        band->last = false;
+
+        // Wait for room, this is where the renderer is slowed down
+        // to the slowest stage
+        while (true)
+        {
+            unsigned int ticket = m_written.getTicket();
+            {
+                sf::Lock lock(m_mutex);
+                if (m_failed)
+                {
+                    delete band;
+                    return false;
+                }
+
+                if (m_bandsInFlight < PIPELINE_BANDS)
+                {
+                    ++m_bandsInFlight;
+                    bool handed = m_held != NULL;
+                    if (handed)
+                        m_toColor.push_back(m_held);
+                    m_held = band;
+
+                    if (handed)
+                        m_toColorReady.notify();
+                    return true;
+                }
+            }
+
+            m_written.wait(ticket);
+        }
+    }
+
+    bool end()
+    {
+        sf::Lock lock(m_mutex);
+        if (m_held)
+        {
+            m_held->last = true;
+            m_toColor.push_back(m_held);
+            m_held = NULL;
+            m_toColorReady.notify();
+        }
+
+        m_frame = NULL;
+        return !m_failed;
+    }
+
+    // Wait for every frame to be on disk
+    bool finish()
+    {
+        while (true)
+        {
+            unsigned int ticket = m_written.getTicket();
+            {
+                sf::Lock lock(m_mutex);
+                if (m_failed || m_frames.empty())
+                    break;
+            }
+
+            m_written.wait(ticket);
+        }
+
+        stop();
+        return !m_failed;
+    }
+
+private :
+
+    struct Frame;
+
+    struct Band
+    {
+        Band() :
+        map(NULL)
+        {
+        }
+
+        ~Band()
+        {
+            delete map;
+        }
+
+        Frame* frame;
+        int index;
+        int top, rows;
+        bool last;
+
+        // What each stage made out of it
+        IterationMap* map;
+        std::vector<sf::Uint8> pixels;
+        std::vector<unsigned char> bytes;
+    };
+
+    struct Frame
+    {
+        std::string path;
+        bool isMap;
+        int bands;
+
+        Palette palette;
+        PngWriter png;
+        IterationMap map;
+
+        // Colored bands by index, waiting for the ones before them
+        std::map<int, Band*> colored;
+        int nextEncode;
+        bool encoding;
+
+        // Encoded bands in order, for the write stage
+        std::deque<Band*> toWrite;
+        FILE* file;
+    };
+
+    void stop()
+    {
+        {
+            sf::Lock lock(m_mutex);
+            m_stopping = true;
+        }
+
+        m_toColorReady.notify();
+        m_toEncodeReady.notify();
+        m_toWriteReady.notify();
+
+        for (std::size_t i = 0; i < m_threads.size(); ++i)
+        {
+            m_threads[i]->wait();
+            delete m_threads[i];
+        }
+
+        m_threads.clear();
+    }
+
+    // Color stage, any band in any order
+    void color()
+    {
+        while (true)
+        {
+            unsigned int ticket = m_toColorReady.getTicket();
+            Band* band = NULL;
+            {
+                sf::Lock lock(m_mutex);
+                if (m_stopping)
+                    return;
+
+                if (!m_toColor.empty())
+                {
+                    band = m_toColor.front();
+                    m_toColor.pop_front();
+                }
+            }
+
+            if (!band)
+            {
+                m_toColorReady.wait(ticket);
+                continue;
+            }
+
+            Frame* frame = band->frame;
+            if (!frame->isMap)
+            {
+                band->map->colorize(frame->palette, band->pixels);
+                delete band->map;
+                band->map = NULL;
+            }
+
+            sf::Lock lock(m_mutex);
+            frame->colored[band->index] = band;
+            m_toEncodeReady.notify();
+        }
+    }
+
+    // Encode stage, the bands of a frame in order
+    void encode()
+    {
+        while (true)
+        {
+            unsigned int ticket = m_toEncodeReady.getTicket();
+            Frame* frame = NULL;
+            Band* band = NULL;
+            {
+                sf::Lock lock(m_mutex);
+                if (m_stopping)
+                    return;
+
+                for (std::size_t i = 0; i < m_frames.size() && !band; ++i)
+                {
+                    frame = m_frames[i];
+                    std::map<int, Band*>::iterator it =
+                        frame->colored.find(frame->nextEncode);
+                    if (frame->encoding || it == frame->colored.end())
+                        continue;
+
+                    band = it->second;
+                    frame->colored.erase(it);
+                    frame->encoding = true;
+                }
+            }
+
+            if (!band)
+            {
+                m_toEncodeReady.wait(ticket);
+                continue;
+            }
+
+            bool ok = true;
+            if (frame->isMap)
+            {
+                // Maps are stored whole once the last band is in
+                const IterationMap& rows = *band->map;
+                std::vector<IterationSample> row(rows.getWidth());
+
+                for (int y = 0; y < band->rows; ++y)
+                {
+                    for (int x = 0; x < rows.getWidth(); ++x)
+                        row[x] = rows.getSample(x, y);
+
+                    frame->map.store(0, band->top + y, rows.getWidth(), 1,
+                                     &row[0], rows.getWidth());
+                }
+
+                delete band->map;
+                band->map = NULL;
+            }
+            else
+            {
+                ok = frame->png.write(&band->pixels[0], band->rows);
+                if (ok && band->last)
+                    ok = frame->png.close();
+
+                frame->png.takeOutput(band->bytes);
+                std::vector<sf::Uint8>().swap(band->pixels);
+            }
+
+            sf::Lock lock(m_mutex);
+            frame->encoding = false;
+            ++frame->nextEncode;
+            frame->toWrite.push_back(band);
+            m_failed = m_failed || !ok;
+
+            // The next band of the frame may be colored already
+            m_toEncodeReady.notify();
+            m_toWriteReady.notify();
+            if (!ok)
+                m_written.notify();
+        }
+    }
+
+    // Write stage, one thread for every file
+    void writeFiles()
+    {
+        while (true)
+        {
+            unsigned int ticket = m_toWriteReady.getTicket();
+            Frame* frame = NULL;
+            Band* band = NULL;
+            {
+                sf::Lock lock(m_mutex);
+                for (std::size_t i = 0; i < m_frames.size() && !band; ++i)
+                {
+                    frame = m_frames[i];
+                    if (!frame->toWrite.empty())
+                    {
+                        band = frame->toWrite.front();
+                        frame->toWrite.pop_front();
+                    }
+                }
+
+                if (!band && m_stopping)
+                    return;
+            }
+
+            if (!band)
+            {
+                m_toWriteReady.wait(ticket);
+                continue;
+            }
+
+            bool ok = true;
+            if (!frame->isMap)
+            {
+                if (!frame->file)
+                    frame->file = fopen(frame->path.c_str(), "wb");
+
+                ok = frame->file && (band->bytes.empty() ||
+                     fwrite(&band->bytes[0], 1, band->bytes.size(),
+                            frame->file) == band->bytes.size());
+            }
+
+            bool last = band->last;
+            delete band;
+
+            if (last)
+            {
+                if (frame->isMap)
+                    ok = frame->map.saveToFile(frame->path);
+                else if (frame->file)
+                    ok = fclose(frame->file) == 0 && ok;
+                frame->file = NULL;
+
+                std::cout << (ok ? "Wrote " : "Could not write ")
+                          << frame->path << std::endl;
+            }
+            else if (!ok)
+            {
+                std::cout << "Could not write " << frame->path << std::endl;
+            }
+
+            sf::Lock lock(m_mutex);
+            --m_bandsInFlight;
+            m_failed = m_failed || !ok;
+
+            if (last)
+            {
+                m_frames.erase(std::find(m_frames.begin(), m_frames.end(),
+                                         frame));
+                delete frame;
+            }
+
+            m_written.notify();
+        }
+    }
+
+    int m_compression;
+
+    // Frame and band coming in from the renderer
+    Frame* m_frame;
+    Band* m_held;
+
+    sf::Mutex m_mutex;
+    std::deque<Band*> m_toColor;
+    std::vector<Frame*> m_frames;
+    int m_bandsInFlight;
+    bool m_failed;
+    bool m_stopping;
+
+    // Work handed to each stage, and a band leaving the pipeline
+    // or a failure for the renderer and finish()
+    Condition m_toColorReady;
+    Condition m_toEncodeReady;
+    Condition m_toWriteReady;
+    Condition m_written;
+
+    std::vector<sf::Thread*> m_threads;
+};
+
+#endif // FRAMEWRITER_HPP
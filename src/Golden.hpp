@@ -0,0 +1,367 @@
+#ifndef GOLDEN_HPP
+#define GOLDEN_HPP
+
+////////////////////////////////////////////////////////////
+// Headers
+////////////////////////////////////////////////////////////
+#include "Kernel.hpp"
+#include "Precision.hpp"
+#include "FixedPoint.hpp"
+#include "IterationMap.hpp"
+#include "Renderer.hpp"
+
+#include <SFML/Graphics.hpp>
+
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+
+////////////////////////////////////////////////////////////
+// Golden image regression checks for the kernels and shaders
+//
+// A catalogue of views is rendered with every kernel that can
+// handle it and kept as reference maps. A check renders them all
+// again and compares pixel by pixel, so a faster kernel that
+// changes its picture is caught. Each kernel is held to its own
+// references, the lower precisions legitimately differ from
+// double-double next to the set; how much is reported alongside.
+// When there is an OpenGL context the float and double-single
+// shaders are drawn too and compared by color to the CPU kernel
+// of their precision, rendered with the same cap and palette.
+////////////////////////////////////////////////////////////
+
+// Width of the golden renders
+#define GOLDEN_SIZE 128
+
+// Difference in color a pixel may have before it counts as changed,
+// distances are compared relative to their size
+#define GOLDEN_TOLERANCE 0.01
+
+// Share of the pixels that may change before a check fails, room for
+// compilers that contract the double math into FMAs
+#define GOLDEN_BUDGET 0.001
+
+// The shaders are held to the CPU kernel of their precision by the
+// colors they draw, GPUs round and contract differently so a few
+// steps of color and a few escaping pixels are let through
+#define GOLDEN_SHADER_TOLERANCE 8
+#define GOLDEN_SHADER_BUDGET 0.02
+
+enum GoldenBackend
+{
+    GoldenFloat,
+    GoldenDouble,
+    GoldenFixedPoint,
+    GoldenDoubleDouble,
+    GoldenPerturbation,
+
+    // renderTileAuto, what the explorer and the farm run
+    GoldenAuto,
+
+    GoldenBackendCount
+};
+
+inline const char* getGoldenBackendName(int backend)
+{
+    static const char* names[GoldenBackendCount] =
+        {"Float", "Double", "Fixed Point", "Double-Double", "Perturbation",
+         "Auto"};
+
+    return names[backend];
+}
+
+// Reference file of a view and backend in directory
+inline std::string getGoldenPath(const std::string& directory,
+                                 const char* view, int backend)
+{
+    static const char* files[GoldenBackendCount] =
+        {"float", "double", "fixed", "dd", "perturbation", "auto"};
+
+    return directory + "/" + view + "-" + files[backend] + ".fxim";
+}
+
+struct GoldenView
+{
+    const char* name;
+
+    // Same meaning as KernelParams, the center is stored negated
+    double x, y, zoom;
+    bool julia;
+    double juliaA, juliaB;
+    bool almond;
+    float maxIterations;
+
+    int features;
+};
+
+// The catalogue, every kernel and feature is covered by a view
+inline const GoldenView* getGoldenViews(int& count)
+{
+    static const GoldenView views[] =
+    {
+        {"overview", 0.5, 0.0, 3.0, false, 0.0, 0.0, false, 200.0f,
+         KernelPlain},
+        {"interior", 0.5, 0.0, 3.0, false, 0.0, 0.0, false, 500.0f,
+         KernelInterior},
+        {"seahorse", 0.7436438870371587, -0.1318259042053119, 1e-3,
+         false, 0.0, 0.0, false, 500.0f, KernelDistance},
+        {"mid-depth", 0.7436438870371587, -0.1318259042053119, 1e-9,
+         false, 0.0, 0.0, false, 3000.0f, KernelPlain},
+        {"past-double", 0.7436438870371587, -0.1318259042053119, 4e-13,
+         false, 0.0, 0.0, false, 4000.0f, KernelPlain},
+        {"deep", 0.7436438870371587, -0.1318259042053119, 1e-14,
+         false, 0.0, 0.0, false, 6000.0f, KernelPlain},
+        {"julia", 0.0, 0.0, 3.0, true, -0.8, 0.156, false, 300.0f,
+         KernelDistance | KernelInterior},
+        {"almond", 0.5, 0.2, 3.0, false, 0.0, 0.0, true, 200.0f,
+         KernelPlain},
+        {"traps", 0.7436438870371587, -0.1318259042053119, 1e-3,
+         false, 0.0, 0.0, false, 500.0f, KernelTraps}
+    };
+
+    count = sizeof(views) / sizeof(views[0]);
+    return views;
+}
+
+inline KernelParams getGoldenParams(const GoldenView& view, int size)
+{
+    KernelParams params;
+    params.x = view.x;
+    params.y = view.y;
+    params.zoom = view.zoom;
+    params.juliaA = view.juliaA;
+    params.juliaB = view.juliaB;
+    params.julia = view.julia;
+    params.almond = view.almond;
+    params.logShading = true;
+    params.maxIterations = view.maxIterations;
+    params.size = size;
+
+    return params;
+}
+
+// Whether a backend is meant to render this view at all
+inline bool canRunGolden(int backend, const KernelParams& params,
+                         int features)
+{
+    int precision = choosePrecision(params, 0, 0, params.size, params.size);
+
+    switch (backend)
+    {
+        case GoldenFloat:
+            return precision == PrecisionFloat;
+
+        case GoldenDouble:
+            return precision <= PrecisionDouble;
+
+        case GoldenFixedPoint:
+            return (features & KernelVariants) == KernelPlain &&
+                   canUseFixedPoint(params, 0, 0, params.size, params.size);
+
+        case GoldenPerturbation:
+            return !params.almond;
+
+        default:
+            return true;
+    }
+}
+
+// Fill map, already created for params, with one backend
+inline void renderGolden(int backend, const KernelParams& params,
+                         int features, IterationMap& map)
+{
+    std::vector<IterationSample> samples(RENDER_TILE * RENDER_TILE);
+
+    // Same tiles as the explorer, perturbation depends on them
+    for (int top = 0; top < map.getHeight(); top += RENDER_TILE)
+    {
+        for (int left = 0; left < map.getWidth(); left += RENDER_TILE)
+        {
+            int width = std::min(RENDER_TILE, map.getWidth() - left);
+            int height = std::min(RENDER_TILE, map.getHeight() - top);
+            IterationSample* out = &samples[0];
+
+            switch (backend)
+            {
+                case GoldenFloat:
+                    renderTile<float>(params, features, out, RENDER_TILE,
+                                      left, top, width, height);
+                    break;
+
+                case GoldenDouble:
+                    renderTile<double>(params, features, out, RENDER_TILE,
+                                       left, top, width, height);
+                    break;
+
+                case GoldenFixedPoint:
+                    renderFixedTile(params, out, RENDER_TILE,
+                                    left, top, width, height);
+                    break;
+
+                case GoldenDoubleDouble:
+                    renderTile<DoubleDouble>(params, features, out,
+                                    RENDER_TILE, left, top, width, height);
+                    break;
+
+                case GoldenPerturbation:
+                    renderPerturbedTile(params, features, out, RENDER_TILE,
+                                        left, top, width, height);
+                    break;
+
+                default:
+                    renderTileAuto(params, features, out, RENDER_TILE,
+                                   left, top, width, height);
+                    break;
+            }
+
+            map.store(left, top, width, height, out, RENDER_TILE);
+        }
+    }
+}
+
+struct GoldenResult
+{
+    int mismatches;
+
+    // Largest color difference of any pixel
+    double maxDifference;
+};
+
+////////////////////////////////////////////////////////////
+/// Compare a render against its reference, the maps must be
+/// the same size. heatmap gets RGBA pixels that are black where
+/// the pixel matched and brighter red the more it changed.
+////////////////////////////////////////////////////////////
+inline GoldenResult compareGolden(const IterationMap& map,
+                                  const IterationMap& reference,
+                                  std::vector<sf::Uint8>& heatmap)
+{
+    GoldenResult result;
+    result.mismatches = 0;
+    result.maxDifference = 0.0;
+
+    int width = map.getWidth(), height = map.getHeight();
+    heatmap.assign(width * height * 4, 0);
+
+    bool distance = map.hasChannel(ChannelDistance) &&
+                    reference.hasChannel(ChannelDistance);
+    bool interior = map.hasChannel(ChannelPeriod) &&
+                    reference.hasChannel(ChannelPeriod);
+    bool traps = map.hasChannel(ChannelStripe) &&
+                 reference.hasChannel(ChannelStripe);
+
+    for (int y = 0; y < height; ++y)
+    {
+        for (int x = 0; x < width; ++x)
+        {
+            IterationSample a = map.getSample(x, y);
+            IterationSample b = reference.getSample(x, y);
+
+            double difference = fabs(a.color - b.color);
+            result.maxDifference = std::max(result.maxDifference, difference);
+
+            bool changed = difference > GOLDEN_TOLERANCE ||
+                           a.iterations != b.iterations;
+            if (distance)
+                changed |= fabs(a.distance - b.distance) >
+                           GOLDEN_TOLERANCE * fabs(b.distance);
+            if (interior)
+                changed |= a.period != b.period;
+            if (traps)
+                changed |= fabs(a.stripe - b.stripe) > GOLDEN_TOLERANCE ||
+                           fabs(a.trapPoint - b.trapPoint) >
+                           GOLDEN_TOLERANCE * fabs(b.trapPoint) ||
+                           fabs(a.trapLine - b.trapLine) >
+                           GOLDEN_TOLERANCE * fabs(b.trapLine) ||
+                           fabs(a.trapCross - b.trapCross) >
+                           GOLDEN_TOLERANCE * fabs(b.trapCross);
+
+            if (!changed)
+                continue;
+
+            ++result.mismatches;
+
+            // Every mismatch shows, big ones are brighter
+            sf::Uint8* pixel = &heatmap[(y * width + x) * 4];
+            pixel[0] = 96 + static_cast<int>(159 * std::min(difference / 10.0,
+                                                             1.0));
+        }
+    }
+
+    for (std::size_t i = 3; i < heatmap.size(); i += 4)
+        heatmap[i] = 255;
+
+    return result;
+}
+
+enum GoldenShader
+{
+    GoldenShaderFloat,
+    GoldenShaderEmulated,
+
+    GoldenShaderCount
+};
+
+inline const char* getGoldenShaderName(int shader)
+{
+    static const char* names[GoldenShaderCount] =
+        {"GLSL Float", "GLSL Double-Single"};
+
+    return names[shader];
+}
+
+// CPU kernel each shader is compared against
+inline int getGoldenShaderBackend(int shader)
+{
+    return shader == GoldenShaderFloat ? GoldenFloat : GoldenDouble;
+}
+
+// Heatmap of a shader render next to the references in directory
+inline std::string getGoldenShaderPath(const std::string& directory,
+                                       const char* view, int shader)
+{
+    static const char* files[GoldenShaderCount] =
+        {"glsl-float", "glsl-emulated"};
+
+    return directory + "/" + view + "-" + files[shader] + "-diff.png";
+}
+
+////////////////////////////////////////////////////////////
+/// Compare two RGBA images of the same size, a pixel changed
+/// when any channel is off by more than GOLDEN_SHADER_TOLERANCE.
+/// The heatmap is filled like the one of compareGolden.
+////////////////////////////////////////////////////////////
+inline GoldenResult compareGoldenPixels(const std::vector<sf::Uint8>& pixels,
+                                const std::vector<sf::Uint8>& reference,
+                                std::vector<sf::Uint8>& heatmap)
+{
+    GoldenResult result;
+    result.mismatches = 0;
+    result.maxDifference = 0.0;
+
+    heatmap.assign(pixels.size(), 0);
+
+    for (std::size_t i = 0; i + 3 < pixels.size(); i += 4)
+    {
+        int difference = 0;
+        for (int c = 0; c < 3; ++c)
+            difference = std::max(difference,
+                                  std::abs(pixels[i + c] - reference[i + c]));
+
+        result.maxDifference = std::max(result.maxDifference,
+                                        static_cast<double>(difference));
+        heatmap[i + 3] = 255;
+
+        if (difference <= GOLDEN_SHADER_TOLERANCE)
+            continue;
+
+        ++result.mismatches;
+        heatmap[i] = 96 + 159 * difference / 255;
+    }
+
+    return result;
+}
+
+#endif // GOLDEN_HPP
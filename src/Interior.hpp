@@ -0,0 +1,300 @@
+#ifndef INTERIOR_HPP
+#define INTERIOR_HPP
+
+////////////////////////////////////////////////////////////
+// Headers
+////////////////////////////////////////////////////////////
+#include "Kernel.hpp"
+
+#include <vector>
+#include <algorithm>
+#include <cmath>
+
+////////////////////////////////////////////////////////////
+// Hyperbolic components of the Mandlebrot near the view
+//
+// A few reference orbits across the view give atom domain
+// periods, Newton's method turns each into the nucleus of a
+// component of that period and the size estimate gives a disk
+// around the nucleus that is safely inside it. The shader skips
+// every pixel in one of those disks.
+////////////////////////////////////////////////////////////
+
+// Reference orbits across and down the view
+#define INTERIOR_GRID 4
+
+// Components handed to the shader, keep in sync with the shaders
+#define INTERIOR_COMPONENTS 16
+
+// Longest period worth a Newton solve
+#define INTERIOR_MAX_PERIOD 1024
+
+#define INTERIOR_NEWTON_STEPS 16
+
+// Fraction of the size estimate used as the disk radius, a quarter
+// fits inside both cardioids and bulbs
+#define INTERIOR_SAFETY 0.2
+
+struct Component
+{
+    // Nucleus, the center of the component
+    double real, imag;
+
+    // Disk around the nucleus that is all interior
+    double radius;
+
+    int period;
+};
+
+// Atom domain period of c, the index of the smallest |z| before escape
+inline int getAtomPeriod(double cReal, double cImag, float maxIterations)
+{
+    double real = cReal, imag = cImag;
+    double minR2 = real * real + imag * imag;
+    int period = 1;
+
+    for (int i = 2; i <= maxIterations; ++i)
+    {
+        iterateStep(real, imag, cReal, cImag, false);
+
+        double r2 = real * real + imag * imag;
+        if (r2 > 4.0)
+            break;
+
+        if (r2 < minR2)
+        {
+            minR2 = r2;
+            period = i;
+        }
+    }
+
+    return period;
+}
+
+////////////////////////////////////////////////////////////
+/// Newton's method for z_period(c) = 0 starting at c, false
+/// when it does not settle
+////////////////////////////////////////////////////////////
+inline bool findNucleus(double& cReal, double& cImag, int period)
+{
+    for (int step = 0; step < INTERIOR_NEWTON_STEPS; ++step)
+    {
+        // z and dz/dc along the orbit of c
+        double zReal = 0.0, zImag = 0.0;
+        double dReal = 0.0, dImag = 0.0;
+        for (int i = 0; i < period; ++i)
+        {
+            double temp = 2.0 * (zReal * dReal - zImag * dImag) + 1.0;
+            dImag = 2.0 * (zReal * dImag + zImag * dReal);
+            dReal = temp;
+
+            iterateStep(zReal, zImag, cReal, cImag, false);
+        }
+
+        double norm = dReal * dReal + dImag * dImag;
+        if (norm == 0.0 || norm != norm)
+            return false;
+
+        // c -= z / dz
+        double stepReal = (zReal * dReal + zImag * dImag) / norm;
+        double stepImag = (zImag * dReal - zReal * dImag) / norm;
+        cReal -= stepReal;
+        cImag -= stepImag;
+
+        double size = stepReal * stepReal + stepImag * stepImag;
+        if (size < 1e-28 * (cReal * cReal + cImag * cImag + 1e-28))
+            return true;
+    }
+
+    return false;
+}
+
+// Size estimate of the component with this nucleus and period
+inline double getComponentSize(double cReal, double cImag, int period)
+{
+    // l is the product of 2z, b sums 1/l
+    double zReal = 0.0, zImag = 0.0;
+    double lReal = 1.0, lImag = 0.0;
+    double bReal = 1.0, bImag = 0.0;
+
+    for (int i = 1; i < period; ++i)
+    {
+        iterateStep(zReal, zImag, cReal, cImag, false);
+
+        double temp = 2.0 * (zReal * lReal - zImag * lImag);
+        lImag = 2.0 * (zReal * lImag + zImag * lReal);
+        lReal = temp;
+
+        double norm = lReal * lReal + lImag * lImag;
+        if (norm == 0.0)
+            return 0.0;
+        bReal += lReal / norm;
+        bImag -= lImag / norm;
+    }
+
+    // |1 / (b l^2)|
+    double l2 = lReal * lReal + lImag * lImag;
+    double b = sqrt(bReal * bReal + bImag * bImag);
+    return b * l2 > 0.0 ? 1.0 / (b * l2) : 0.0;
+}
+
+////////////////////////////////////////////////////////////
+/// Multiplier of the attracting cycle of c, found with Newton's
+/// method on the period-th iterate starting from the orbit of c.
+/// Returns a value >= 1 when there is no attracting cycle.
+////////////////////////////////////////////////////////////
+inline double getCycleMultiplier(double cReal, double cImag, int period)
+{
+    // Start from the settled orbit
+    double real = 0.0, imag = 0.0;
+    for (int i = 0; i < period * 8; ++i)
+        iterateStep(real, imag, cReal, cImag, false);
+
+    double mReal = 1.0, mImag = 0.0;
+    for (int step = 0; step < INTERIOR_NEWTON_STEPS; ++step)
+    {
+        double zReal = real, zImag = imag;
+        mReal = 1.0;
+        mImag = 0.0;
+        for (int i = 0; i < period; ++i)
+        {
+            double temp = 2.0 * (mReal * zReal - mImag * zImag);
+            mImag = 2.0 * (mReal * zImag + mImag * zReal);
+            mReal = temp;
+
+            iterateStep(zReal, zImag, cReal, cImag, false);
+        }
+
+        // Solve f^p(z) - z = 0, the derivative is m - 1
+        double fReal = zReal - real, fImag = zImag - imag;
+        double gReal = mReal - 1.0, gImag = mImag;
+        double norm = gReal * gReal + gImag * gImag;
+        if (norm == 0.0 || norm != norm)
+            return 1.0;
+
+        real -= (fReal * gReal + fImag * gImag) / norm;
+        imag -= (fImag * gReal - fReal * gImag) / norm;
+    }
+
+    return sqrt(mReal * mReal + mImag * mImag);
+}
+
+////////////////////////////////////////////////////////////
+/// Finds the components around a view, and remembers the last
+/// view so it only runs when the view changes
+////////////////////////////////////////////////////////////
+class InteriorAnalysis
+{
+public :
+
+    InteriorAnalysis() :
+    m_params()
+    {
+    }
+
+    const std::vector<Component>& analyze(const KernelParams& params)
+    {
+        if (isSameView(params, m_params) &&
+             params.maxIterations == m_params.maxIterations)
+            return m_components;
+
+        m_params = params;
+        m_components.clear();
+
+        // Components only exist for the plain Mandlebrot
+        if (params.julia || params.almond)
+            return m_components;
+
+        for (int y = 0; y <= INTERIOR_GRID; ++y)
+        {
+            for (int x = 0; x <= INTERIOR_GRID; ++x)
+            {
+                double cReal = -params.x +
+                               (x / (double)INTERIOR_GRID - 0.5) * params.zoom;
+                double cImag = -params.y -
+                               (y / (double)INTERIOR_GRID - 0.5) * params.zoom;
+
+                addComponent(params, cReal, cImag);
+            }
+        }
+
+        // Biggest disks first, they save the most
+        std::sort(m_components.begin(), m_components.end(), isLarger);
+        if (m_components.size() > INTERIOR_COMPONENTS)
+            m_components.resize(INTERIOR_COMPONENTS);
+
+        return m_components;
+    }
+
+private :
+
+    void addComponent(const KernelParams& params, double cReal, double cImag)
+    {
+        int period = getAtomPeriod(cReal, cImag, params.maxIterations);
+
+        // The main components have an exact test of their own
+        if (period <= 2 || period > INTERIOR_MAX_PERIOD ||
+             !findNucleus(cReal, cImag, period))
+            return;
+
+        // Newton can land on a nucleus of a divisor of the period
+        double zReal = 0.0, zImag = 0.0;
+        for (int i = 1; i < period; ++i)
+        {
+            iterateStep(zReal, zImag, cReal, cImag, false);
+            if (zReal * zReal + zImag * zImag < 1e-24)
+                return;
+        }
+
+        Component component;
+        component.real = cReal;
+        component.imag = cImag;
+        component.period = period;
+        component.radius = getComponentSize(cReal, cImag, period) *
+                           INTERIOR_SAFETY;
+
+        // The size estimate is only an estimate, shrink the disk until
+        // the cycle is still attracting all around its edge
+        static const double directions[4][2] = {{1, 0}, {0, 1}, {-1, 0},
+                                                {0, -1}};
+        for (int d = 0; d < 4 && component.radius > 0.0; )
+        {
+            double edgeReal = cReal + directions[d][0] * component.radius;
+            double edgeImag = cImag + directions[d][1] * component.radius;
+            if (getCycleMultiplier(edgeReal, edgeImag, period) < 1.0)
+            {
+                ++d;
+            }
+            else
+            {
+                component.radius *= 0.5;
+                if (component.radius < 1e-3 * params.zoom / params.size)
+                    return;
+            }
+        }
+
+        if (component.radius <= 0.0)
+            return;
+
+        for (std::size_t i = 0; i < m_components.size(); ++i)
+        {
+            double dReal = m_components[i].real - cReal;
+            double dImag = m_components[i].imag - cImag;
+            if (dReal * dReal + dImag * dImag <
+                 component.radius * component.radius * 1e-6)
+                return;
+        }
+
+        m_components.push_back(component);
+    }
+
+    static bool isLarger(const Component& a, const Component& b)
+    {
+        return a.radius > b.radius;
+    }
+
+    KernelParams m_params;
+    std::vector<Component> m_components;
+};
+
+#endif // INTERIOR_HPP
@@ -0,0 +1,799 @@
+#ifndef ITERATIONMAP_HPP
+#define ITERATIONMAP_HPP
+
+////////////////////////////////////////////////////////////
+// Headers
+////////////////////////////////////////////////////////////
+#include "Kernel.hpp"
+#include "Palette.hpp"
+
+#include <SFML/Graphics.hpp>
+
+#include <vector>
+#include <algorithm>
+#include <string>
+#include <cstring>
+#include <stdio.h>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+////////////////////////////////////////////////////////////
+// Raw per pixel data of one render, and the .fxim file format
+//
+// A file is a header, a table of chunks and the chunks. Every
+// chunk holds FXIM_CHUNK_ROWS rows of one channel as floats,
+// either raw or xor-delta/zero-run encoded, whichever is smaller.
+// Raw chunks are used in place from the memory mapped file, so
+// reloading a map only decodes the chunks that compressed well.
+// Everything is little endian.
+////////////////////////////////////////////////////////////
+
+#define FXIM_MAGIC "FXIM"
+#define FXIM_VERSION 3
+#define FXIM_CHUNK_ROWS 32
+
+// Version 1 files predate the interior channels, their chunk table
+// only has room for the first three, version 2 files predate the
+// trap channels
+#define FXIM_V1_CHANNELS 3
+#define FXIM_V2_CHANNELS 5
+
+// Chunks start on this boundary so raw floats can be used in place
+#define FXIM_ALIGNMENT 16
+
+// Largest map a file may describe, anything bigger is taken for a
+// broken file rather than allocated
+#define FXIM_MAX_SIZE 65536
+#define FXIM_MAX_PIXELS (1 << 28)
+
+enum MapChannel
+{
+    ChannelIterations,
+    ChannelColor,
+    ChannelDistance,
+    ChannelAtom,
+    ChannelPeriod,
+    ChannelStripe,
+    ChannelTrapPoint,
+    ChannelTrapLine,
+    ChannelTrapCross,
+
+    ChannelCount
+};
+
+// Channels beyond iterations and color that a kernel variant fills
+inline int getFeatureChannels(int features)
+{
+    int channels = 0;
+    if (features & KernelDistance)
+        channels |= 1 << ChannelDistance;
+    if (features & KernelInterior)
+        channels |= (1 << ChannelAtom) | (1 << ChannelPeriod);
+    if (features & KernelTraps)
+        channels |= (1 << ChannelStripe) | (1 << ChannelTrapPoint) |
+                    (1 << ChannelTrapLine) | (1 << ChannelTrapCross);
+
+    return channels;
+}
+
+// How pixels map onto the plane
+enum MapLayout
+{
+    LayoutGrid,       // Square pane, KernelParams::size wide
+    LayoutExponential // Log-polar strip around the center, see ExpMap.hpp
+};
+
+enum ChunkEncoding
+{
+    EncodingRaw,
+    EncodingXorRun
+};
+
+// On disk header, only fixed size members in a fixed order
+struct MapFileHeader
+{
+    char magic[4];
+    sf::Uint32 version;
+    sf::Uint32 width;
+    sf::Uint32 height;
+    sf::Uint32 channels;   // Bit mask of MapChannel
+    sf::Uint32 chunkRows;
+    sf::Uint32 chunkCount; // Per channel
+    sf::Uint32 flags;      // 1 julia, 2 almond, 4 log shading,
+                           // 8 exponential layout
+
+    double x, y, zoom;
+    double juliaA, juliaB;
+    float maxIterations;
+    sf::Uint32 size;
+};
+
+// One entry per chunk and channel, in channel major order
+struct MapFileChunk
+{
+    sf::Uint64 offset;
+    sf::Uint64 size;
+    sf::Uint32 encoding;
+    sf::Uint32 reserved;
+};
+
+////////////////////////////////////////////////////////////
+/// Read only view of a whole file, mapped where possible
+////////////////////////////////////////////////////////////
+class MappedFile : sf::NonCopyable
+{
+public :
+
+    MappedFile() :
+    m_data(NULL),
+    m_size(0)
+    {
+    }
+
+    ~MappedFile()
+    {
+        close();
+    }
+
+    bool open(const std::string& path)
+    {
+        close();
+
+#ifdef _WIN32
+        // No mmap, fall back on reading the file
+        FILE* file = fopen(path.c_str(), "rb");
+        if (!file)
+            return false;
+
+        fseek(file, 0, SEEK_END);
+        m_buffer.resize(ftell(file));
+        fseek(file, 0, SEEK_SET);
+
+        bool ok = m_buffer.empty() ||
+                  fread(&m_buffer[0], 1, m_buffer.size(), file) ==
+                    m_buffer.size();
+        fclose(file);
+
+        if (!ok || m_buffer.empty())
+            return false;
+
+        m_data = &m_buffer[0];
+        m_size = m_buffer.size();
+#else
+        int fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0)
+            return false;
+
+        struct stat info;
+        if (fstat(fd, &info) != 0 || info.st_size == 0)
+        {
+            ::close(fd);
+            return false;
+        }
+
+        void* data = mmap(NULL, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        ::close(fd);
+
+        if (data == MAP_FAILED)
+            return false;
+
+        m_data = static_cast<const char*>(data);
+        m_size = info.st_size;
+#endif
+        return true;
+    }
+
+    void close()
+    {
+#ifdef _WIN32
+        m_buffer.clear();
+#else
+        if (m_data)
+            munmap(const_cast<char*>(m_data), m_size);
+#endif
+        m_data = NULL;
+        m_size = 0;
+    }
+
+    const char* getData() const
+    {
+        return m_data;
+    }
+
+    std::size_t getSize() const
+    {
+        return m_size;
+    }
+
+private :
+
+    const char* m_data;
+    std::size_t m_size;
+
+#ifdef _WIN32
+    std::vector<char> m_buffer;
+#endif
+};
+
+////////////////////////////////////////////////////////////
+// Chunk codec, consecutive values are xor-ed together so runs
+// of equal values (iteration counts mostly) become zero words
+////////////////////////////////////////////////////////////
+inline void writeVarint(std::vector<char>& out, sf::Uint32 value)
+{
+    while (value >= 0x80)
+    {
+        out.push_back(static_cast<char>((value & 0x7F) | 0x80));
+        value >>= 7;
+    }
+    out.push_back(static_cast<char>(value));
+}
+
+inline bool readVarint(const char*& data, const char* end, sf::Uint32& value)
+{
+    value = 0;
+    for (int shift = 0; shift < 35 && data < end; shift += 7)
+    {
+        sf::Uint8 byte = static_cast<sf::Uint8>(*data++);
+        value |= static_cast<sf::Uint32>(byte & 0x7F) << shift;
+        if (!(byte & 0x80))
+            return true;
+    }
+    return false;
+}
+
+// Tokens are a zero run length, a literal count and the literals
+inline void encodeChunk(const float* values, int count, std::vector<char>& out)
+{
+    out.clear();
+
+    sf::Uint32 previous = 0;
+    int i = 0;
+    while (i < count)
+    {
+        sf::Uint32 zeros = 0;
+        sf::Uint32 word;
+        while (i < count)
+        {
+            std::memcpy(&word, &values[i], 4);
+            if ((word ^ previous) != 0)
+                break;
+            ++zeros;
+            ++i;
+        }
+
+        // Literals run until a value repeats, which starts a new run
+        int start = i;
+        sf::Uint32 last = previous;
+        while (i < count)
+        {
+            std::memcpy(&word, &values[i], 4);
+            if (word == last)
+                break;
+            last = word;
+            ++i;
+        }
+
+        writeVarint(out, zeros);
+        writeVarint(out, i - start);
+
+        for (int j = start; j < i; ++j)
+        {
+            std::memcpy(&word, &values[j], 4);
+            sf::Uint32 delta = word ^ previous;
+            previous = word;
+
+            char bytes[4];
+            std::memcpy(bytes, &delta, 4);
+            out.insert(out.end(), bytes, bytes + 4);
+        }
+    }
+}
+
+inline bool decodeChunk(const char* data, std::size_t size,
+                        float* values, int count)
+{
+    const char* end = data + size;
+
+    sf::Uint32 previous = 0;
+    int i = 0;
+    while (i < count)
+    {
+        sf::Uint32 zeros, literals;
+        if (!readVarint(data, end, zeros) || !readVarint(data, end, literals))
+            return false;
+
+        if (zeros + literals > static_cast<sf::Uint32>(count - i) ||
+             static_cast<std::size_t>(end - data) < literals * 4)
+            return false;
+
+        for (sf::Uint32 j = 0; j < zeros; ++j, ++i)
+            std::memcpy(&values[i], &previous, 4);
+
+        for (sf::Uint32 j = 0; j < literals; ++j, ++i)
+        {
+            sf::Uint32 delta;
+            std::memcpy(&delta, data, 4);
+            data += 4;
+
+            previous ^= delta;
+            std::memcpy(&values[i], &previous, 4);
+        }
+    }
+
+    return data == end;
+}
+
+////////////////////////////////////////////////////////////
+/// Per pixel data of one render, stored per channel so that
+/// rows of a mapped file can be used without copying
+////////////////////////////////////////////////////////////
+class IterationMap : sf::NonCopyable
+{
+public :
+
+    IterationMap() :
+    m_width(0),
+    m_height(0),
+    m_channels(0),
+    m_layout(LayoutGrid)
+    {
+        for (int c = 0; c < ChannelCount; ++c)
+            m_mapped[c] = false;
+    }
+
+    // Allocate an empty map for a render of params
+    void create(const KernelParams& params, int width, int height,
+                int channels)
+    {
+        m_file.close();
+
+        m_params = params;
+        m_width = width;
+        m_height = height;
+        m_layout = LayoutGrid;
+        m_channels = channels | (1 << ChannelIterations) |
+                                (1 << ChannelColor);
+
+        for (int c = 0; c < ChannelCount; ++c)
+        {
+            m_rows[c].clear();
+            m_storage[c].clear();
+            m_mapped[c] = false;
+
+            if (!hasChannel(c))
+                continue;
+
+            m_storage[c].assign(static_cast<std::size_t>(width) * height,
+                                0.0f);
+            for (int y = 0; y < height; ++y)
+                m_rows[c].push_back(
+                    &m_storage[c][static_cast<std::size_t>(y) * width]);
+        }
+    }
+
+    int getWidth() const
+    {
+        return m_width;
+    }
+
+    int getHeight() const
+    {
+        return m_height;
+    }
+
+    bool hasChannel(int channel) const
+    {
+        return (m_channels & (1 << channel)) != 0;
+    }
+
+    bool isEmpty() const
+    {
+        return m_width == 0;
+    }
+
+    // The view the map was rendered from
+    const KernelParams& getParams() const
+    {
+        return m_params;
+    }
+
+    // Maps are grids unless the renderer says otherwise
+    void setLayout(int layout)
+    {
+        m_layout = layout;
+    }
+
+    int getLayout() const
+    {
+        return m_layout;
+    }
+
+    // Rows of a mapped file are read only, the channel is copied
+    // out of the file the first time one of them is written
+    float* getRow(int channel, int y)
+    {
+        if (m_mapped[channel])
+            copyMappedRows(channel);
+
+        return &m_storage[channel][static_cast<std::size_t>(y) * m_width];
+    }
+
+    const float* getRow(int channel, int y) const
+    {
+        return m_rows[channel][y];
+    }
+
+    IterationSample getSample(int x, int y) const
+    {
+        IterationSample sample;
+        sample.iterations = m_rows[ChannelIterations][y][x];
+        sample.color = m_rows[ChannelColor][y][x];
+        sample.distance = getValue(ChannelDistance, x, y);
+        sample.atom = getValue(ChannelAtom, x, y);
+        sample.period = getValue(ChannelPeriod, x, y);
+        sample.stripe = getValue(ChannelStripe, x, y);
+        sample.trapPoint = getValue(ChannelTrapPoint, x, y);
+        sample.trapLine = getValue(ChannelTrapLine, x, y);
+        sample.trapCross = getValue(ChannelTrapCross, x, y);
+        return sample;
+    }
+
+    // Copy a rendered tile in, stride is in samples
+    void store(int left, int top, int width, int height,
+               const IterationSample* samples, int stride)
+    {
+        bool distance = hasChannel(ChannelDistance);
+        bool interior = hasChannel(ChannelAtom) && hasChannel(ChannelPeriod);
+        bool traps = hasChannel(ChannelStripe) &&
+                     hasChannel(ChannelTrapPoint) &&
+                     hasChannel(ChannelTrapLine) &&
+                     hasChannel(ChannelTrapCross);
+
+        for (int y = 0; y < height; ++y)
+        {
+            float* iterations = getRow(ChannelIterations, top + y) + left;
+            float* color = getRow(ChannelColor, top + y) + left;
+            float* dist = distance ?
+                            getRow(ChannelDistance, top + y) + left : NULL;
+            float* atom = interior ?
+                            getRow(ChannelAtom, top + y) + left : NULL;
+            float* period = interior ?
+                              getRow(ChannelPeriod, top + y) + left : NULL;
+            float* stripe = traps ?
+                              getRow(ChannelStripe, top + y) + left : NULL;
+            float* trapPoint = traps ?
+                              getRow(ChannelTrapPoint, top + y) + left : NULL;
+            float* trapLine = traps ?
+                              getRow(ChannelTrapLine, top + y) + left : NULL;
+            float* trapCross = traps ?
+                              getRow(ChannelTrapCross, top + y) + left : NULL;
+
+            const IterationSample* row = samples + y * stride;
+            for (int x = 0; x < width; ++x)
+            {
+                iterations[x] = row[x].iterations;
+                color[x] = row[x].color;
+                if (dist)
+                    dist[x] = row[x].distance;
+                if (atom)
+                {
+                    atom[x] = row[x].atom;
+                    period[x] = row[x].period;
+                }
+                if (stripe)
+                {
+                    stripe[x] = row[x].stripe;
+                    trapPoint[x] = row[x].trapPoint;
+                    trapLine[x] = row[x].trapLine;
+                    trapCross[x] = row[x].trapCross;
+                }
+            }
+        }
+    }
+
+    ////////////////////////////////////////////////////////////
+    /// Color the map into RGBA pixels with the palette
+    ////////////////////////////////////////////////////////////
+    void colorize(const Palette& palette, std::vector<sf::Uint8>& pixels) const
+    {
+        pixels.resize(m_width * m_height * 4);
+
+        bool distance = hasChannel(ChannelDistance);
+        double spacing = pixelSpacing(m_params);
+
+        for (int y = 0; y < m_height; ++y)
+        {
+            for (int x = 0; x < m_width; ++x)
+            {
+                sf::Color color = palette.lookup(getSample(x, y), spacing,
+                                                 distance);
+                sf::Uint8* pixel = &pixels[(y * m_width + x) * 4];
+                pixel[0] = color.r;
+                pixel[1] = color.g;
+                pixel[2] = color.b;
+                pixel[3] = 255;
+            }
+        }
+    }
+
+    // Equalize the palette to this map, every step-th pixel is used
+    void fillHistogram(Palette& palette, int step = 4) const
+    {
+        std::vector<IterationSample> samples;
+        for (int y = 0; y < m_height; y += step)
+            for (int x = 0; x < m_width; x += step)
+                samples.push_back(getSample(x, y));
+
+        if (!samples.empty())
+            palette.setHistogram(&samples[0], samples.size());
+    }
+
+    ////////////////////////////////////////////////////////////
+    /// Write the map to disk
+    ////////////////////////////////////////////////////////////
+    bool saveToFile(const std::string& path) const
+    {
+        if (isEmpty())
+            return false;
+
+        MapFileHeader header;
+        std::memset(&header, 0, sizeof(header));
+        std::memcpy(header.magic, FXIM_MAGIC, 4);
+        header.version = FXIM_VERSION;
+        header.width = m_width;
+        header.height = m_height;
+        header.channels = m_channels;
+        header.chunkRows = FXIM_CHUNK_ROWS;
+        header.chunkCount = getChunkCount();
+        header.flags = (m_params.julia ? 1 : 0) |
+                       (m_params.almond ? 2 : 0) |
+                       (m_params.logShading ? 4 : 0) |
+                       (m_layout == LayoutExponential ? 8 : 0);
+        header.x = m_params.x;
+        header.y = m_params.y;
+        header.zoom = m_params.zoom;
+        header.juliaA = m_params.juliaA;
+        header.juliaB = m_params.juliaB;
+        header.maxIterations = m_params.maxIterations;
+        header.size = m_params.size;
+
+        std::vector<MapFileChunk> table(ChannelCount * header.chunkCount);
+        std::memset(&table[0], 0, table.size() * sizeof(MapFileChunk));
+
+        FILE* file = fopen(path.c_str(), "wb");
+        if (!file)
+            return false;
+
+        // Header and table are rewritten once the offsets are known
+        bool ok = fwrite(&header, sizeof(header), 1, file) == 1 &&
+                  fwrite(&table[0], sizeof(MapFileChunk), table.size(),
+                         file) == table.size();
+
+        std::vector<float> plane;
+        std::vector<char> encoded;
+        sf::Uint64 offset = sizeof(header) + table.size() *
+                                               sizeof(MapFileChunk);
+
+        for (int c = 0; c < ChannelCount && ok; ++c)
+        {
+            if (!hasChannel(c))
+                continue;
+
+            for (sf::Uint32 k = 0; k < header.chunkCount && ok; ++k)
+            {
+                // Gather the rows of the chunk
+                int top = k * FXIM_CHUNK_ROWS;
+                int rows = std::min(FXIM_CHUNK_ROWS, m_height - top);
+                plane.resize(rows * m_width);
+                for (int y = 0; y < rows; ++y)
+                    std::memcpy(&plane[y * m_width], getRow(c, top + y),
+                                m_width * sizeof(float));
+
+                encodeChunk(&plane[0], plane.size(), encoded);
+
+                MapFileChunk& chunk = table[c * header.chunkCount + k];
+                const char* data = reinterpret_cast<const char*>(&plane[0]);
+                chunk.size = plane.size() * sizeof(float);
+                chunk.encoding = EncodingRaw;
+
+                if (encoded.size() < chunk.size)
+                {
+                    data = &encoded[0];
+                    chunk.size = encoded.size();
+                    chunk.encoding = EncodingXorRun;
+                }
+
+                // Pad so the next chunk is aligned
+                char padding[FXIM_ALIGNMENT] = {0};
+                std::size_t pad = (FXIM_ALIGNMENT - offset % FXIM_ALIGNMENT) %
+                                    FXIM_ALIGNMENT;
+                ok = fwrite(padding, 1, pad, file) == pad;
+                offset += pad;
+
+                chunk.offset = offset;
+                ok = ok && fwrite(data, 1, chunk.size, file) == chunk.size;
+                offset += chunk.size;
+            }
+        }
+
+        ok = ok && fseek(file, 0, SEEK_SET) == 0 &&
+             fwrite(&header, sizeof(header), 1, file) == 1 &&
+             fwrite(&table[0], sizeof(MapFileChunk), table.size(),
+                    file) == table.size();
+
+        return fclose(file) == 0 && ok;
+    }
+
+    ////////////////////////////////////////////////////////////
+    /// Map a file, raw chunks are not copied
+    ////////////////////////////////////////////////////////////
+    bool loadFromFile(const std::string& path)
+    {
+        m_width = m_height = m_channels = 0;
+        if (!m_file.open(path))
+            return false;
+
+        const char* data = m_file.getData();
+        std::size_t size = m_file.getSize();
+
+        MapFileHeader header;
+        if (size < sizeof(header))
+            return false;
+        std::memcpy(&header, data, sizeof(header));
+
+        if (std::memcmp(header.magic, FXIM_MAGIC, 4) != 0 ||
+             header.version < 1 || header.version > FXIM_VERSION)
+            return false;
+
+        if (header.width == 0 || header.height == 0 ||
+             header.width > FXIM_MAX_SIZE || header.height > FXIM_MAX_SIZE ||
+             static_cast<sf::Uint64>(header.width) * header.height >
+             FXIM_MAX_PIXELS)
+            return false;
+
+        // The table has one row of chunks per channel the version knew
+        int tableChannels = header.version == 1 ? FXIM_V1_CHANNELS :
+                            header.version == 2 ? FXIM_V2_CHANNELS :
+                                                  ChannelCount;
+
+        if (header.chunkRows != FXIM_CHUNK_ROWS ||
+             header.chunkCount != (header.height + FXIM_CHUNK_ROWS - 1) /
+                                    FXIM_CHUNK_ROWS ||
+             header.channels >> tableChannels != 0 ||
+             size < sizeof(header) + tableChannels * header.chunkCount *
+                                       sizeof(MapFileChunk))
+            return false;
+
+        const MapFileChunk* table =
+            reinterpret_cast<const MapFileChunk*>(data + sizeof(header));
+
+        m_params.x = header.x;
+        m_params.y = header.y;
+        m_params.zoom = header.zoom;
+        m_params.juliaA = header.juliaA;
+        m_params.juliaB = header.juliaB;
+        m_params.julia = (header.flags & 1) != 0;
+        m_params.almond = (header.flags & 2) != 0;
+        m_params.logShading = (header.flags & 4) != 0;
+        m_layout = header.flags & 8 ? LayoutExponential : LayoutGrid;
+        m_params.maxIterations = header.maxIterations;
+        m_params.size = header.size;
+
+        int width = header.width;
+        int height = header.height;
+
+        for (int c = 0; c < ChannelCount; ++c)
+        {
+            m_rows[c].clear();
+            m_storage[c].clear();
+            m_mapped[c] = false;
+
+            if (!(header.channels & (1 << c)))
+                continue;
+
+            m_rows[c].resize(height);
+
+            for (sf::Uint32 k = 0; k < header.chunkCount; ++k)
+            {
+                const MapFileChunk& chunk = table[c * header.chunkCount + k];
+                int top = k * FXIM_CHUNK_ROWS;
+                int rows = std::min(FXIM_CHUNK_ROWS, height - top);
+                std::size_t bytes = static_cast<std::size_t>(rows) * width *
+                                    sizeof(float);
+
+                if (chunk.offset > size || chunk.size > size - chunk.offset)
+                    return false;
+
+                const char* chunkData = data + chunk.offset;
+
+                if (chunk.encoding == EncodingRaw)
+                {
+                    if (chunk.size != bytes ||
+                         chunk.offset % FXIM_ALIGNMENT != 0)
+                        return false;
+
+                    // Use the mapping in place
+                    for (int y = 0; y < rows; ++y)
+                        m_rows[c][top + y] =
+                            reinterpret_cast<const float*>(chunkData) +
+                            y * width;
+                    m_mapped[c] = true;
+                }
+                else
+                {
+                    if (m_storage[c].empty())
+                        m_storage[c].resize(static_cast<std::size_t>(width) *
+                                            height);
+
+                    float* out =
+                        &m_storage[c][static_cast<std::size_t>(top) * width];
+                    if (!decodeChunk(chunkData, chunk.size, out, rows * width))
+                        return false;
+
+                    for (int y = 0; y < rows; ++y)
+                        m_rows[c][top + y] = out + y * width;
+                }
+            }
+        }
+
+        m_width = width;
+        m_height = height;
+        m_channels = header.channels;
+
+        return hasChannel(ChannelIterations) && hasChannel(ChannelColor);
+    }
+
+private :
+
+    // Value of an optional channel, 0 when the map does not have it
+    float getValue(int channel, int x, int y) const
+    {
+        return hasChannel(channel) ? m_rows[channel][y][x] : 0.0f;
+    }
+
+    // Move the rows of a channel that are still in the file to
+    // m_storage, where they can be written
+    void copyMappedRows(int channel)
+    {
+        std::vector<float>& storage = m_storage[channel];
+        if (storage.empty())
+            storage.resize(static_cast<std::size_t>(m_width) * m_height);
+
+        for (int y = 0; y < m_height; ++y)
+        {
+            float* row = &storage[static_cast<std::size_t>(y) * m_width];
+            if (m_rows[channel][y] != row)
+            {
+                std::memcpy(row, m_rows[channel][y], m_width * sizeof(float));
+                m_rows[channel][y] = row;
+            }
+        }
+
+        m_mapped[channel] = false;
+    }
+
+    int getChunkCount() const
+    {
+        return (m_height + FXIM_CHUNK_ROWS - 1) / FXIM_CHUNK_ROWS;
+    }
+
+    KernelParams m_params;
+    int m_width, m_height;
+    int m_channels;
+    int m_layout;
+
+    // Row pointers into either m_storage or m_file, m_mapped tells
+    // which channels still have rows in the file
+    std::vector<const float*> m_rows[ChannelCount];
+    std::vector<float> m_storage[ChannelCount];
+    bool m_mapped[ChannelCount];
+    MappedFile m_file;
+};
+
+#endif // ITERATIONMAP_HPP
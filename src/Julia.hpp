@@ -6,8 +6,10 @@ class Julia : public Effect
 public :
 
     Julia() :
-    Effect("julia")
+    Effect("julia"),
+    m_dragging(false)
     {
+        m_panePosition = sf::Vector2f(PANE_SIZE, 0);
     }
 
     bool onLoad()
@@ -27,6 +29,7 @@ public :
         // Initialize the julia constants
         juliaA = 0.0;
         juliaB = 0.0;
+        m_hint = getJuliaHint(juliaA, juliaB, 70.0, false, NULL);
 
         return true;
     }
@@ -41,43 +44,10 @@ public :
         }
 
 
-        // Calculate the max iterations
-        float maxItValue=70.0;
-        if (m_iterationsScaing)
-            maxItValue = sqrt(2.*sqrt(fabs(1.-sqrt(5./frame.z))))*66.5;
-
-        // Enable the correct shader
-        if (m_emulated)
-            m_shader = &m_emulated_shader;
-        else
-            m_shader = &m_normal_shader;        
-
-        // Update the shader parameters
-        m_shader->setParameter("MaxIterations", maxItValue);
-        m_shader->setParameter("Zoom", frame.z);
-        m_shader->setParameter("JuliaA", juliaA );
-        m_shader->setParameter("JuliaB", juliaB );
-
-        m_shader->setParameter("Julia", true );
-
-        m_shader->setParameter("R", m_coloring.x);
-        m_shader->setParameter("G", m_coloring.y);
-        m_shader->setParameter("B", m_coloring.z);
-
-        m_shader->setParameter("Almond", m_almond);
-        m_shader->setParameter("LogShading", m_logShading);
-
-        // Create a rectangle to draw on the screen
-        sf::Vector2u renderTargetSize(960,960);
-        const sf::Vector2f windowSize(
-            static_cast<unsigned int>(renderTargetSize.x),
-             static_cast<unsigned int>(renderTargetSize.y));
-        
-        m_screenRect.setPosition(960, 0);
-        m_screenRect.setSize(windowSize);
-
-        m_shader->setParameter("Xcenter", frame.x);
-        m_shader->setParameter("Ycenter", frame.y);
+        // Both shaders can be on screen at once, each on its own tiles
+        updateShader(m_normal_shader);
+        updateShader(m_emulated_shader);
+        updateTiles();
 
         // Are we currently interacting with this fractal
         m_interacting = m_panning || m_zooming;
@@ -85,9 +55,8 @@ public :
 
     void onDraw(sf::RenderTarget& target, sf::RenderStates states) const
     {
-        // Render the shader
-        states.shader = m_shader;
-        target.draw(m_screenRect, states);
+        // Render the shaders
+        drawTiles(target, states, &m_normal_shader, &m_emulated_shader);
 
         if (m_zooming)
         {
@@ -96,15 +65,62 @@ public :
         }
     }
 
-    void setJuliaC(sf::Vector2f coords)
+    ////////////////////////////////////////////////////////////
+    /// Move C, known is the Mandlebrot sample at C when there is
+    /// one in memory already, it saves iterating the critical orbit
+    ////////////////////////////////////////////////////////////
+    void setJuliaC(sf::Vector2<double> coords,
+                   const IterationSample* known = NULL)
     {
         juliaA = coords.x;
         juliaB = coords.y;
+
+        m_hint = getJuliaHint(juliaA, juliaB, getMaxIterations(), m_almond,
+                              known);
+    }
+
+    // Cheaper shading while C follows the mouse
+    void setDragging(bool dragging)
+    {
+        m_dragging = dragging;
+    }
+
+    // The hint caps the iterations while C is dragged
+    bool isComplete()
+    {
+        return Effect::isComplete() && !(m_dragging && m_hint.valid);
+    }
+
+    const JuliaHint& getHint()
+    {
+        return m_hint;
+    }
+
+    // Zoom out just enough to show the whole set
+    void fitToHint()
+    {
+        setFrame(sf::Vector3<double>(0.0, 0.0, 2.0 * m_hint.radius * 1.05));
+    }
+
+    sf::Vector2<double> getJuliaC()
+    {
+        return sf::Vector2<double>(juliaA, juliaB);
+    }
+
+    void setKernelParams(const KernelParams& params)
+    {
+        Effect::setKernelParams(params);
+        setJuliaC(sf::Vector2<double>(params.juliaA, params.juliaB));
     }
 
-    sf::Vector2f getJuliaC()
+    KernelParams getKernelParams()
     {
-        return sf::Vector2f(juliaA, juliaB);
+        KernelParams params = Effect::getKernelParams();
+        params.julia = true;
+        params.juliaA = juliaA;
+        params.juliaB = juliaB;
+
+        return params;
     }
 
     // Mouse button events
@@ -114,10 +130,12 @@ public :
         {
             m_zooming = false;
             sf::Vector2f position = m_zoomBox.getPosition() -
-                                        sf::Vector2f(960.0, 0);
+                                        m_panePosition;
 
-            float mouseX = fmin(event.mouseButton.x,1920.0)-960.0;
-            float mouseY = fmin(event.mouseButton.y,960.0);
+            float mouseX = fmin(event.mouseButton.x - m_panePosition.x,
+                                PANE_SIZE);
+            float mouseY = fmin(event.mouseButton.y - m_panePosition.y,
+                                PANE_SIZE);
             float newSize = fmax(mouseX-position.x, mouseY-position.y);
 
             setFrame(getFrame(position.x, position.y, newSize));
@@ -131,13 +149,61 @@ public :
 
 private:
 
+    void updateShader(sf::Shader& shader)
+    {
+        // Calculate the max iterations
+        float maxItValue = getMaxIterations();
+
+        // While C is dragged the hint trades a little accuracy for speed
+        bool hinted = m_dragging && m_hint.valid;
+        if (hinted)
+            maxItValue = fmin(maxItValue, m_hint.iterationCap);
+
+        shader.setParameter(Uniform::TrapRadius,
+                            hinted ? static_cast<float>(m_hint.trap) : 0.0f);
+        shader.setParameter(Uniform::TrapCenter,
+                            sf::Vector2f(m_hint.cycleReal, m_hint.cycleImag));
+
+        // Update the shader parameters
+        shader.setParameter(Uniform::MaxIterations, maxItValue);
+        shader.setParameter(Uniform::Zoom, static_cast<float>(frame.z));
+
+        // C is split like the center
+        float a = static_cast<float>(juliaA);
+        float b = static_cast<float>(juliaB);
+        shader.setParameter(Uniform::JuliaA, a);
+        shader.setParameter(Uniform::JuliaB, b);
+        if (&shader == &m_emulated_shader)
+            shader.setParameter(Uniform::JuliaLow,
+                                static_cast<float>(juliaA - a),
+                                static_cast<float>(juliaB - b));
+
+        shader.setParameter(Uniform::Julia, true );
+
+        updatePalette(shader);
+
+        shader.setParameter(Uniform::Almond, m_almond);
+        shader.setParameter(Uniform::DistanceEstimation,
+                            m_distanceEstimation);
+        shader.setParameter(Uniform::LogShading, m_logShading);
+
+        updateCenter(shader);
+
+        updatePane(shader);
+    }
+
+    sf::Shader* getShader(bool emulated)
+    {
+        return emulated ? &m_emulated_shader : &m_normal_shader;
+    }
+
     sf::Texture m_texture;
-    sf::Shader * m_shader;
 
     sf::Shader m_emulated_shader;
     sf::Shader m_normal_shader;
 
-    sf::RectangleShape m_screenRect;
+    double juliaA, juliaB;
 
-    float juliaA, juliaB;
+    JuliaHint m_hint;
+    bool m_dragging;
 };
\ No newline at end of file
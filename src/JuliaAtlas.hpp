@@ -0,0 +1,602 @@
+#ifndef JULIAATLAS_HPP
+#define JULIAATLAS_HPP
+
+////////////////////////////////////////////////////////////
+// Headers
+////////////////////////////////////////////////////////////
+#include "Effect.hpp"
+#include "Kernel.hpp"
+#include "Threads.hpp"
+#include "Memory.hpp"
+
+#include <SFML/Graphics.hpp>
+
+#include <map>
+#include <deque>
+#include <vector>
+#include <algorithm>
+#include <cmath>
+#include <stdio.h>
+
+////////////////////////////////////////////////////////////
+// Grid of small Julia sets, one for every cell of the
+// Mandlebrot view, rendered on the CPU and cached by C
+////////////////////////////////////////////////////////////
+
+// Default number of thumbnails across and down
+#define ATLAS_GRID 8
+
+// Thumbnails kept around, about 60KB each at the default grid
+#define ATLAS_CACHE 512
+
+// C values closer than 2^-40 share a thumbnail
+#define ATLAS_QUANTUM 1099511627776.0
+
+// Width of the enlarged thumbnail shown under the mouse
+#define ATLAS_PREVIEW 360
+
+// Quantized C a thumbnail was rendered for
+struct AtlasKey
+{
+    sf::Int64 real, imag;
+};
+
+inline bool operator<(const AtlasKey& a, const AtlasKey& b)
+{
+    return a.real < b.real || (a.real == b.real && a.imag < b.imag);
+}
+
+inline bool operator==(const AtlasKey& a, const AtlasKey& b)
+{
+    return a.real == b.real && a.imag == b.imag;
+}
+
+inline AtlasKey getAtlasKey(double cReal, double cImag)
+{
+    AtlasKey key;
+    key.real = static_cast<sf::Int64>(floor(cReal * ATLAS_QUANTUM + 0.5));
+    key.imag = static_cast<sf::Int64>(floor(cImag * ATLAS_QUANTUM + 0.5));
+    return key;
+}
+
+// A rendered thumbnail, only the shading value is kept so a palette
+// change recolors it without iterating again
+struct AtlasThumbnail
+{
+    std::vector<float> colors;
+    unsigned int lastUse;
+};
+
+////////////////////////////////////////////////////////////
+/// Background threads rendering queued thumbnails. All the
+/// thumbnails share one view and only differ by C, so they
+/// go through the packet kernel in a single threaded pass.
+////////////////////////////////////////////////////////////
+class AtlasRenderer : sf::NonCopyable
+{
+public :
+
+    AtlasRenderer() :
+    m_generation(0),
+    m_active(0),
+    m_useCount(0)
+    {
+    }
+
+    ~AtlasRenderer()
+    {
+        clear(m_params);
+        wait();
+    }
+
+    // Forget every thumbnail, the next ones are rendered with params
+    void clear(const KernelParams& params)
+    {
+        sf::Lock lock(m_mutex);
+
+        std::map<AtlasKey, AtlasThumbnail*>::iterator it;
+        for (it = m_cache.begin(); it != m_cache.end(); ++it)
+            delete it->second;
+
+        m_cache.clear();
+        m_queue.clear();
+        m_params = params;
+        ++m_generation;
+    }
+
+    // Queue C unless it is cached or queued, urgent ones go first
+    void request(double cReal, double cImag, bool urgent)
+    {
+        sf::Lock lock(m_mutex);
+
+        Request request;
+        request.key = getAtlasKey(cReal, cImag);
+        request.cReal = cReal;
+        request.cImag = cImag;
+
+        if (m_cache.count(request.key))
+            return;
+
+        for (std::size_t i = 0; i < m_queue.size(); ++i)
+        {
+            if (m_queue[i].key == request.key)
+            {
+                if (!urgent)
+                    return;
+
+                m_queue.erase(m_queue.begin() + i);
+                break;
+            }
+        }
+
+        if (urgent)
+            m_queue.push_front(request);
+        else
+            m_queue.push_back(request);
+
+        // Threads leave once the queue is empty, bring them back
+        if (m_active == 0)
+        {
+            wait();
+
+            m_active = getCoreCount();
+            for (int i = 0; i < m_active; ++i)
+            {
+                sf::Thread* thread =
+                    new sf::Thread(&AtlasRenderer::work, this);
+                m_threads.push_back(thread);
+                thread->launch();
+            }
+        }
+    }
+
+    // Copy the colors of a finished thumbnail, false if not ready
+    bool getColors(double cReal, double cImag, std::vector<float>& colors)
+    {
+        sf::Lock lock(m_mutex);
+
+        std::map<AtlasKey, AtlasThumbnail*>::iterator it =
+            m_cache.find(getAtlasKey(cReal, cImag));
+        if (it == m_cache.end())
+            return false;
+
+        it->second->lastUse = ++m_useCount;
+        colors = it->second->colors;
+        return true;
+    }
+
+    int getQueued()
+    {
+        sf::Lock lock(m_mutex);
+        return m_queue.size();
+    }
+
+    int getCached()
+    {
+        sf::Lock lock(m_mutex);
+        return m_cache.size();
+    }
+
+private :
+
+    struct Request
+    {
+        AtlasKey key;
+        double cReal, cImag;
+    };
+
+    void wait()
+    {
+        for (std::size_t i = 0; i < m_threads.size(); ++i)
+        {
+            m_threads[i]->wait();
+            delete m_threads[i];
+        }
+
+        m_threads.clear();
+    }
+
+    void work()
+    {
+        std::vector<IterationSample> samples;
+
+        while (true)
+        {
+            Request request;
+            KernelParams params;
+            unsigned int generation;
+            {
+                sf::Lock lock(m_mutex);
+                if (m_queue.empty())
+                {
+                    --m_active;
+                    return;
+                }
+
+                request = m_queue.front();
+                m_queue.pop_front();
+                params = m_params;
+                generation = m_generation;
+            }
+
+            params.juliaA = request.cReal;
+            params.juliaB = request.cImag;
+
+            samples.resize(params.size * params.size);
+            renderPacketTile(params, &samples[0], params.size,
+                             0, 0, params.size, params.size);
+
+            AtlasThumbnail* thumbnail = new AtlasThumbnail;
+            thumbnail->colors.resize(samples.size());
+            for (std::size_t i = 0; i < samples.size(); ++i)
+                thumbnail->colors[i] = samples[i].color;
+
+            sf::Lock lock(m_mutex);
+
+            // The view changed while we were busy
+            if (generation != m_generation || m_cache.count(request.key))
+            {
+                delete thumbnail;
+                continue;
+            }
+
+            thumbnail->lastUse = ++m_useCount;
+            m_cache[request.key] = thumbnail;
+            evict();
+        }
+    }
+
+    // Drop the least recently used thumbnail once the cache is full
+    void evict()
+    {
+        if (m_cache.size() <= ATLAS_CACHE)
+            return;
+
+        std::map<AtlasKey, AtlasThumbnail*>::iterator it, oldest;
+        oldest = m_cache.begin();
+        for (it = m_cache.begin(); it != m_cache.end(); ++it)
+            if (it->second->lastUse < oldest->second->lastUse)
+                oldest = it;
+
+        delete oldest->second;
+        m_cache.erase(oldest);
+    }
+
+    sf::Mutex m_mutex;
+    KernelParams m_params;
+    unsigned int m_generation;
+
+    std::map<AtlasKey, AtlasThumbnail*> m_cache;
+    std::deque<Request> m_queue;
+    int m_active;
+    unsigned int m_useCount;
+
+    std::vector<sf::Thread*> m_threads;
+};
+
+////////////////////////////////////////////////////////////
+// "Atlas" CPU effect, shown in the right pane in place of the
+// Julia. Its frame is the view inside every thumbnail, the C
+// region is the Mandlebrot view given to setRegion().
+////////////////////////////////////////////////////////////
+class JuliaAtlas : public Effect
+{
+public :
+
+    JuliaAtlas() :
+    Effect("atlas"),
+    m_columns(ATLAS_GRID),
+    m_rows(ATLAS_GRID),
+    m_drawnVersion(0),
+    m_hovered(-1),
+    m_previewCell(-1)
+    {
+        m_panePosition = sf::Vector2f(PANE_SIZE, 0);
+
+        // Nothing rendered yet, the Mandlebrot starting view
+        m_params.size = 0;
+        m_region.x = 0.0;
+        m_region.y = 0.0;
+        m_region.zoom = 4.0;
+    }
+
+    bool onLoad()
+    {
+        if (!m_texture.create(PANE_SIZE, PANE_SIZE))
+            return false;
+
+        m_pixels.assign(PANE_SIZE * PANE_SIZE * 4, 0);
+        m_sprite.setTexture(m_texture, true);
+        m_sprite.setPosition(PANE_SIZE, 0);
+
+        m_preview.setOutlineColor(sf::Color(80, 80, 80));
+        m_preview.setOutlineThickness(2);
+
+        m_status.getText().setFont(getFont());
+        m_status.getText().setCharacterSize(20);
+        m_status.getText().setColor(sf::Color(80, 80, 80));
+        m_status.getText().setPosition(970, 930);
+
+        return true;
+    }
+
+    // Spread the thumbnails over this view of the Mandlebrot
+    void setRegion(const KernelParams& region)
+    {
+        m_region = region;
+    }
+
+    void setGrid(int columns, int rows)
+    {
+        m_columns = std::max(columns, 1);
+        m_rows = std::max(rows, 1);
+    }
+
+    // Track the mouse for the preview, in window coordinates
+    void setHover(sf::Vector2f position)
+    {
+        m_hovered = getCell(position);
+        m_hoverPosition = position;
+    }
+
+    // C of the thumbnail under position, false outside of the atlas
+    bool getC(sf::Vector2f position, sf::Vector2<double>& c)
+    {
+        int cell = getCell(position);
+        if (cell < 0)
+            return false;
+
+        double cReal, cImag;
+        getCellC(cell, cReal, cImag);
+        c = sf::Vector2<double>(cReal, cImag);
+
+        return true;
+    }
+
+    void onUpdate()
+    {
+        // Update the frame if we are panning
+        if (m_panning)
+        {
+            frame.x += m_panVelocity * cos(m_panAngle);
+            frame.y += m_panVelocity * sin(m_panAngle);
+        }
+
+        m_palette.setCoefficients(m_coloring);
+        m_palette.setRange(getMaxIterations() + 2.0);
+        m_palette.bake();
+
+        // Everything but C is shared by the thumbnails
+        KernelParams params = getKernelParams();
+        params.julia = true;
+        params.size = PANE_SIZE / std::max(m_columns, m_rows);
+
+        if (params != m_params)
+        {
+            m_renderer.clear(params);
+            m_params = params;
+            m_drawn.clear();
+            m_previewCell = -1;
+        }
+
+        if (m_drawnVersion != m_palette.getVersion())
+        {
+            m_drawn.clear();
+            m_drawnVersion = m_palette.getVersion();
+            m_previewCell = -1;
+        }
+
+        int cells = m_columns * m_rows;
+        m_drawn.resize(cells, false);
+
+        // Keep the C each cell shows so a region change redraws it
+        m_cellKeys.resize(cells);
+
+        bool dirty = false;
+        for (int cell = 0; cell < cells; ++cell)
+        {
+            double cReal, cImag;
+            getCellC(cell, cReal, cImag);
+
+            AtlasKey key = getAtlasKey(cReal, cImag);
+            if (!(key == m_cellKeys[cell]))
+            {
+                m_cellKeys[cell] = key;
+                m_drawn[cell] = false;
+            }
+
+            if (m_drawn[cell])
+                continue;
+
+            if (m_renderer.getColors(cReal, cImag, m_colors))
+            {
+                drawCell(cell);
+                if (cell == m_previewCell)
+                    m_previewCell = -1;
+                m_drawn[cell] = true;
+                dirty = true;
+            }
+            else
+            {
+                m_renderer.request(cReal, cImag, cell == m_hovered);
+            }
+        }
+
+        if (dirty)
+            m_texture.update(&m_pixels[0]);
+
+        updatePreview();
+
+        char temp[128];
+        sprintf(temp, "Thumbnails: %d cached, %d queued",
+                m_renderer.getCached(), m_renderer.getQueued());
+        m_status.setString(temp);
+
+        // Are we currently interacting with this fractal
+        m_interacting = m_panning || m_zooming;
+    }
+
+    // Every thumbnail of the grid is drawn
+    bool isComplete()
+    {
+        return !m_drawn.empty() &&
+               std::find(m_drawn.begin(), m_drawn.end(), false) ==
+                   m_drawn.end();
+    }
+
+    void onDraw(sf::RenderTarget& target, sf::RenderStates states) const
+    {
+        target.draw(m_sprite, states);
+        target.draw(m_status, states);
+
+        if (m_hovered >= 0 && m_previewTexture.getSize().x > 0)
+            target.draw(m_preview, states);
+    }
+
+    // Mouse button events
+    void onMouseButtonRelease(sf::Event event)
+    {
+        if (event.mouseButton.button == sf::Mouse::Right)
+        {
+            // A zoom box makes no sense across thumbnails, use the wheel
+            m_zooming = false;
+        }
+        else if (event.mouseButton.button == sf::Mouse::Middle)
+        {
+            m_panning = false;
+            m_panVelocity = 0.0;
+        }
+    }
+
+private :
+
+    // Cell under a window position, -1 outside of the pane
+    int getCell(sf::Vector2f position)
+    {
+        float x = position.x - m_panePosition.x;
+        float y = position.y - m_panePosition.y;
+        if (x < 0 || y < 0 || x >= PANE_SIZE || y >= PANE_SIZE)
+            return -1;
+
+        int column = std::min(static_cast<int>(x * m_columns / PANE_SIZE),
+                              m_columns - 1);
+        int row = std::min(static_cast<int>(y * m_rows / PANE_SIZE),
+                           m_rows - 1);
+
+        return row * m_columns + column;
+    }
+
+    // Center of the cell in the Mandlebrot view, same mapping as its pane
+    void getCellC(int cell, double& cReal, double& cImag)
+    {
+        int column = cell % m_columns;
+        int row = cell / m_columns;
+
+        cReal = -m_region.x + ((column + 0.5) / m_columns - 0.5) *
+                                m_region.zoom;
+        cImag = -m_region.y - ((row + 0.5) / m_rows - 0.5) * m_region.zoom;
+    }
+
+    void drawCell(int cell)
+    {
+        int size = m_params.size;
+        int left = (cell % m_columns) * PANE_SIZE / m_columns;
+        int top = (cell / m_columns) * PANE_SIZE / m_rows;
+
+        IterationSample sample;
+        sample.iterations = 0.0f;
+        sample.distance = 0.0f;
+        sample.atom = 0.0f;
+        sample.period = 0.0f;
+        sample.stripe = 0.0f;
+        sample.trapPoint = 0.0f;
+        sample.trapLine = 0.0f;
+        sample.trapCross = 0.0f;
+
+        for (int y = 0; y < size && top + y < PANE_SIZE; ++y)
+        {
+            for (int x = 0; x < size && left + x < PANE_SIZE; ++x)
+            {
+                sample.color = m_colors[y * size + x];
+                sf::Color color = m_palette.lookup(sample, 0.0, false);
+
+                sf::Uint8* pixel =
+                    &m_pixels[((top + y) * PANE_SIZE + left + x) * 4];
+                pixel[0] = color.r;
+                pixel[1] = color.g;
+                pixel[2] = color.b;
+                pixel[3] = 255;
+            }
+        }
+    }
+
+    // Enlarge the hovered thumbnail straight from the cache
+    void updatePreview()
+    {
+        if (m_hovered < 0 || !m_drawn[m_hovered])
+            return;
+
+        // Keep the preview inside the pane, away from the cursor
+        sf::Vector2f position = m_hoverPosition + sf::Vector2f(20, 20);
+        position.x = std::min<float>(position.x,
+                                     2 * PANE_SIZE - ATLAS_PREVIEW);
+        position.y = std::min<float>(position.y, PANE_SIZE - ATLAS_PREVIEW);
+        m_preview.setPosition(position);
+
+        if (m_previewCell == m_hovered)
+            return;
+
+        int size = m_params.size;
+        if (m_previewTexture.getSize() != sf::Vector2u(size, size))
+        {
+            m_previewTexture.create(size, size);
+            m_previewTexture.setSmooth(true);
+        }
+
+        int left = (m_hovered % m_columns) * PANE_SIZE / m_columns;
+        int top = (m_hovered / m_columns) * PANE_SIZE / m_rows;
+        sf::Image image;
+        image.create(size, size, sf::Color::Black);
+        for (int y = 0; y < size && top + y < PANE_SIZE; ++y)
+        {
+            for (int x = 0; x < size && left + x < PANE_SIZE; ++x)
+            {
+                const sf::Uint8* pixel =
+                    &m_pixels[((top + y) * PANE_SIZE + left + x) * 4];
+                image.setPixel(x, y,
+                               sf::Color(pixel[0], pixel[1], pixel[2]));
+            }
+        }
+        m_previewTexture.update(image);
+
+        m_preview.setTexture(&m_previewTexture, true);
+        m_preview.setSize(sf::Vector2f(ATLAS_PREVIEW, ATLAS_PREVIEW));
+        m_previewCell = m_hovered;
+    }
+
+    int m_columns, m_rows;
+    KernelParams m_region;
+    KernelParams m_params;
+
+    AtlasRenderer m_renderer;
+    std::vector<float> m_colors;
+
+    // What is on the texture
+    std::vector<AtlasKey> m_cellKeys;
+    std::vector<bool> m_drawn;
+    unsigned int m_drawnVersion;
+
+    std::vector<sf::Uint8> m_pixels;
+    sf::Texture m_texture;
+    sf::Sprite m_sprite;
+
+    int m_hovered;
+    int m_previewCell;
+    sf::Vector2f m_hoverPosition;
+    sf::Texture m_previewTexture;
+    sf::RectangleShape m_preview;
+
+    CachedText m_status;
+};
+
+#endif // JULIAATLAS_HPP
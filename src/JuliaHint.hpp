@@ -0,0 +1,146 @@
+#ifndef JULIAHINT_HPP
+#define JULIAHINT_HPP
+
+////////////////////////////////////////////////////////////
+// Headers
+////////////////////////////////////////////////////////////
+#include "Kernel.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+////////////////////////////////////////////////////////////
+// What the Mandlebrot already knows about the Julia set at C,
+// used to keep the Julia pane fast while C is being dragged
+////////////////////////////////////////////////////////////
+
+// Longest attracting cycle looked for
+#define HINT_MAX_PERIOD 32
+
+// Critical orbit steps spent converging to the cycle
+#define HINT_SETTLE 1000
+
+// Radius of the trap around the cycle, scaled by 1 - |multiplier|.
+// Small enough to sit inside the immediate basin in practice, the
+// full render takes over again as soon as the drag stops.
+#define HINT_TRAP 1e-3
+
+// Iteration cap for dust like Julias, relative to the critical orbit
+#define HINT_ESCAPE_FACTOR 4
+#define HINT_ESCAPE_MARGIN 16
+
+struct JuliaHint
+{
+    // The hint math assumes z^2 + c, it is off for the almond bread
+    bool valid;
+
+    // C is in the Mandlebrot, the Julia is one piece instead of dust
+    bool connected;
+
+    // The whole Julia set fits in |z| <= radius
+    double radius;
+
+    // Iteration the critical orbit escaped at, the cap if it did not
+    float escape;
+
+    // Enough iterations to tell escaping pixels apart
+    float iterationCap;
+
+    // Attracting cycle, period 0 when none was found. Orbits that
+    // come within trap of the cycle point never escape.
+    int period;
+    double cycleReal, cycleImag;
+    double trap;
+};
+
+////////////////////////////////////////////////////////////
+/// Work out the hint for C. known is the Mandlebrot sample at
+/// C when one is already in memory, the critical orbit is only
+/// iterated when it did not escape.
+////////////////////////////////////////////////////////////
+inline JuliaHint getJuliaHint(double cReal, double cImag, float maxIterations,
+                              bool almond, const IterationSample* known)
+{
+    JuliaHint hint;
+    hint.valid = !almond;
+    hint.connected = true;
+    hint.escape = maxIterations;
+    hint.iterationCap = maxIterations;
+    hint.period = 0;
+    hint.cycleReal = hint.cycleImag = 0.0;
+    hint.trap = 0.0;
+
+    // |z| > R implies |z^2 + c| > |z| as long as R^2 - |c| = R
+    double modulus = sqrt(cReal * cReal + cImag * cImag);
+    hint.radius = (1.0 + sqrt(1.0 + 4.0 * modulus)) / 2.0;
+
+    if (almond)
+        return hint;
+
+    // Iterating z0 = 0 at C is the Mandlebrot pixel at C
+    IterationSample sample;
+    if (known)
+    {
+        sample = *known;
+    }
+    else
+    {
+        KernelParams params;
+        params.julia = false;
+        params.almond = false;
+        params.logShading = false;
+        params.maxIterations = maxIterations;
+        params.zoom = 4.0;
+        params.size = 1;
+        sample = iteratePoint<double, KernelPlain>(params, cReal, cImag);
+    }
+
+    if (!isInsideSample(sample, maxIterations))
+    {
+        hint.connected = false;
+        hint.escape = sample.iterations;
+        hint.iterationCap = std::min<float>(maxIterations,
+            sample.iterations * HINT_ESCAPE_FACTOR + HINT_ESCAPE_MARGIN);
+        return hint;
+    }
+
+    // Let the critical orbit settle onto its attracting cycle
+    double real = 0.0, imag = 0.0;
+    for (int i = 0; i < HINT_SETTLE; ++i)
+    {
+        iterateStep(real, imag, cReal, cImag, false);
+        if (real * real + imag * imag > 4.0)
+            return hint;
+    }
+
+    // Smallest period that comes back, with the cycle multiplier
+    double zReal = real, zImag = imag;
+    double mReal = 1.0, mImag = 0.0;
+    for (int period = 1; period <= HINT_MAX_PERIOD; ++period)
+    {
+        double temp = 2.0 * (mReal * zReal - mImag * zImag);
+        mImag = 2.0 * (mReal * zImag + mImag * zReal);
+        mReal = temp;
+
+        iterateStep(zReal, zImag, cReal, cImag, false);
+
+        double dReal = zReal - real;
+        double dImag = zImag - imag;
+        if (dReal * dReal + dImag * dImag < 1e-18)
+        {
+            double multiplier = sqrt(mReal * mReal + mImag * mImag);
+            if (multiplier >= 1.0)
+                break;
+
+            hint.period = period;
+            hint.cycleReal = real;
+            hint.cycleImag = imag;
+            hint.trap = HINT_TRAP * (1.0 - multiplier);
+            break;
+        }
+    }
+
+    return hint;
+}
+
+#endif // JULIAHINT_HPP
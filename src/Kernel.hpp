@@ -0,0 +1,743 @@
+#ifndef KERNEL_HPP
+#define KERNEL_HPP
+
+////////////////////////////////////////////////////////////
+// Headers
+////////////////////////////////////////////////////////////
+#include <cmath>
+#include <algorithm>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+    #define KERNEL_AVX2
+    #include <immintrin.h>
+#endif
+
+////////////////////////////////////////////////////////////
+// CPU versions of the iteration done in the shaders
+////////////////////////////////////////////////////////////
+
+// Compile time switches for the kernel variants, combine them with |
+// A variant only pays for the features it was built with
+enum KernelFeature
+{
+    KernelPlain    = 0,
+    KernelDistance = 1 << 0,
+    KernelInterior = 1 << 1,
+
+    // Orbit traps and the stripe average, see OrbitTraps
+    KernelTraps    = 1 << 3,
+
+    // The bits the kernels are compiled for
+    KernelVariants = KernelDistance | KernelInterior | KernelTraps,
+
+    // Not a variant, asks renderTileAuto for the fixed point kernel on
+    // every tile it can take so the render is the same on any machine
+    KernelFixedPoint = 1 << 2
+};
+
+// Orbits closer than this fraction of a pixel to an earlier point of
+// themselves are taken as periodic, and so as interior
+#define INTERIOR_EPSILON 1e-3
+
+// Everything a kernel needs to know about the view it renders
+struct KernelParams
+{
+    // Same meaning as Effect::frame, the center is stored negated
+    double x, y, zoom;
+
+    // C for the Julia set, unused for the Mandlebrot
+    double juliaA, juliaB;
+
+    bool julia;
+    bool almond;
+    bool logShading;
+
+    // Float like the shader uniform, the loop runs while iter < max
+    float maxIterations;
+
+    // Width of the square pane in pixels
+    int size;
+};
+
+inline bool operator==(const KernelParams& a, const KernelParams& b)
+{
+    return a.x == b.x && a.y == b.y && a.zoom == b.zoom &&
+           a.juliaA == b.juliaA && a.juliaB == b.juliaB &&
+           a.julia == b.julia && a.almond == b.almond &&
+           a.logShading == b.logShading &&
+           a.maxIterations == b.maxIterations && a.size == b.size;
+}
+
+inline bool operator!=(const KernelParams& a, const KernelParams& b)
+{
+    return !(a == b);
+}
+
+// Whether two renders show the same points, ignoring the shading
+inline bool isSameView(const KernelParams& a, const KernelParams& b)
+{
+    return a.x == b.x && a.y == b.y && a.zoom == b.zoom &&
+           a.julia == b.julia && a.almond == b.almond &&
+           (!a.julia || (a.juliaA == b.juliaA && a.juliaB == b.juliaB));
+}
+
+// What the kernels produce for a single point
+struct IterationSample
+{
+    // Raw escape count, equal to the iteration cap when inside
+    float iterations;
+
+    // Shading value exactly as the shader computes it, 0 when inside
+    float color;
+
+    // Exterior distance estimate in fractal units, 0 when inside or
+    // when the variant was built without KernelDistance
+    float distance;
+
+    // Index of the smallest |z|, counting z1 = c for the Mandlebrot and
+    // z0 = the pixel for the Julia. Only with KernelInterior.
+    float atom;
+
+    // Period of the attracting cycle for interior points where it was
+    // found, 0 otherwise. Only with KernelInterior.
+    float period;
+
+    // Stripe average from 0 to 1, 0 when inside. Only with KernelTraps.
+    float stripe;
+
+    // Closest the orbit came to each trap in fractal units. Only with
+    // KernelTraps, 0 otherwise.
+    float trapPoint;
+    float trapLine;
+    float trapCross;
+};
+
+////////////////////////////////////////////////////////////
+/// Whether a sample of a render capped at maxIterations never
+/// escaped. The color can not tell, log shading takes escaped
+/// points down to 0 and below when the first escaping r^2 is
+/// large. Known interior points count as having run to the cap.
+////////////////////////////////////////////////////////////
+inline bool isInsideSample(const IterationSample& sample,
+                           float maxIterations)
+{
+    return sample.iterations >= maxIterations;
+}
+
+// Conversions so the kernels can be written once for every precision
+inline double toDouble(float value)
+{
+    return value;
+}
+
+inline double toDouble(double value)
+{
+    return value;
+}
+
+// Offset of a pixel center from the center of the pane in fractal units
+inline double pixelOffset(const KernelParams& params, double pixel)
+{
+    return ((pixel + 0.5) / params.size - 0.5) * params.zoom;
+}
+
+// Size of one pixel in fractal units
+inline double pixelSpacing(const KernelParams& params)
+{
+    return params.zoom / params.size;
+}
+
+// Period of the main cardioid (1) or the period two bulb (2) when c
+// is inside one of them, 0 otherwise
+inline int getMainComponentPeriod(double cReal, double cImag)
+{
+    double q = (cReal - 0.25) * (cReal - 0.25) + cImag * cImag;
+    if (q * (q + (cReal - 0.25)) < 0.25 * cImag * cImag)
+        return 1;
+    if ((cReal + 1.0) * (cReal + 1.0) + cImag * cImag < 0.0625)
+        return 2;
+
+    return 0;
+}
+
+// One step of z^2 + c, followed by the almond bread transform
+template <typename Real>
+inline void iterateStep(Real& real, Real& imag,
+                        const Real& cReal, const Real& cImag, bool almond)
+{
+    Real tempReal = real;
+    real = tempReal * tempReal - imag * imag + cReal;
+    imag = Real(2.0) * tempReal * imag + cImag;
+
+    if (almond)
+    {
+        // Same transform as the shader
+        tempReal = real;
+        real = Real(0.1) * real - imag;
+        imag = Real(1.0) + tempReal + imag;
+    }
+}
+
+////////////////////////////////////////////////////////////
+/// Interior bookkeeping along one orbit. Orbits that come back
+/// to themselves are checked against a point saved at every
+/// power of two (Brent), the smallest |z| gives the atom domain.
+////////////////////////////////////////////////////////////
+struct InteriorCheck
+{
+    // real and imag are the first point of the orbit
+    void start(const KernelParams& params, double real, double imag)
+    {
+        period = 0.0f;
+        checkReal = real;
+        checkImag = imag;
+        checkIter = 0.0f;
+        nextCheck = 1.0f;
+        epsilon = pixelSpacing(params) * INTERIOR_EPSILON;
+
+        // The main cardioid and bulb of the plain Mandlebrot are known
+        if (!params.julia && !params.almond)
+            period = getMainComponentPeriod(real, imag);
+
+        // z1 = c is the first point of the Mandlebrot orbit
+        minR2 = params.julia ? 4.0 : real * real + imag * imag;
+        atom = params.julia ? 0.0f : 1.0f;
+        offset = params.julia ? 1.0f : 2.0f;
+    }
+
+    // z after step iter, true once the orbit is known to be periodic
+    bool update(float iter, double real, double imag, double r2)
+    {
+        if (r2 < minR2)
+        {
+            minR2 = r2;
+            atom = iter + offset;
+        }
+
+        double diffReal = real - checkReal;
+        double diffImag = imag - checkImag;
+        if (diffReal * diffReal + diffImag * diffImag < epsilon * epsilon)
+        {
+            period = iter + 1.0f - checkIter;
+            return true;
+        }
+
+        if (iter + 1.0f == nextCheck)
+        {
+            checkReal = real;
+            checkImag = imag;
+            checkIter = nextCheck;
+            nextCheck *= 2.0f;
+        }
+
+        return false;
+    }
+
+    float period;
+    float atom;
+    float offset;
+    double minR2;
+    double checkReal, checkImag;
+    float checkIter;
+    float nextCheck;
+    double epsilon;
+};
+
+////////////////////////////////////////////////////////////
+/// Orbit traps and stripe average along one orbit, the same
+/// as in the shaders. The traps are fixed shapes, the origin,
+/// the real axis and both axes, so that every one is kept and
+/// the palette picks which to show without iterating again.
+/// The stripe average is the mean of sin(STRIPE_DENSITY * arg z)
+/// over the orbit, smoothed between the means with and without
+/// the last point the way the escape time is.
+////////////////////////////////////////////////////////////
+
+// Stripes per turn around the origin
+#define STRIPE_DENSITY 5.0
+
+struct OrbitTraps
+{
+    void start()
+    {
+        pointR2 = line = cross = 4.0;
+        stripeSum = 0.0;
+        stripeLast = 0.0;
+    }
+
+    // z after a step
+    void update(double real, double imag)
+    {
+        double absReal = fabs(real);
+        double absImag = fabs(imag);
+
+        pointR2 = std::min(pointR2, real * real + imag * imag);
+        line = std::min(line, absImag);
+        cross = std::min(cross, std::min(absReal, absImag));
+
+        stripeLast = 0.5 * sin(STRIPE_DENSITY * atan2(imag, real)) + 0.5;
+        stripeSum += stripeLast;
+    }
+
+    // Stripe value of an orbit that escaped after steps steps with
+    // |z|^2 = r2
+    double getStripe(float steps, double r2) const
+    {
+        double last = stripeSum / steps;
+        double previous = steps > 1.0f ? (stripeSum - stripeLast) /
+                                         (steps - 1.0f) : last;
+
+        // 0 right past the bailout, 1 where one more step was needed
+        double blend = log(log(r2) / log(4.0)) / log(2.0);
+        blend = std::min(std::max(blend, 0.0), 1.0);
+
+        return last + (previous - last) * blend;
+    }
+
+    double pointR2;
+    double line;
+    double cross;
+    double stripeSum;
+    double stripeLast;
+};
+
+// dz' = 2*z*dz (+ 1 for the Mandlebrot), z is the point before the step
+inline void stepDerivative(const KernelParams& params, double zReal,
+                           double zImag, double& dReal, double& dImag)
+{
+    double tempDReal = 2.0 * (zReal * dReal - zImag * dImag) +
+                       (params.julia ? 0.0 : 1.0);
+    dImag = 2.0 * (zReal * dImag + zImag * dReal);
+    dReal = tempDReal;
+}
+
+////////////////////////////////////////////////////////////
+/// Turn the end of an orbit into a sample, interior and traps
+/// are only read when Features has KernelInterior and
+/// KernelTraps
+////////////////////////////////////////////////////////////
+template <int Features>
+IterationSample finishSample(const KernelParams& params, float iter,
+                             double r2, double dReal, double dImag,
+                             const InteriorCheck& interior,
+                             const OrbitTraps& traps)
+{
+    IterationSample sample;
+    sample.iterations = iter;
+    sample.color = 0.0f;
+    sample.distance = 0.0f;
+    sample.atom = 0.0f;
+    sample.period = 0.0f;
+    sample.stripe = 0.0f;
+    sample.trapPoint = 0.0f;
+    sample.trapLine = 0.0f;
+    sample.trapCross = 0.0f;
+
+    if (Features & KernelTraps)
+    {
+        sample.trapPoint = sqrt(traps.pointR2);
+        sample.trapLine = traps.line;
+        sample.trapCross = traps.cross;
+    }
+
+    // Known interior points count as having run to the cap
+    if ((Features & KernelInterior) && interior.period > 0.0f)
+    {
+        sample.iterations = ceil(params.maxIterations);
+        sample.period = interior.period;
+        r2 = 0.0;
+
+        // The main components are inside their own atom domain
+        sample.atom = iter == 0.0f ? interior.period : interior.atom;
+    }
+    else if (Features & KernelInterior)
+    {
+        sample.atom = interior.atom;
+    }
+
+    if (r2 >= 4.0)
+    {
+        // http://linas.org/art-gallery/escape/escape.htm
+        if (params.logShading)
+            sample.color = iter + 1.0 - log(log(r2)) / log(2.0);
+        else
+            sample.color = iter;
+
+        if (Features & KernelDistance)
+        {
+            // d = 0.5*|z|*log|z|/|dz|
+            double modulus = sqrt(r2);
+            double derivative = sqrt(dReal * dReal + dImag * dImag);
+            if (derivative > 0.0)
+                sample.distance = 0.5 * modulus * log(modulus) / derivative;
+        }
+
+        if (Features & KernelTraps)
+            sample.stripe = traps.getStripe(iter, r2);
+    }
+
+    return sample;
+}
+
+////////////////////////////////////////////////////////////
+/// Iterate a single point, real and imag are z0 for the Julia
+/// and c for the Mandlebrot
+///
+/// The derivative for the distance estimate is dz/dc for the
+/// Mandlebrot and dz/dz0 for the Julia. It only has to be as
+/// precise as the final distance, so it is kept in double no
+/// matter what Real is.
+///
+/// KernelInterior skips the main cardioid and bulb of the plain
+/// Mandlebrot and stops orbits that come back to themselves.
+/// KernelTraps follows the orbit for the trap colorings.
+////////////////////////////////////////////////////////////
+template <typename Real, int Features>
+IterationSample iteratePoint(const KernelParams& params, Real real, Real imag)
+{
+    Real cReal = real;
+    Real cImag = imag;
+
+    if (params.julia)
+    {
+        cReal = Real(params.juliaA);
+        cImag = Real(params.juliaB);
+    }
+
+    // dz/dz0 starts at 1 for the Julia, dz/dc starts at 0
+    double dReal = params.julia ? 1.0 : 0.0;
+    double dImag = 0.0;
+
+    double r2 = 0.0;
+    float iter = 0.0f;
+
+    InteriorCheck interior;
+    interior.period = 0.0f;
+    if (Features & KernelInterior)
+        interior.start(params, toDouble(real), toDouble(imag));
+
+    OrbitTraps traps;
+    if (Features & KernelTraps)
+        traps.start();
+
+    for (; interior.period == 0.0f && iter < params.maxIterations && r2 < 4.0;
+         ++iter)
+    {
+        if (Features & KernelDistance)
+            stepDerivative(params, toDouble(real), toDouble(imag),
+                           dReal, dImag);
+
+        iterateStep(real, imag, cReal, cImag, params.almond);
+
+        r2 = toDouble(real * real + imag * imag);
+
+        if (Features & KernelTraps)
+            traps.update(toDouble(real), toDouble(imag));
+
+        if ((Features & KernelInterior) &&
+             interior.update(iter, toDouble(real), toDouble(imag), r2))
+            break;
+    }
+
+    return finishSample<Features>(params, iter, r2, dReal, dImag, interior,
+                                  traps);
+}
+
+////////////////////////////////////////////////////////////
+/// Render a rectangle of the pane into out, which is laid out
+/// row by row with stride samples between rows
+////////////////////////////////////////////////////////////
+template <typename Real, int Features>
+void renderTile(const KernelParams& params, IterationSample* out, int stride,
+                int left, int top, int width, int height)
+{
+    for (int y = 0; y < height; ++y)
+    {
+        // The pane is stored top down but imag grows upwards
+        Real imag = Real(-params.y) - Real(pixelOffset(params, top + y));
+
+        for (int x = 0; x < width; ++x)
+        {
+            Real real = Real(-params.x) + Real(pixelOffset(params, left + x));
+
+            out[y * stride + x] =
+                iteratePoint<Real, Features>(params, real, imag);
+        }
+    }
+}
+
+// The compiled variant for the distance and interior bits of
+// features, Traps is KernelTraps or KernelPlain and goes with all
+template <typename Real, int Traps>
+void renderTileVariant(const KernelParams& params, int features,
+                       IterationSample* out, int stride,
+                       int left, int top, int width, int height)
+{
+    switch (features & (KernelDistance | KernelInterior))
+    {
+        case KernelDistance:
+            renderTile<Real, KernelDistance | Traps>(params, out, stride,
+                                             left, top, width, height);
+            break;
+
+        case KernelInterior:
+            renderTile<Real, KernelInterior | Traps>(params, out, stride,
+                                             left, top, width, height);
+            break;
+
+        case KernelDistance | KernelInterior:
+            renderTile<Real, KernelDistance | KernelInterior | Traps>(params,
+                                    out, stride, left, top, width, height);
+            break;
+
+        default:
+            renderTile<Real, KernelPlain | Traps>(params, out, stride,
+                                          left, top, width, height);
+            break;
+    }
+}
+
+// Pick the compiled variant for a runtime set of features
+template <typename Real>
+void renderTile(const KernelParams& params, int features,
+                IterationSample* out, int stride,
+                int left, int top, int width, int height)
+{
+    if (features & KernelTraps)
+        renderTileVariant<Real, KernelTraps>(params, features, out, stride,
+                                             left, top, width, height);
+    else
+        renderTileVariant<Real, KernelPlain>(params, features, out, stride,
+                                             left, top, width, height);
+}
+
+////////////////////////////////////////////////////////////
+/// Iterate KERNEL_PACKET points in lock step, for the plain
+/// double variant only. Finished lanes keep their state through
+/// selects instead of branches. The lanes run on AVX2 when the
+/// machine has it and one at a time otherwise, both match
+/// iteratePoint exactly unless the build contracts the scalar
+/// math into FMAs.
+////////////////////////////////////////////////////////////
+
+// Lanes per packet, two AVX registers of doubles
+#define KERNEL_PACKET 8
+
+// Advance every lane that has not escaped yet by one step
+template <bool Almond>
+inline void stepPacket(double* real, double* imag, double* r2, double* iter,
+                       const double* cReal, const double* cImag,
+                       double maxIterations)
+{
+    for (int i = 0; i < KERNEL_PACKET; ++i)
+    {
+        bool active = iter[i] < maxIterations && r2[i] < 4.0;
+
+        double newReal = real[i];
+        double newImag = imag[i];
+        iterateStep(newReal, newImag, cReal[i], cImag[i], Almond);
+
+        real[i] = active ? newReal : real[i];
+        imag[i] = active ? newImag : imag[i];
+        r2[i] = active ? real[i] * real[i] + imag[i] * imag[i] : r2[i];
+        iter[i] = active ? iter[i] + 1.0 : iter[i];
+    }
+}
+
+#ifdef KERNEL_AVX2
+
+////////////////////////////////////////////////////////////
+/// stepPacket until every lane is done, on two AVX2 registers
+/// of four lanes. The operations are those of iterateStep in
+/// the same order.
+////////////////////////////////////////////////////////////
+template <bool Almond>
+__attribute__((target("avx2")))
+inline void iterateLanesAvx2(double* real, double* imag, double* r2,
+                             double* iter, const double* cReal,
+                             const double* cImag, double maxIterations)
+{
+    const __m256d cap = _mm256_set1_pd(maxIterations);
+    const __m256d four = _mm256_set1_pd(4.0);
+    const __m256d one = _mm256_set1_pd(1.0);
+    const __m256d two = _mm256_set1_pd(2.0);
+    const __m256d tenth = _mm256_set1_pd(0.1);
+
+    __m256d x[2], y[2], cx[2], cy[2], m[2], n[2], active[2];
+    for (int h = 0; h < 2; ++h)
+    {
+        x[h] = _mm256_loadu_pd(real + h * 4);
+        y[h] = _mm256_loadu_pd(imag + h * 4);
+        cx[h] = _mm256_loadu_pd(cReal + h * 4);
+        cy[h] = _mm256_loadu_pd(cImag + h * 4);
+        m[h] = _mm256_loadu_pd(r2 + h * 4);
+        n[h] = _mm256_loadu_pd(iter + h * 4);
+    }
+
+    for (;;)
+    {
+        int running = 0;
+        for (int h = 0; h < 2; ++h)
+        {
+            active[h] = _mm256_and_pd(_mm256_cmp_pd(n[h], cap, _CMP_LT_OQ),
+                                      _mm256_cmp_pd(m[h], four, _CMP_LT_OQ));
+            running |= _mm256_movemask_pd(active[h]);
+        }
+
+        if (!running)
+            break;
+
+        for (int h = 0; h < 2; ++h)
+        {
+            __m256d newX = _mm256_add_pd(_mm256_sub_pd(
+                               _mm256_mul_pd(x[h], x[h]),
+                               _mm256_mul_pd(y[h], y[h])), cx[h]);
+            __m256d newY = _mm256_add_pd(_mm256_mul_pd(
+                               _mm256_mul_pd(two, x[h]), y[h]), cy[h]);
+
+            if (Almond)
+            {
+                __m256d temp = newX;
+                newX = _mm256_sub_pd(_mm256_mul_pd(tenth, newX), newY);
+                newY = _mm256_add_pd(_mm256_add_pd(one, temp), newY);
+            }
+
+            x[h] = _mm256_blendv_pd(x[h], newX, active[h]);
+            y[h] = _mm256_blendv_pd(y[h], newY, active[h]);
+            m[h] = _mm256_blendv_pd(m[h], _mm256_add_pd(
+                       _mm256_mul_pd(x[h], x[h]), _mm256_mul_pd(y[h], y[h])),
+                       active[h]);
+            n[h] = _mm256_add_pd(n[h], _mm256_and_pd(active[h], one));
+        }
+    }
+
+    for (int h = 0; h < 2; ++h)
+    {
+        _mm256_storeu_pd(real + h * 4, x[h]);
+        _mm256_storeu_pd(imag + h * 4, y[h]);
+        _mm256_storeu_pd(r2 + h * 4, m[h]);
+        _mm256_storeu_pd(iter + h * 4, n[h]);
+    }
+}
+
+#endif // KERNEL_AVX2
+
+// Whether this machine runs the AVX2 lanes, checked once
+inline bool hasKernelAvx2()
+{
+#ifdef KERNEL_AVX2
+    static const bool avx2 = __builtin_cpu_supports("avx2");
+    return avx2;
+#else
+    return false;
+#endif
+}
+
+inline void iteratePacket(const KernelParams& params,
+                          const double* startReal, const double* startImag,
+                          IterationSample* out)
+{
+    double real[KERNEL_PACKET], imag[KERNEL_PACKET];
+    double cReal[KERNEL_PACKET], cImag[KERNEL_PACKET];
+    double r2[KERNEL_PACKET];
+
+    // Whole numbers, kept in double so every lane array is the same width
+    double iter[KERNEL_PACKET];
+
+    for (int i = 0; i < KERNEL_PACKET; ++i)
+    {
+        real[i] = startReal[i];
+        imag[i] = startImag[i];
+        cReal[i] = params.julia ? params.juliaA : startReal[i];
+        cImag[i] = params.julia ? params.juliaB : startImag[i];
+        r2[i] = 0.0;
+        iter[i] = 0.0;
+    }
+
+    double maxIterations = params.maxIterations;
+
+#ifdef KERNEL_AVX2
+    if (hasKernelAvx2())
+    {
+        if (params.almond)
+            iterateLanesAvx2<true>(real, imag, r2, iter, cReal, cImag,
+                                   maxIterations);
+        else
+            iterateLanesAvx2<false>(real, imag, r2, iter, cReal, cImag,
+                                    maxIterations);
+    }
+    else
+#endif
+    {
+        bool running = true;
+        while (running)
+        {
+            if (params.almond)
+                stepPacket<true>(real, imag, r2, iter, cReal, cImag,
+                                 maxIterations);
+            else
+                stepPacket<false>(real, imag, r2, iter, cReal, cImag,
+                                  maxIterations);
+
+            running = false;
+            for (int i = 0; i < KERNEL_PACKET; ++i)
+                running |= iter[i] < maxIterations && r2[i] < 4.0;
+        }
+    }
+
+    for (int i = 0; i < KERNEL_PACKET; ++i)
+    {
+        float count = static_cast<float>(iter[i]);
+
+        out[i].iterations = count;
+        out[i].color = 0.0f;
+        out[i].distance = 0.0f;
+        out[i].atom = 0.0f;
+        out[i].period = 0.0f;
+        out[i].stripe = 0.0f;
+        out[i].trapPoint = 0.0f;
+        out[i].trapLine = 0.0f;
+        out[i].trapCross = 0.0f;
+
+        if (r2[i] >= 4.0)
+        {
+            if (params.logShading)
+                out[i].color = count + 1.0 - log(log(r2[i])) / log(2.0);
+            else
+                out[i].color = count;
+        }
+    }
+}
+
+// Same as renderTile<double, KernelPlain>, a packet at a time
+inline void renderPacketTile(const KernelParams& params, IterationSample* out,
+                             int stride, int left, int top,
+                             int width, int height)
+{
+    double real[KERNEL_PACKET], imag[KERNEL_PACKET];
+    IterationSample samples[KERNEL_PACKET];
+
+    for (int y = 0; y < height; ++y)
+    {
+        double rowImag = -params.y - pixelOffset(params, top + y);
+
+        for (int x = 0; x < width; x += KERNEL_PACKET)
+        {
+            // The last packet of a row repeats its final pixel
+            for (int i = 0; i < KERNEL_PACKET; ++i)
+            {
+                int column = left + std::min(x + i, width - 1);
+                real[i] = -params.x + pixelOffset(params, column);
+                imag[i] = rowImag;
+            }
+
+            iteratePacket(params, real, imag, samples);
+
+            int count = std::min(KERNEL_PACKET, width - x);
+            for (int i = 0; i < count; ++i)
+                out[y * stride + x + i] = samples[i];
+        }
+    }
+}
+
+#endif // KERNEL_HPP
@@ -0,0 +1,1374 @@
+#ifndef MANDELBULB_HPP
+#define MANDELBULB_HPP
+
+////////////////////////////////////////////////////////////
+// Headers
+////////////////////////////////////////////////////////////
+#include "Effect.hpp"
+#include "Threads.hpp"
+
+#include <SFML/Graphics.hpp>
+
+#include <vector>
+#include <algorithm>
+#include <cmath>
+#include <stdio.h>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+    #define RAY_AVX2
+    #include <immintrin.h>
+#endif
+
+////////////////////////////////////////////////////////////
+// 3D fractals, ray marched on the CPU with their distance
+// estimators. A distance estimate is a radius around a point
+// that holds none of the fractal, so a ray can safely advance
+// by it. Rays are marched in packets with selects like the 2D
+// packet kernel. The estimators, where the time goes, run the
+// packet on AVX2 lanes when the machine has them and one lane at
+// a time otherwise; the rest of the march is scalar code over the
+// packet.
+////////////////////////////////////////////////////////////
+
+// Rays marched in lock step, two AVX registers of doubles
+#define RAY_PACKET 8
+
+// Tangent of half the field of view, about 40 degrees across
+#define RAY_FOV 0.36
+
+// A ray hits once the estimate is below this share of its pixel
+#define RAY_HIT 0.5
+
+// Reprojected distances are shortened by this much before a ray
+// starts at them, surfaces seen last frame may have moved closer
+#define RAY_HINT_SAFETY 0.95
+
+// Time a pass may take while the camera moves, in milliseconds
+#define RAY_FRAME_BUDGET 33
+
+// Depth of pixels that hit nothing
+#define RAY_MISS -1.0f
+
+// Color values of the traps are spread over this much of the palette
+#define RAY_COLOR_RANGE 100.0f
+
+// Radians the camera orbits per pixel of mouse drag
+#define RAY_ORBIT_SPEED 0.01f
+
+// Power 8 Mandelbulb, iterations of the estimate and the bailout
+// on the squared radius
+#define BULB_ITERATIONS 10
+#define BULB_BAILOUT 256.0
+#define BULB_RADIUS 1.2
+
+// Mandelbox, a box fold and a sphere fold per iteration
+#define BOX_SCALE -1.75
+#define BOX_ITERATIONS 12
+#define BOX_MIN_RADIUS2 0.25
+#define BOX_FIXED_RADIUS2 1.0
+#define BOX_RADIUS 3.5
+
+enum RayShape
+{
+    ShapeMandelbulb,
+    ShapeMandelbox,
+
+    ShapeCount
+};
+
+inline const char* getShapeName(int shape)
+{
+    static const char* names[ShapeCount] = {"Mandelbulb", "Mandelbox"};
+    return names[shape];
+}
+
+// Radius of a sphere around the origin that holds the whole shape
+inline double getShapeRadius(int shape)
+{
+    return shape == ShapeMandelbox ? BOX_RADIUS : BULB_RADIUS;
+}
+
+////////////////////////////////////////////////////////////
+/// Quality of a pass. Passes while the camera moves trace
+/// fewer pixels with fewer steps, level 0 is the still frame.
+////////////////////////////////////////////////////////////
+struct RayQuality
+{
+    // Screen pixels across one traced pixel
+    int scale;
+
+    // Steps a ray gets before it counts as a hit
+    int steps;
+};
+
+#define RAY_LEVELS 7
+
+inline const RayQuality& getRayQuality(int level)
+{
+    static const RayQuality levels[RAY_LEVELS] =
+        {{1, 256}, {1, 128}, {2, 96}, {2, 64}, {4, 48}, {4, 32}, {8, 24}};
+
+    return levels[level];
+}
+
+// Orbit camera looking at the origin
+struct RayCamera
+{
+    int shape;
+    double yaw, pitch, distance;
+};
+
+inline bool operator==(const RayCamera& a, const RayCamera& b)
+{
+    return a.shape == b.shape && a.yaw == b.yaw && a.pitch == b.pitch &&
+           a.distance == b.distance;
+}
+
+inline bool operator!=(const RayCamera& a, const RayCamera& b)
+{
+    return !(a == b);
+}
+
+// Position and axes of a camera, y is up
+struct RayBasis
+{
+    double origin[3];
+    double forward[3], right[3], up[3];
+};
+
+inline RayBasis getRayBasis(const RayCamera& camera)
+{
+    double cosPitch = cos(camera.pitch), sinPitch = sin(camera.pitch);
+    double cosYaw = cos(camera.yaw), sinYaw = sin(camera.yaw);
+
+    RayBasis basis;
+    basis.origin[0] = camera.distance * cosPitch * sinYaw;
+    basis.origin[1] = camera.distance * sinPitch;
+    basis.origin[2] = camera.distance * cosPitch * cosYaw;
+
+    basis.forward[0] = -cosPitch * sinYaw;
+    basis.forward[1] = -sinPitch;
+    basis.forward[2] = -cosPitch * cosYaw;
+
+    basis.right[0] = cosYaw;
+    basis.right[1] = 0.0;
+    basis.right[2] = -sinYaw;
+
+    basis.up[0] = -sinYaw * sinPitch;
+    basis.up[1] = cosPitch;
+    basis.up[2] = -cosYaw * sinPitch;
+
+    return basis;
+}
+
+// Unit direction of the ray through the center of a pixel
+inline void getRayDirection(const RayBasis& basis, int size, double x,
+                            double y, double* direction)
+{
+    double u = ((x + 0.5) / size * 2.0 - 1.0) * RAY_FOV;
+    double v = (1.0 - (y + 0.5) / size * 2.0) * RAY_FOV;
+
+    double length = 0.0;
+    for (int c = 0; c < 3; ++c)
+    {
+        direction[c] = basis.forward[c] + u * basis.right[c] +
+                       v * basis.up[c];
+        length += direction[c] * direction[c];
+    }
+
+    length = sqrt(length);
+    for (int c = 0; c < 3; ++c)
+        direction[c] /= length;
+}
+
+////////////////////////////////////////////////////////////
+/// Power 8 Mandelbulb estimate, z = z^8 + p with the triplex
+/// power written out as a polynomial so there is no atan or
+/// pow in the loop. trap gets the smallest squared radius.
+////////////////////////////////////////////////////////////
+inline void getBulbDistance(const double* px, const double* py,
+                            const double* pz, double* distance,
+                            double* trap)
+{
+    double x[RAY_PACKET], y[RAY_PACKET], z[RAY_PACKET];
+    double m[RAY_PACKET], dr[RAY_PACKET];
+
+    for (int i = 0; i < RAY_PACKET; ++i)
+    {
+        x[i] = px[i];
+        y[i] = py[i];
+        z[i] = pz[i];
+        m[i] = x[i] * x[i] + y[i] * y[i] + z[i] * z[i];
+        dr[i] = 1.0;
+        trap[i] = m[i];
+    }
+
+    for (int n = 0; n < BULB_ITERATIONS; ++n)
+    {
+        bool running = false;
+        for (int i = 0; i < RAY_PACKET; ++i)
+        {
+            bool active = m[i] < BULB_BAILOUT;
+
+            double x2 = x[i] * x[i], y2 = y[i] * y[i], z2 = z[i] * z[i];
+            double x4 = x2 * x2, y4 = y2 * y2, z4 = z2 * z2;
+
+            // Points on the y axis would divide by zero
+            double k3 = std::max(x2 + z2, 1e-30);
+            double k2 = 1.0 / sqrt(k3 * k3 * k3 * k3 * k3 * k3 * k3);
+            double k1 = x4 + y4 + z4 - 6.0 * y2 * z2 - 6.0 * x2 * y2 +
+                        2.0 * z2 * x2;
+            double k4 = x2 - y2 + z2;
+
+            double newX = px[i] + 64.0 * x[i] * y[i] * z[i] * (x2 - z2) *
+                          k4 * (x4 - 6.0 * x2 * z2 + z4) * k1 * k2;
+            double newY = py[i] - 16.0 * y2 * k3 * k4 * k4 + k1 * k1;
+            double newZ = pz[i] - 8.0 * y[i] * k4 *
+                          (x4 * x4 - 28.0 * x4 * x2 * z2 + 70.0 * x4 * z4 -
+                           28.0 * x2 * z2 * z4 + z4 * z4) * k1 * k2;
+
+            // The derivative grows by 8 r^7
+            double newDr = 8.0 * m[i] * m[i] * m[i] * sqrt(m[i]) * dr[i] +
+                           1.0;
+
+            x[i] = active ? newX : x[i];
+            y[i] = active ? newY : y[i];
+            z[i] = active ? newZ : z[i];
+            dr[i] = active ? newDr : dr[i];
+            m[i] = active ? x[i] * x[i] + y[i] * y[i] + z[i] * z[i] : m[i];
+            trap[i] = std::min(trap[i], m[i]);
+
+            running |= m[i] < BULB_BAILOUT;
+        }
+
+        if (!running)
+            break;
+    }
+
+    for (int i = 0; i < RAY_PACKET; ++i)
+    {
+        double radius2 = std::max(m[i], 1e-30);
+        distance[i] = 0.25 * log(radius2) * sqrt(radius2) / dr[i];
+    }
+}
+
+////////////////////////////////////////////////////////////
+/// Mandelbox estimate, every iteration folds the point back
+/// into a box and a sphere and scales it. There is no bailout,
+/// the folds keep points inside bounded and the others only
+/// grow by the scale. trap gets the smallest squared radius.
+////////////////////////////////////////////////////////////
+inline void getBoxDistance(const double* px, const double* py,
+                           const double* pz, double* distance, double* trap)
+{
+    double x[RAY_PACKET], y[RAY_PACKET], z[RAY_PACKET];
+    double dr[RAY_PACKET];
+
+    for (int i = 0; i < RAY_PACKET; ++i)
+    {
+        x[i] = px[i];
+        y[i] = py[i];
+        z[i] = pz[i];
+        dr[i] = 1.0;
+        trap[i] = 1e30;
+    }
+
+    for (int n = 0; n < BOX_ITERATIONS; ++n)
+    {
+        for (int i = 0; i < RAY_PACKET; ++i)
+        {
+            x[i] = std::min(std::max(x[i], -1.0), 1.0) * 2.0 - x[i];
+            y[i] = std::min(std::max(y[i], -1.0), 1.0) * 2.0 - y[i];
+            z[i] = std::min(std::max(z[i], -1.0), 1.0) * 2.0 - z[i];
+
+            double r2 = x[i] * x[i] + y[i] * y[i] + z[i] * z[i];
+            double factor = r2 < BOX_MIN_RADIUS2 ?
+                                BOX_FIXED_RADIUS2 / BOX_MIN_RADIUS2 :
+                            r2 < BOX_FIXED_RADIUS2 ?
+                                BOX_FIXED_RADIUS2 / r2 : 1.0;
+
+            x[i] = x[i] * factor * BOX_SCALE + px[i];
+            y[i] = y[i] * factor * BOX_SCALE + py[i];
+            z[i] = z[i] * factor * BOX_SCALE + pz[i];
+            dr[i] = dr[i] * factor * fabs(BOX_SCALE) + 1.0;
+            trap[i] = std::min(trap[i], r2);
+        }
+    }
+
+    for (int i = 0; i < RAY_PACKET; ++i)
+        distance[i] = sqrt(x[i] * x[i] + y[i] * y[i] + z[i] * z[i]) / dr[i];
+}
+
+#ifdef RAY_AVX2
+
+////////////////////////////////////////////////////////////
+/// getBulbDistance on AVX2, four lanes per register and the
+/// operations in the same order so the lanes match it. The log
+/// of the estimate stays scalar.
+////////////////////////////////////////////////////////////
+__attribute__((target("avx2")))
+inline void getBulbDistanceAvx2(const double* px, const double* py,
+                                const double* pz, double* distance,
+                                double* trap)
+{
+    const __m256d one = _mm256_set1_pd(1.0);
+    const __m256d two = _mm256_set1_pd(2.0);
+    const __m256d six = _mm256_set1_pd(6.0);
+    const __m256d eight = _mm256_set1_pd(8.0);
+    const __m256d sixteen = _mm256_set1_pd(16.0);
+    const __m256d twentyEight = _mm256_set1_pd(28.0);
+    const __m256d sixtyFour = _mm256_set1_pd(64.0);
+    const __m256d seventy = _mm256_set1_pd(70.0);
+    const __m256d tiny = _mm256_set1_pd(1e-30);
+    const __m256d bailout = _mm256_set1_pd(BULB_BAILOUT);
+
+    for (int lane = 0; lane < RAY_PACKET; lane += 4)
+    {
+        __m256d cx = _mm256_loadu_pd(px + lane);
+        __m256d cy = _mm256_loadu_pd(py + lane);
+        __m256d cz = _mm256_loadu_pd(pz + lane);
+
+        __m256d x = cx, y = cy, z = cz;
+        __m256d m = _mm256_add_pd(_mm256_add_pd(_mm256_mul_pd(x, x),
+                                                _mm256_mul_pd(y, y)),
+                                  _mm256_mul_pd(z, z));
+        __m256d dr = one;
+        __m256d minimum = m;
+
+        for (int n = 0; n < BULB_ITERATIONS; ++n)
+        {
+            __m256d active = _mm256_cmp_pd(m, bailout, _CMP_LT_OQ);
+            if (!_mm256_movemask_pd(active))
+                break;
+
+            __m256d x2 = _mm256_mul_pd(x, x);
+            __m256d y2 = _mm256_mul_pd(y, y);
+            __m256d z2 = _mm256_mul_pd(z, z);
+            __m256d x4 = _mm256_mul_pd(x2, x2);
+            __m256d y4 = _mm256_mul_pd(y2, y2);
+            __m256d z4 = _mm256_mul_pd(z2, z2);
+
+            __m256d k3 = _mm256_max_pd(tiny, _mm256_add_pd(x2, z2));
+            __m256d k3n = _mm256_mul_pd(k3, k3);
+            for (int i = 0; i < 5; ++i)
+                k3n = _mm256_mul_pd(k3n, k3);
+            __m256d k2 = _mm256_div_pd(one, _mm256_sqrt_pd(k3n));
+
+            __m256d k1 = _mm256_add_pd(x4, y4);
+            k1 = _mm256_add_pd(k1, z4);
+            k1 = _mm256_sub_pd(k1, _mm256_mul_pd(_mm256_mul_pd(six, y2), z2));
+            k1 = _mm256_sub_pd(k1, _mm256_mul_pd(_mm256_mul_pd(six, x2), y2));
+            k1 = _mm256_add_pd(k1, _mm256_mul_pd(_mm256_mul_pd(two, z2), x2));
+            __m256d k4 = _mm256_add_pd(_mm256_sub_pd(x2, y2), z2);
+
+            __m256d quartic = _mm256_add_pd(_mm256_sub_pd(x4,
+                              _mm256_mul_pd(_mm256_mul_pd(six, x2), z2)), z4);
+            __m256d newX = _mm256_mul_pd(sixtyFour, x);
+            newX = _mm256_mul_pd(newX, y);
+            newX = _mm256_mul_pd(newX, z);
+            newX = _mm256_mul_pd(newX, _mm256_sub_pd(x2, z2));
+            newX = _mm256_mul_pd(newX, k4);
+            newX = _mm256_mul_pd(newX, quartic);
+            newX = _mm256_mul_pd(newX, k1);
+            newX = _mm256_add_pd(cx, _mm256_mul_pd(newX, k2));
+
+            __m256d newY = _mm256_mul_pd(_mm256_mul_pd(sixteen, y2), k3);
+            newY = _mm256_mul_pd(_mm256_mul_pd(newY, k4), k4);
+            newY = _mm256_add_pd(_mm256_sub_pd(cy, newY),
+                                 _mm256_mul_pd(k1, k1));
+
+            __m256d octic = _mm256_mul_pd(x4, x4);
+            octic = _mm256_sub_pd(octic, _mm256_mul_pd(_mm256_mul_pd(
+                        _mm256_mul_pd(twentyEight, x4), x2), z2));
+            octic = _mm256_add_pd(octic, _mm256_mul_pd(
+                        _mm256_mul_pd(seventy, x4), z4));
+            octic = _mm256_sub_pd(octic, _mm256_mul_pd(_mm256_mul_pd(
+                        _mm256_mul_pd(twentyEight, x2), z2), z4));
+            octic = _mm256_add_pd(octic, _mm256_mul_pd(z4, z4));
+            __m256d newZ = _mm256_mul_pd(_mm256_mul_pd(eight, y), k4);
+            newZ = _mm256_mul_pd(_mm256_mul_pd(newZ, octic), k1);
+            newZ = _mm256_sub_pd(cz, _mm256_mul_pd(newZ, k2));
+
+            __m256d newDr = _mm256_mul_pd(_mm256_mul_pd(eight, m), m);
+            newDr = _mm256_mul_pd(_mm256_mul_pd(newDr, m), _mm256_sqrt_pd(m));
+            newDr = _mm256_add_pd(_mm256_mul_pd(newDr, dr), one);
+
+            x = _mm256_blendv_pd(x, newX, active);
+            y = _mm256_blendv_pd(y, newY, active);
+            z = _mm256_blendv_pd(z, newZ, active);
+            dr = _mm256_blendv_pd(dr, newDr, active);
+            m = _mm256_blendv_pd(m, _mm256_add_pd(_mm256_add_pd(
+                    _mm256_mul_pd(x, x), _mm256_mul_pd(y, y)),
+                    _mm256_mul_pd(z, z)), active);
+            minimum = _mm256_min_pd(m, minimum);
+        }
+
+        double radius2[4], derivative[4];
+        _mm256_storeu_pd(radius2, _mm256_max_pd(tiny, m));
+        _mm256_storeu_pd(derivative, dr);
+        _mm256_storeu_pd(trap + lane, minimum);
+
+        for (int i = 0; i < 4; ++i)
+            distance[lane + i] = 0.25 * log(radius2[i]) * sqrt(radius2[i]) /
+                                 derivative[i];
+    }
+}
+
+// getBoxDistance on AVX2, the lanes match it
+__attribute__((target("avx2")))
+inline void getBoxDistanceAvx2(const double* px, const double* py,
+                               const double* pz, double* distance,
+                               double* trap)
+{
+    const __m256d one = _mm256_set1_pd(1.0);
+    const __m256d minusOne = _mm256_set1_pd(-1.0);
+    const __m256d two = _mm256_set1_pd(2.0);
+    const __m256d scale = _mm256_set1_pd(BOX_SCALE);
+    const __m256d scaleSize = _mm256_set1_pd(fabs(BOX_SCALE));
+    const __m256d minRadius = _mm256_set1_pd(BOX_MIN_RADIUS2);
+    const __m256d fixedRadius = _mm256_set1_pd(BOX_FIXED_RADIUS2);
+    const __m256d minFactor = _mm256_set1_pd(BOX_FIXED_RADIUS2 /
+                                             BOX_MIN_RADIUS2);
+
+    for (int lane = 0; lane < RAY_PACKET; lane += 4)
+    {
+        __m256d cx = _mm256_loadu_pd(px + lane);
+        __m256d cy = _mm256_loadu_pd(py + lane);
+        __m256d cz = _mm256_loadu_pd(pz + lane);
+
+        __m256d x = cx, y = cy, z = cz;
+        __m256d dr = one;
+        __m256d minimum = _mm256_set1_pd(1e30);
+
+        for (int n = 0; n < BOX_ITERATIONS; ++n)
+        {
+            x = _mm256_sub_pd(_mm256_mul_pd(_mm256_min_pd(one,
+                    _mm256_max_pd(minusOne, x)), two), x);
+            y = _mm256_sub_pd(_mm256_mul_pd(_mm256_min_pd(one,
+                    _mm256_max_pd(minusOne, y)), two), y);
+            z = _mm256_sub_pd(_mm256_mul_pd(_mm256_min_pd(one,
+                    _mm256_max_pd(minusOne, z)), two), z);
+
+            __m256d r2 = _mm256_add_pd(_mm256_add_pd(_mm256_mul_pd(x, x),
+                                                     _mm256_mul_pd(y, y)),
+                                       _mm256_mul_pd(z, z));
+            __m256d factor = _mm256_blendv_pd(one,
+                                 _mm256_div_pd(fixedRadius, r2),
+                                 _mm256_cmp_pd(r2, fixedRadius, _CMP_LT_OQ));
+            factor = _mm256_blendv_pd(factor, minFactor,
+                                 _mm256_cmp_pd(r2, minRadius, _CMP_LT_OQ));
+
+            x = _mm256_add_pd(_mm256_mul_pd(_mm256_mul_pd(x, factor), scale),
+                              cx);
+            y = _mm256_add_pd(_mm256_mul_pd(_mm256_mul_pd(y, factor), scale),
+                              cy);
+            z = _mm256_add_pd(_mm256_mul_pd(_mm256_mul_pd(z, factor), scale),
+                              cz);
+            dr = _mm256_add_pd(_mm256_mul_pd(_mm256_mul_pd(dr, factor),
+                                             scaleSize), one);
+            minimum = _mm256_min_pd(r2, minimum);
+        }
+
+        __m256d length = _mm256_sqrt_pd(_mm256_add_pd(_mm256_add_pd(
+                             _mm256_mul_pd(x, x), _mm256_mul_pd(y, y)),
+                             _mm256_mul_pd(z, z)));
+        _mm256_storeu_pd(distance + lane, _mm256_div_pd(length, dr));
+        _mm256_storeu_pd(trap + lane, minimum);
+    }
+}
+
+#endif // RAY_AVX2
+
+// Whether this machine runs the AVX2 estimators, checked once
+inline bool hasRayAvx2()
+{
+#ifdef RAY_AVX2
+    static const bool avx2 = __builtin_cpu_supports("avx2");
+    return avx2;
+#else
+    return false;
+#endif
+}
+
+inline void getShapeDistance(int shape, const double* x, const double* y,
+                             const double* z, double* distance,
+                             double* trap)
+{
+#ifdef RAY_AVX2
+    if (hasRayAvx2())
+    {
+        if (shape == ShapeMandelbox)
+            getBoxDistanceAvx2(x, y, z, distance, trap);
+        else
+            getBulbDistanceAvx2(x, y, z, distance, trap);
+        return;
+    }
+#endif
+
+    if (shape == ShapeMandelbox)
+        getBoxDistance(x, y, z, distance, trap);
+    else
+        getBulbDistance(x, y, z, distance, trap);
+}
+
+// What a pass produces for every pixel
+struct RayPixel
+{
+    // Distance along the ray to the surface, RAY_MISS if none
+    float depth;
+
+    // Orbit trap, looked up in the palette
+    float color;
+
+    // Light reaching the surface, 0 to 1
+    float shade;
+};
+
+////////////////////////////////////////////////////////////
+/// March RAY_PACKET rays from the camera in basis. start holds
+/// a distance each ray may skip to, from a reprojected frame,
+/// or 0. cone is the width of a pixel at distance 1.
+////////////////////////////////////////////////////////////
+inline void traceRayPacket(int shape, const RayBasis& basis,
+                           const double (*directions)[3],
+                           const float* start, double cone, int maxSteps,
+                           RayPixel* out)
+{
+    // Distance along each ray, and where it enters and leaves the
+    // bounding sphere
+    double t[RAY_PACKET], front[RAY_PACKET], back[RAY_PACKET];
+    double px[RAY_PACKET], py[RAY_PACKET], pz[RAY_PACKET];
+    double distance[RAY_PACKET], trap[RAY_PACKET], color[RAY_PACKET];
+
+    // 1 while marching, 0 once done, double so every lane array is
+    // the same width
+    double marching[RAY_PACKET];
+
+    const double* origin = basis.origin;
+    double radius = getShapeRadius(shape);
+
+    // Clip every ray to the bounding sphere
+    bool running = false;
+    for (int i = 0; i < RAY_PACKET; ++i)
+    {
+        const double* direction = directions[i];
+        double b = origin[0] * direction[0] + origin[1] * direction[1] +
+                   origin[2] * direction[2];
+        double c = origin[0] * origin[0] + origin[1] * origin[1] +
+                   origin[2] * origin[2] - radius * radius;
+        double root = sqrt(std::max(b * b - c, 0.0));
+
+        front[i] = std::max(-b - root, 0.0);
+        back[i] = b * b - c > 0.0 ? -b + root : 0.0;
+        t[i] = std::max(front[i], start[i] * RAY_HINT_SAFETY);
+        marching[i] = t[i] < back[i] ? 1.0 : 0.0;
+        color[i] = 0.0;
+
+        running |= marching[i] > 0.0;
+    }
+
+    // A ray that starts on a surface was sent past one that moved in
+    // front of it, those go back to the bounding sphere
+    bool hinted = false;
+    for (int i = 0; i < RAY_PACKET; ++i)
+        hinted |= t[i] > front[i];
+
+    if (hinted && running)
+    {
+        for (int i = 0; i < RAY_PACKET; ++i)
+        {
+            px[i] = origin[0] + directions[i][0] * t[i];
+            py[i] = origin[1] + directions[i][1] * t[i];
+            pz[i] = origin[2] + directions[i][2] * t[i];
+        }
+
+        getShapeDistance(shape, px, py, pz, distance, trap);
+
+        for (int i = 0; i < RAY_PACKET; ++i)
+            t[i] = distance[i] < cone * t[i] * RAY_HIT ? front[i] : t[i];
+    }
+
+    for (int step = 0; step < maxSteps && running; ++step)
+    {
+        for (int i = 0; i < RAY_PACKET; ++i)
+        {
+            px[i] = origin[0] + directions[i][0] * t[i];
+            py[i] = origin[1] + directions[i][1] * t[i];
+            pz[i] = origin[2] + directions[i][2] * t[i];
+        }
+
+        getShapeDistance(shape, px, py, pz, distance, trap);
+
+        running = false;
+        for (int i = 0; i < RAY_PACKET; ++i)
+        {
+            bool active = marching[i] > 0.0;
+            bool close = distance[i] < cone * t[i] * RAY_HIT;
+
+            color[i] = active ? trap[i] : color[i];
+            t[i] = active && !close ? t[i] + distance[i] : t[i];
+            marching[i] = active && !close && t[i] < back[i] ? 1.0 : 0.0;
+
+            running |= marching[i] > 0.0;
+        }
+    }
+
+    // Rays out of steps are creeping along a surface and count as hits
+    bool hit[RAY_PACKET];
+    bool anyHit = false;
+    for (int i = 0; i < RAY_PACKET; ++i)
+    {
+        hit[i] = t[i] < back[i];
+        anyHit |= hit[i];
+
+        out[i].depth = hit[i] ? static_cast<float>(t[i]) : RAY_MISS;
+        out[i].color = static_cast<float>(sqrt(color[i]));
+        out[i].shade = 0.0f;
+    }
+
+    if (!anyHit)
+        return;
+
+    // Normals from the estimate at the corners of a tetrahedron
+    static const double corners[4][3] =
+        {{1, -1, -1}, {-1, -1, 1}, {-1, 1, -1}, {1, 1, 1}};
+
+    double normal[3][RAY_PACKET];
+    double epsilon[RAY_PACKET];
+    for (int i = 0; i < RAY_PACKET; ++i)
+    {
+        epsilon[i] = std::max(cone * t[i] * RAY_HIT, 1e-7);
+        normal[0][i] = normal[1][i] = normal[2][i] = 0.0;
+    }
+
+    for (int k = 0; k < 4; ++k)
+    {
+        for (int i = 0; i < RAY_PACKET; ++i)
+        {
+            px[i] = origin[0] + directions[i][0] * t[i] +
+                    corners[k][0] * epsilon[i];
+            py[i] = origin[1] + directions[i][1] * t[i] +
+                    corners[k][1] * epsilon[i];
+            pz[i] = origin[2] + directions[i][2] * t[i] +
+                    corners[k][2] * epsilon[i];
+        }
+
+        getShapeDistance(shape, px, py, pz, distance, trap);
+
+        for (int i = 0; i < RAY_PACKET; ++i)
+            for (int c = 0; c < 3; ++c)
+                normal[c][i] += corners[k][c] * distance[i];
+    }
+
+    // Key light over the left shoulder of the camera
+    double light[3];
+    double lightLength = 0.0;
+    for (int c = 0; c < 3; ++c)
+    {
+        light[c] = -basis.forward[c] + 0.6 * basis.up[c] -
+                   0.4 * basis.right[c];
+        lightLength += light[c] * light[c];
+    }
+
+    lightLength = sqrt(lightLength);
+    for (int c = 0; c < 3; ++c)
+        light[c] /= lightLength;
+
+    double diffuse[RAY_PACKET];
+    for (int i = 0; i < RAY_PACKET; ++i)
+    {
+        double length = sqrt(normal[0][i] * normal[0][i] +
+                             normal[1][i] * normal[1][i] +
+                             normal[2][i] * normal[2][i]) + 1e-30;
+
+        for (int c = 0; c < 3; ++c)
+            normal[c][i] /= length;
+
+        diffuse[i] = std::max(normal[0][i] * light[0] +
+                              normal[1][i] * light[1] +
+                              normal[2][i] * light[2], 0.0);
+    }
+
+    // Ambient occlusion, how much the estimate falls short of the
+    // distance walked out along the normal
+    double occlusion[RAY_PACKET];
+    for (int i = 0; i < RAY_PACKET; ++i)
+        occlusion[i] = 0.0;
+
+    double radius3 = radius * 0.02;
+    for (int k = 1; k <= 3; ++k)
+    {
+        double h = radius3 * k;
+        for (int i = 0; i < RAY_PACKET; ++i)
+        {
+            px[i] = origin[0] + directions[i][0] * t[i] + normal[0][i] * h;
+            py[i] = origin[1] + directions[i][1] * t[i] + normal[1][i] * h;
+            pz[i] = origin[2] + directions[i][2] * t[i] + normal[2][i] * h;
+        }
+
+        getShapeDistance(shape, px, py, pz, distance, trap);
+
+        for (int i = 0; i < RAY_PACKET; ++i)
+            occlusion[i] += (h - std::max(distance[i], 0.0)) / (h * k);
+    }
+
+    for (int i = 0; i < RAY_PACKET; ++i)
+    {
+        double ambient = std::min(std::max(1.0 - occlusion[i] * 0.5, 0.0),
+                                  1.0);
+        double shade = (0.2 + 0.8 * diffuse[i]) * ambient;
+
+        out[i].shade = hit[i] ? static_cast<float>(shade) : 0.0f;
+    }
+}
+
+////////////////////////////////////////////////////////////
+/// Trace one row of a size x size view. start is NULL or has
+/// a distance to start every ray of the row at.
+////////////////////////////////////////////////////////////
+inline void traceRayRow(const RayCamera& camera, int size, int row,
+                        int maxSteps, const float* start, RayPixel* out)
+{
+    RayBasis basis = getRayBasis(camera);
+    double cone = 2.0 * RAY_FOV / size;
+
+    double directions[RAY_PACKET][3];
+    float starts[RAY_PACKET];
+    RayPixel pixels[RAY_PACKET];
+
+    for (int x = 0; x < size; x += RAY_PACKET)
+    {
+        // The last packet of a row repeats its final pixel
+        for (int i = 0; i < RAY_PACKET; ++i)
+        {
+            int column = std::min(x + i, size - 1);
+            getRayDirection(basis, size, column, row, directions[i]);
+            starts[i] = start ? std::max(start[column], 0.0f) : 0.0f;
+        }
+
+        traceRayPacket(camera.shape, basis, directions, starts, cone,
+                       maxSteps, pixels);
+
+        int count = std::min(RAY_PACKET, size - x);
+        for (int i = 0; i < count; ++i)
+            out[x + i] = pixels[i];
+    }
+}
+
+// A finished or running pass
+struct RayBuffer
+{
+    RayCamera camera;
+    int level;
+
+    // Pixels across, 0 when there is no pass
+    int size;
+    std::vector<RayPixel> pixels;
+};
+
+////////////////////////////////////////////////////////////
+/// Splat the surfaces of a traced pass into a size x size view
+/// of camera, nearest first. depths gets the distance from the
+/// new camera to whatever lands on each pixel, RAY_MISS where
+/// nothing does. When colors has the RGBA pixels of buffer
+/// they are carried into pixels, the rest is left alone.
+////////////////////////////////////////////////////////////
+inline void reprojectRays(const RayBuffer& buffer,
+                          const std::vector<sf::Uint8>* colors,
+                          const RayCamera& camera, int size,
+                          std::vector<float>& depths,
+                          std::vector<sf::Uint8>* pixels)
+{
+    depths.assign(size * size, RAY_MISS);
+    if (buffer.size == 0 || buffer.camera.shape != camera.shape)
+        return;
+
+    RayBasis from = getRayBasis(buffer.camera);
+    RayBasis to = getRayBasis(camera);
+    double ratio = static_cast<double>(size) / buffer.size;
+
+    double direction[3];
+    for (int y = 0; y < buffer.size; ++y)
+    {
+        for (int x = 0; x < buffer.size; ++x)
+        {
+            const RayPixel& pixel = buffer.pixels[y * buffer.size + x];
+            if (pixel.depth < 0.0f)
+                continue;
+
+            getRayDirection(from, buffer.size, x, y, direction);
+
+            double point[3], forward = 0.0, right = 0.0, up = 0.0;
+            for (int c = 0; c < 3; ++c)
+            {
+                point[c] = from.origin[c] + direction[c] * pixel.depth -
+                           to.origin[c];
+                forward += point[c] * to.forward[c];
+                right += point[c] * to.right[c];
+                up += point[c] * to.up[c];
+            }
+
+            if (forward <= 0.0)
+                continue;
+
+            double depth = sqrt(point[0] * point[0] + point[1] * point[1] +
+                                point[2] * point[2]);
+
+            // Where the point lands, and how big its pixel has become
+            double u = (right / forward / RAY_FOV + 1.0) * 0.5 * size;
+            double v = (1.0 - up / forward / RAY_FOV) * 0.5 * size;
+            double footprint = ratio * pixel.depth / depth;
+            int splat = std::min(static_cast<int>(ceil(footprint + 0.5)), 16);
+
+            int left = static_cast<int>(floor(u - splat * 0.5));
+            int top = static_cast<int>(floor(v - splat * 0.5));
+            for (int j = std::max(top, 0); j < std::min(top + splat, size);
+                  ++j)
+            {
+                for (int i = std::max(left, 0);
+                      i < std::min(left + splat, size); ++i)
+                {
+                    float& target = depths[j * size + i];
+                    if (target >= 0.0f && target <= depth)
+                        continue;
+
+                    target = static_cast<float>(depth);
+                    if (colors && pixels)
+                        for (int c = 0; c < 4; ++c)
+                            (*pixels)[(j * size + i) * 4 + c] =
+                                (*colors)[(y * buffer.size + x) * 4 + c];
+                }
+            }
+        }
+    }
+}
+
+////////////////////////////////////////////////////////////
+/// Background threads tracing one pass at a time, a row per
+/// work item. Finished rows can be shown before the pass is.
+////////////////////////////////////////////////////////////
+class RayEngine : sf::NonCopyable
+{
+public :
+
+    RayEngine() :
+    m_nextRow(0),
+    m_doneRows(0),
+    m_cancelled(false),
+    m_time(0)
+    {
+        m_buffer.size = 0;
+    }
+
+    ~RayEngine()
+    {
+        stop();
+    }
+
+    // Trace camera at a quality level, hints are empty or hold a
+    // distance for every pixel to start at
+    void start(const RayCamera& camera, int level, int size,
+               const std::vector<float>& hints)
+    {
+        stop();
+
+        m_buffer.camera = camera;
+        m_buffer.level = level;
+        m_buffer.size = size;
+        m_buffer.pixels.resize(size * size);
+        m_hints = hints;
+
+        m_nextRow = 0;
+        m_doneRows = 0;
+        m_finishedRows.clear();
+        m_cancelled = false;
+        m_clock.restart();
+
+        unsigned int count = std::min<unsigned int>(getCoreCount(), size);
+        for (unsigned int i = 0; i < count; ++i)
+        {
+            sf::Thread* thread = new sf::Thread(&RayEngine::work, this);
+            m_threads.push_back(thread);
+            thread->launch();
+        }
+    }
+
+    // Drop the pass, rows being traced are finished first
+    void stop()
+    {
+        {
+            sf::Lock lock(m_mutex);
+            m_cancelled = true;
+        }
+
+        wait();
+        m_buffer.size = 0;
+    }
+
+    // Whether a pass was started and not taken or stopped since
+    bool hasPass() const
+    {
+        return m_buffer.size > 0;
+    }
+
+    bool isDone()
+    {
+        sf::Lock lock(m_mutex);
+        return m_buffer.size > 0 && m_doneRows == m_buffer.size;
+    }
+
+    // The pass being traced, only finished rows may be read
+    const RayBuffer& getBuffer() const
+    {
+        return m_buffer;
+    }
+
+    // Rows finished since the last call
+    void getFinishedRows(std::vector<int>& rows)
+    {
+        sf::Lock lock(m_mutex);
+        rows.swap(m_finishedRows);
+        m_finishedRows.clear();
+    }
+
+    // Milliseconds the last finished pass took
+    int getTime() const
+    {
+        return m_time;
+    }
+
+    // Hand a finished pass over, the engine is then free
+    void take(RayBuffer& buffer)
+    {
+        wait();
+
+        buffer.camera = m_buffer.camera;
+        buffer.level = m_buffer.level;
+        buffer.size = m_buffer.size;
+        buffer.pixels.swap(m_buffer.pixels);
+        m_buffer.size = 0;
+    }
+
+private :
+
+    void wait()
+    {
+        for (std::size_t i = 0; i < m_threads.size(); ++i)
+        {
+            m_threads[i]->wait();
+            delete m_threads[i];
+        }
+
+        m_threads.clear();
+    }
+
+    void work()
+    {
+        const RayQuality& quality = getRayQuality(m_buffer.level);
+        int size = m_buffer.size;
+
+        int row;
+        while (nextRow(row))
+        {
+            const float* start = m_hints.empty() ? NULL :
+                                                   &m_hints[row * size];
+
+            // Rows never overlap so the buffer needs no lock
+            traceRayRow(m_buffer.camera, size, row, quality.steps, start,
+                        &m_buffer.pixels[row * size]);
+
+            sf::Lock lock(m_mutex);
+            m_finishedRows.push_back(row);
+            if (++m_doneRows == size)
+                m_time = m_clock.getElapsedTime().asMilliseconds();
+        }
+    }
+
+    bool nextRow(int& row)
+    {
+        sf::Lock lock(m_mutex);
+        if (m_cancelled || m_nextRow >= m_buffer.size)
+            return false;
+
+        row = m_nextRow++;
+        return true;
+    }
+
+    sf::Mutex m_mutex;
+    RayBuffer m_buffer;
+    std::vector<float> m_hints;
+
+    int m_nextRow;
+    int m_doneRows;
+    std::vector<int> m_finishedRows;
+    bool m_cancelled;
+
+    sf::Clock m_clock;
+    int m_time;
+
+    std::vector<sf::Thread*> m_threads;
+};
+
+////////////////////////////////////////////////////////////
+// "Mandelbulb" CPU effect, shown in the right pane. The frame
+// is the orbit camera: yaw, pitch and distance to the origin.
+// While it moves every pass is started from the last one
+// reprojected into the new camera, which is shown until the
+// pass is done, and the passes get coarser or finer to stay
+// within RAY_FRAME_BUDGET. A still camera gets a full pass.
+////////////////////////////////////////////////////////////
+class Mandelbulb : public Effect
+{
+public :
+
+    Mandelbulb() :
+    Effect("bulb"),
+    m_shape(ShapeMandelbulb),
+    m_level(3),
+    m_paletteVersion(0),
+    m_orbiting(false)
+    {
+        m_panePosition = sf::Vector2f(PANE_SIZE, 0);
+        m_buffer.size = 0;
+
+        // Nothing shown yet
+        m_shownCamera.shape = -1;
+    }
+
+    ~Mandelbulb()
+    {
+        m_engine.stop();
+    }
+
+    bool onLoad()
+    {
+        if (!m_texture.create(PANE_SIZE, PANE_SIZE))
+            return false;
+
+        m_pixels.assign(PANE_SIZE * PANE_SIZE * 4, 0);
+        m_sprite.setTexture(m_texture, true);
+        m_sprite.setPosition(PANE_SIZE, 0);
+
+        m_status.setFont(getFont());
+        m_status.setCharacterSize(20);
+        m_status.setColor(sf::Color(80, 80, 80));
+        m_status.setPosition(970, 930);
+
+        return true;
+    }
+
+    // Switch fractal and put the camera where all of it shows
+    void setShape(int shape)
+    {
+        m_engine.stop();
+        m_buffer.size = 0;
+        m_shape = shape;
+
+        frame = sf::Vector3<double>(0.6, 0.4, getShapeRadius(shape) * 3.2);
+    }
+
+    int getShape()
+    {
+        return m_shape;
+    }
+
+    void onUpdate()
+    {
+        // Panning spins the camera
+        if (m_panning)
+        {
+            frame.x += m_panVelocity * cos(m_panAngle);
+            frame.y += m_panVelocity * sin(m_panAngle);
+        }
+
+        frame.y = std::min(std::max(frame.y, -1.55), 1.55);
+        frame.z = std::max(frame.z, 0.01);
+
+        m_palette.setCoefficients(m_coloring);
+        m_palette.setRange(RAY_COLOR_RANGE);
+        m_palette.bake();
+
+        RayCamera camera = getCamera();
+        bool redraw = camera != m_shownCamera ||
+                      m_paletteVersion != m_palette.getVersion();
+
+        if (m_engine.hasPass())
+        {
+            const RayBuffer& pass = m_engine.getBuffer();
+
+            if (m_engine.isDone())
+            {
+                if (pass.level > 0)
+                    adaptLevel(m_engine.getTime());
+
+                m_engine.take(m_buffer);
+                colorize(m_buffer, 0, m_buffer.size, m_bufferPixels);
+                redraw = true;
+            }
+            else if (pass.level == 0 && pass.camera != camera)
+            {
+                // Moving again, the still frame is of no use
+                m_engine.stop();
+            }
+            else if (pass.level == 0 && !redraw)
+            {
+                drawFinishedRows();
+            }
+        }
+
+        if (!m_engine.hasPass())
+        {
+            // Only reprojected frames get hints, a still frame is
+            // marched from the camera so it misses nothing
+            if (m_buffer.size == 0 || m_buffer.camera != camera)
+            {
+                int size = PANE_SIZE / getRayQuality(m_level).scale;
+                reprojectRays(m_buffer, NULL, camera, size, m_hints, NULL);
+                m_engine.start(camera, m_level, size, m_hints);
+            }
+            else if (m_buffer.level > 0)
+            {
+                m_hints.clear();
+                m_engine.start(camera, 0, PANE_SIZE, m_hints);
+            }
+        }
+
+        if (redraw)
+            drawBuffer(camera);
+
+        // Quality of what is shown, or of the first pass
+        const RayQuality& quality =
+            getRayQuality(m_buffer.size > 0 ? m_buffer.level : m_level);
+
+        char temp[128];
+        sprintf(temp, "%s: %d steps at 1/%d, %d ms", getShapeName(m_shape),
+                quality.steps, quality.scale, m_engine.getTime());
+        m_status.setString(temp);
+
+        // Are we currently interacting with this fractal
+        m_interacting = m_panning || m_zooming || m_orbiting;
+    }
+
+    void onDraw(sf::RenderTarget& target, sf::RenderStates states) const
+    {
+        target.draw(m_sprite, states);
+        target.draw(m_status, states);
+    }
+
+    // The full pass of the current camera is shown
+    bool isComplete()
+    {
+        return m_buffer.size > 0 && m_buffer.level == 0 &&
+               m_buffer.camera == m_shownCamera &&
+               m_shownCamera == getCamera();
+    }
+
+    // Stop tracing while the pane is hidden
+    void pause()
+    {
+        m_engine.stop();
+    }
+
+    // Mouse button events, the left button orbits
+    void onMouseButtonPress(sf::Event event)
+    {
+        if (event.mouseButton.button == sf::Mouse::Left)
+        {
+            m_orbitStart = sf::Vector2f(event.mouseButton.x,
+                                        event.mouseButton.y);
+            m_orbitFrame = frame;
+            m_orbiting = true;
+        }
+        else if (event.mouseButton.button == sf::Mouse::Middle)
+        {
+            Effect::onMouseButtonPress(event);
+        }
+    }
+
+    void onMouseMove(sf::Event event)
+    {
+        if (m_orbiting)
+        {
+            frame.x = m_orbitFrame.x - (event.mouseMove.x - m_orbitStart.x) *
+                                       RAY_ORBIT_SPEED;
+            frame.y = m_orbitFrame.y + (event.mouseMove.y - m_orbitStart.y) *
+                                       RAY_ORBIT_SPEED;
+        }
+        else
+        {
+            Effect::onMouseMove(event);
+        }
+    }
+
+    void onMouseButtonRelease(sf::Event event)
+    {
+        if (event.mouseButton.button == sf::Mouse::Left)
+        {
+            m_orbiting = false;
+        }
+        else if (event.mouseButton.button == sf::Mouse::Middle)
+        {
+            m_panning = false;
+            m_panVelocity = 0.0;
+        }
+    }
+
+private :
+
+    RayCamera getCamera()
+    {
+        RayCamera camera;
+        camera.shape = m_shape;
+        camera.yaw = frame.x;
+        camera.pitch = frame.y;
+        camera.distance = frame.z;
+        return camera;
+    }
+
+    // Coarser passes when the last one ran over the budget, finer ones
+    // when it had plenty to spare
+    void adaptLevel(int time)
+    {
+        if (time > RAY_FRAME_BUDGET && m_level < RAY_LEVELS - 1)
+            ++m_level;
+        else if (time < RAY_FRAME_BUDGET / 3 && m_level > 1)
+            --m_level;
+    }
+
+    // RGBA of rows first to last of a pass
+    void colorize(const RayBuffer& buffer, int first, int last,
+                  std::vector<sf::Uint8>& pixels)
+    {
+        pixels.resize(buffer.size * buffer.size * 4);
+
+        IterationSample sample;
+        sample.iterations = 0.0f;
+        sample.distance = 0.0f;
+        sample.atom = 0.0f;
+        sample.period = 0.0f;
+        sample.stripe = 0.0f;
+        sample.trapPoint = 0.0f;
+        sample.trapLine = 0.0f;
+        sample.trapCross = 0.0f;
+
+        for (int y = first; y < last; ++y)
+        {
+            for (int x = 0; x < buffer.size; ++x)
+            {
+                const RayPixel& ray = buffer.pixels[y * buffer.size + x];
+                sf::Uint8* pixel = &pixels[(y * buffer.size + x) * 4];
+
+                sf::Color color = sf::Color(16, 16, 16);
+                if (ray.depth >= 0.0f)
+                {
+                    sample.color = 1.0f + ray.color * RAY_COLOR_RANGE * 0.5f;
+                    color = m_palette.lookup(sample, 0.0, false);
+                }
+
+                float shade = ray.depth >= 0.0f ? ray.shade : 1.0f;
+                pixel[0] = static_cast<sf::Uint8>(color.r * shade);
+                pixel[1] = static_cast<sf::Uint8>(color.g * shade);
+                pixel[2] = static_cast<sf::Uint8>(color.b * shade);
+                pixel[3] = 255;
+            }
+        }
+    }
+
+    // Show the last pass, scaled up if it was a coarse one or
+    // reprojected if the camera has moved since
+    void drawBuffer(const RayCamera& camera)
+    {
+        if (m_paletteVersion != m_palette.getVersion())
+        {
+            colorize(m_buffer, 0, m_buffer.size, m_bufferPixels);
+            m_paletteVersion = m_palette.getVersion();
+        }
+
+        if (m_buffer.size == 0)
+        {
+            for (std::size_t i = 0; i < m_pixels.size(); i += 4)
+            {
+                m_pixels[i] = m_pixels[i + 1] = m_pixels[i + 2] = 16;
+                m_pixels[i + 3] = 255;
+            }
+        }
+        else if (m_buffer.camera == camera)
+        {
+            blitRows(m_buffer, m_bufferPixels, 0, m_buffer.size);
+        }
+        else
+        {
+            for (std::size_t i = 0; i < m_pixels.size(); i += 4)
+            {
+                m_pixels[i] = m_pixels[i + 1] = m_pixels[i + 2] = 16;
+                m_pixels[i + 3] = 255;
+            }
+
+            reprojectRays(m_buffer, &m_bufferPixels, camera, PANE_SIZE,
+                          m_screenDepths, &m_pixels);
+        }
+
+        m_texture.update(&m_pixels[0]);
+        m_shownCamera = camera;
+    }
+
+    // Stream in the rows of the still frame as they finish
+    void drawFinishedRows()
+    {
+        m_engine.getFinishedRows(m_rows);
+        if (m_rows.empty())
+            return;
+
+        const RayBuffer& pass = m_engine.getBuffer();
+        for (std::size_t i = 0; i < m_rows.size(); ++i)
+        {
+            colorize(pass, m_rows[i], m_rows[i] + 1, m_passPixels);
+            blitRows(pass, m_passPixels, m_rows[i], m_rows[i] + 1);
+        }
+
+        m_texture.update(&m_pixels[0]);
+    }
+
+    // Scale rows first to last of a pass up to the pane
+    void blitRows(const RayBuffer& buffer,
+                  const std::vector<sf::Uint8>& colors, int first, int last)
+    {
+        int scale = PANE_SIZE / buffer.size;
+        for (int y = first * scale; y < last * scale; ++y)
+        {
+            for (int x = 0; x < PANE_SIZE; ++x)
+            {
+                const sf::Uint8* source =
+                    &colors[((y / scale) * buffer.size + x / scale) * 4];
+                std::copy(source, source + 4,
+                          &m_pixels[(y * PANE_SIZE + x) * 4]);
+            }
+        }
+    }
+
+    int m_shape;
+
+    RayEngine m_engine;
+    RayBuffer m_buffer;
+    std::vector<sf::Uint8> m_bufferPixels;
+    std::vector<float> m_hints;
+    int m_level;
+
+    // What the pane shows
+    RayCamera m_shownCamera;
+    unsigned int m_paletteVersion;
+    std::vector<float> m_screenDepths;
+    std::vector<int> m_rows;
+    std::vector<sf::Uint8> m_passPixels;
+
+    bool m_orbiting;
+    sf::Vector2f m_orbitStart;
+    sf::Vector3<double> m_orbitFrame;
+
+    std::vector<sf::Uint8> m_pixels;
+    sf::Texture m_texture;
+    sf::Sprite m_sprite;
+    sf::Text m_status;
+};
+
+#endif // MANDELBULB_HPP
@@ -8,6 +8,12 @@ public :
     Mandlebrot() :
     Effect("mandlebrot")
     {
+        for (int i = 0; i < INTERIOR_COMPONENTS; ++i)
+        {
+            char name[32];
+            sprintf(name, "Components[%d]", i);
+            m_componentNames[i] = name;
+        }
     }
 
     bool onLoad()
@@ -36,40 +42,10 @@ public :
             frame.y += m_panVelocity * sin(m_panAngle);
         }
 
-        // Calculate the max iterations
-        float maxItValue=70.0;
-        if (m_iterationsScaing)
-            maxItValue = sqrt(2.*sqrt(fabs(1.-sqrt(5./frame.z))))*66.5;
-
-        // Enable the correct shader
-        if (m_emulated)
-            m_shader = &m_emulated_shader;
-        else
-            m_shader = &m_normal_shader;
-
-        // Update the shader parameters
-        m_shader->setParameter("MaxIterations", maxItValue);
-        m_shader->setParameter("LogShading", m_logShading);
-        m_shader->setParameter("Zoom", frame.z);
-        m_shader->setParameter("Almond", m_almond);
-
-        m_shader->setParameter("Julia", false);
-
-        m_shader->setParameter("R", m_coloring.x);
-        m_shader->setParameter("G", m_coloring.y);
-        m_shader->setParameter("B", m_coloring.z);
-
-        // Create a rectangle to draw on the screen
-        sf::Vector2u renderTargetSize(960,960);
-        const sf::Vector2f windowSize(
-            static_cast<unsigned int>(renderTargetSize.x),
-             static_cast<unsigned int>(renderTargetSize.y));
-        
-        m_screenRect.setPosition(0, 0);
-        m_screenRect.setSize(windowSize);
-
-        m_shader->setParameter("Xcenter", frame.x);
-        m_shader->setParameter("Ycenter", frame.y);
+        // Both shaders can be on screen at once, each on its own tiles
+        updateShader(m_normal_shader);
+        updateShader(m_emulated_shader);
+        updateTiles();
 
         // Are we currently interacting with this fractal
         m_interacting = m_panning || m_zooming;
@@ -77,8 +53,7 @@ public :
 
     void onDraw(sf::RenderTarget& target, sf::RenderStates states) const
     {
-        states.shader = m_shader;
-        target.draw(m_screenRect, states);
+        drawTiles(target, states, &m_normal_shader, &m_emulated_shader);
 
         if (m_zooming)
         {
@@ -91,10 +66,13 @@ public :
         if (event.mouseButton.button == sf::Mouse::Right)
         {
             m_zooming = false;
-            sf::Vector2f position = m_zoomBox.getPosition();
+            sf::Vector2f position = m_zoomBox.getPosition() -
+                                        m_panePosition;
 
-            float mouseX = fmin(event.mouseButton.x,960.0);
-            float mouseY = fmin(event.mouseButton.y,960.0);
+            float mouseX = fmin(event.mouseButton.x - m_panePosition.x,
+                                PANE_SIZE);
+            float mouseY = fmin(event.mouseButton.y - m_panePosition.y,
+                                PANE_SIZE);
             float newSize = fmax(mouseX-position.x, mouseY-position.y);
 
             setFrame(getFrame(position.x, position.y, newSize));
@@ -107,9 +85,67 @@ public :
     }
 
 private:
-    sf::Shader * m_shader;
+
+    void updateShader(sf::Shader& shader)
+    {
+        // Calculate the max iterations
+        float maxItValue = getMaxIterations();
+
+        // Update the shader parameters
+        shader.setParameter(Uniform::MaxIterations, maxItValue);
+        shader.setParameter(Uniform::LogShading, m_logShading);
+        shader.setParameter(Uniform::Zoom, static_cast<float>(frame.z));
+        shader.setParameter(Uniform::Almond, m_almond);
+        shader.setParameter(Uniform::DistanceEstimation,
+                            m_distanceEstimation);
+
+        shader.setParameter(Uniform::Julia, false);
+
+        updatePalette(shader);
+        updateComponents(shader);
+
+        updateCenter(shader);
+
+        updatePane(shader);
+    }
+
+    sf::Shader* getShader(bool emulated)
+    {
+        return emulated ? &m_emulated_shader : &m_normal_shader;
+    }
+
+    // Hand the component disks around the view to the shader
+    void updateComponents(sf::Shader& shader)
+    {
+        int count = 0;
+        if (m_interiorDetection)
+        {
+            const std::vector<Component>& components =
+                m_interior.analyze(getKernelParams());
+
+            for (std::size_t i = 0; i < components.size(); ++i)
+            {
+                const Component& component = components[i];
+
+                // Float uniforms only place the nucleus to about 1e-7,
+                // smaller disks are left to the periodicity check
+                double scale = fabs(component.real) + fabs(component.imag);
+                if (component.radius < 1e-6 * scale)
+                    continue;
+
+                shader.setParameter(m_componentNames[count++],
+                                    component.real, component.imag,
+                                    component.radius, component.period);
+            }
+        }
+
+        shader.setParameter(Uniform::ComponentCount,
+                            static_cast<float>(count));
+    }
+
     sf::Shader m_emulated_shader;
     sf::Shader m_normal_shader;
 
-    sf::RectangleShape m_screenRect;
+    InteriorAnalysis m_interior;
+    std::string m_componentNames[INTERIOR_COMPONENTS];
 };
\ No newline at end of file
@@ -0,0 +1,89 @@
+#ifndef MEMORY_HPP
+#define MEMORY_HPP
+
+////////////////////////////////////////////////////////////
+// Headers
+////////////////////////////////////////////////////////////
+#include <SFML/Graphics.hpp>
+
+#include <string.h>
+
+////////////////////////////////////////////////////////////
+// Keeping the frame loop off the heap. Once nothing on screen
+// changes a frame should not allocate at all, scratch memory
+// lives in members and pools that keep their capacity.
+////////////////////////////////////////////////////////////
+
+////////////////////////////////////////////////////////////
+/// Heap allocations since start up. Debug builds replace the
+/// global operator new to count them (Shader.cpp), release
+/// builds always read 0.
+////////////////////////////////////////////////////////////
+class AllocationCounter
+{
+public :
+
+    static void add()
+    {
+#ifdef __GNUC__
+        __sync_fetch_and_add(&s_count, 1);
+#else
+        ++s_count;
+#endif
+    }
+
+    static unsigned long getCount()
+    {
+        return s_count;
+    }
+
+private :
+
+    // Bumped from every thread, so no sf::Mutex, it allocates itself
+    static volatile unsigned long s_count;
+};
+
+////////////////////////////////////////////////////////////
+/// A text that is only rebuilt when its string changes, for
+/// status lines printed every frame. sf::Text copies the string
+/// into a new sf::String and new vertices on every setString.
+////////////////////////////////////////////////////////////
+#define CACHED_TEXT_LENGTH 256
+
+class CachedText : public sf::Drawable
+{
+public :
+
+    CachedText()
+    {
+        m_string[0] = '\0';
+    }
+
+    // Longer strings are cut to CACHED_TEXT_LENGTH - 1 characters
+    void setString(const char* string)
+    {
+        if (strncmp(m_string, string, CACHED_TEXT_LENGTH - 1) == 0)
+            return;
+
+        strncpy(m_string, string, CACHED_TEXT_LENGTH - 1);
+        m_string[CACHED_TEXT_LENGTH - 1] = '\0';
+        m_text.setString(m_string);
+    }
+
+    sf::Text& getText()
+    {
+        return m_text;
+    }
+
+    void draw(sf::RenderTarget& target, sf::RenderStates states) const
+    {
+        target.draw(m_text, states);
+    }
+
+private :
+
+    char m_string[CACHED_TEXT_LENGTH];
+    sf::Text m_text;
+};
+
+#endif // MEMORY_HPP
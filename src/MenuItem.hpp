@@ -7,8 +7,10 @@ class Checkbox : public sf::Drawable
 {
 public :
     
-    Checkbox(sf::Sprite* box, sf::Sprite* check,
-              sf::Text * text, std::string name)
+    // The sprites and text are copied, they only share the textures
+    // and the font
+    Checkbox(const sf::Sprite& box, const sf::Sprite& check,
+              const sf::Text& text, std::string name)
     {
         m_box = box;
         m_check = check;
@@ -17,8 +19,7 @@ public :
 
         m_checked = true;
 
-        x = 0;
-        y = 980;
+        setPosition(0, 980);
     }
 
     std::string getName()
@@ -28,14 +29,11 @@ public :
 
     void draw(sf::RenderTarget& target, sf::RenderStates states) const
     {
-        m_box->setPosition(x,y);
-        target.draw(*m_box);
-        m_text->setPosition(x+30,y);
-        target.draw(*m_text);
+        target.draw(m_box);
+        target.draw(m_text);
         if (m_checked)
         {
-            m_check->setPosition(x-2,y);
-            target.draw(*m_check);
+            target.draw(m_check);
         }
     }
 
@@ -43,6 +41,10 @@ public :
     {
         x = _x;
         y = _y;
+
+        m_box.setPosition(x,y);
+        m_text.setPosition(x+30,y);
+        m_check.setPosition(x-2,y);
     }
 
     void onMousePress(int _x, int _y)
@@ -64,9 +66,9 @@ public :
     int x, y;
 
 private :
-    sf::Sprite* m_box;
-    sf::Sprite* m_check;
-    sf::Text* m_text;
+    sf::Sprite m_box;
+    sf::Sprite m_check;
+    sf::Text m_text;
 
     std::string m_name;
 
@@ -77,7 +79,8 @@ class Slider : public sf::Drawable
 {
 public :
     
-    Slider(sf::Sprite* button, int length, std::string name)
+    // The button is copied, it only shares the texture
+    Slider(const sf::Sprite& button, int length, std::string name)
     {
         m_button = button;
         m_length = length;        
@@ -94,6 +97,7 @@ public :
         m_bar.setOutlineColor(sf::Color(93, 93, 93));
         m_bar.setOutlineThickness(0.5);
         m_bar.setPosition(m_x,m_y);
+        placeButton();
     }
 
     std::string getName()
@@ -104,10 +108,7 @@ public :
     void draw(sf::RenderTarget& target, sf::RenderStates states) const
     {
         target.draw(m_bar);
-
-        m_button->setPosition(m_x + m_length * m_value - 8, m_y - 8);
-        m_button->setColor(m_color);
-        target.draw(*m_button);
+        target.draw(m_button);
     }
 
     void setPosition(int _x, int _y)
@@ -115,6 +116,7 @@ public :
         m_x = _x;
         m_y = _y;
         m_bar.setPosition(m_x,m_y);
+        placeButton();
     }
 
     void onMousePress(int _x, int _y)
@@ -131,6 +133,7 @@ public :
         if (m_dragging)
         {
             m_value = fmax(fmin((_x - m_x)/((float)m_length), 1.0f), 0.0f);
+            placeButton();
         }
     }
 
@@ -147,6 +150,7 @@ public :
     void setValue(float value)
     {
         m_value = value;
+        placeButton();
     }
 
     float getValue()
@@ -156,13 +160,18 @@ public :
 
     void setColor(sf::Color color)
     {
-        m_color = color;
+        m_button.setColor(color);
     }
 
 private :
-    sf::Sprite* m_button;
+
+    void placeButton()
+    {
+        m_button.setPosition(m_x + m_length * m_value - 8, m_y - 8);
+    }
+
+    sf::Sprite m_button;
     sf::RectangleShape m_bar;
-    sf::Color m_color;
 
     std::string m_name;
 
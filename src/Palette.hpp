@@ -0,0 +1,366 @@
+#ifndef PALETTE_HPP
+#define PALETTE_HPP
+
+////////////////////////////////////////////////////////////
+// Headers
+////////////////////////////////////////////////////////////
+#include "Kernel.hpp"
+
+#include <SFML/Graphics.hpp>
+
+#include <vector>
+#include <algorithm>
+#include <cmath>
+
+////////////////////////////////////////////////////////////
+// Color lookup tables, baked once per frame and sampled once
+// per pixel by the shaders and the CPU paths
+////////////////////////////////////////////////////////////
+
+// Number of entries in the lookup table
+#define PALETTE_SIZE 4096
+
+// Number of bins used for the histogram equalization
+#define PALETTE_BINS 1024
+
+// Trap distances from 1 down to 10^-TRAP_DECADES span the table
+#define TRAP_DECADES 4.0
+
+enum PalettePreset
+{
+    PaletteCosine,   // The original R/G/B coefficient coloring
+    PaletteFire,
+    PaletteOcean,
+    PaletteElectric,
+    PaletteGrey,
+
+    PalettePresetCount
+};
+
+// What the color of a pixel is based on
+enum ColorMode
+{
+    ColorEscape,     // Escape time, interior points are black
+    ColorAtomDomain, // Atom domain period of every point
+    ColorPeriod,     // Escape time with interior points by cycle period
+
+    // Need the trap kernel, see OrbitTraps
+    ColorStripes,    // Stripe average, interior points are black
+    ColorTrapPoint,  // Closest the orbit comes to the origin
+    ColorTrapLine,   // Closest the orbit comes to the real axis
+    ColorTrapCross,  // Closest the orbit comes to either axis
+
+    ColorModeCount
+};
+
+// One color stop of a gradient preset
+struct PaletteStop
+{
+    float position;
+    float r, g, b;
+};
+
+class Palette
+{
+public :
+
+    Palette() :
+    m_preset(PaletteCosine),
+    m_equalize(false),
+    m_colorMode(ColorEscape),
+    m_range(1.0f),
+    m_dirty(true),
+    m_created(false),
+    m_version(0)
+    {
+        m_lut.resize(PALETTE_SIZE * 4);
+    }
+
+    // Has to be called once there is a GL context
+    bool create()
+    {
+        if (!m_texture.create(PALETTE_SIZE, 1))
+            return false;
+
+        m_texture.setSmooth(true);
+        m_created = true;
+        m_dirty = true;
+        return true;
+    }
+
+    static const char* getPresetName(int preset)
+    {
+        static const char* names[PalettePresetCount] =
+            {"Cosine", "Fire", "Ocean", "Electric", "Grey"};
+
+        return names[preset];
+    }
+
+    void setPreset(int preset)
+    {
+        m_dirty |= preset != m_preset;
+        m_preset = preset;
+    }
+
+    int getPreset() const
+    {
+        return m_preset;
+    }
+
+    void setCoefficients(sf::Vector3f coeff)
+    {
+        m_dirty |= coeff != m_coefficients;
+        m_coefficients = coeff;
+    }
+
+    void setEqualize(bool equalize)
+    {
+        m_dirty |= equalize != m_equalize;
+        m_equalize = equalize;
+    }
+
+    bool getEqualize() const
+    {
+        return m_equalize;
+    }
+
+    static const char* getColorModeName(int mode)
+    {
+        static const char* names[ColorModeCount] =
+            {"Escape Time", "Atom Domains", "Interior Period", "Stripes",
+             "Point Trap", "Line Trap", "Cross Trap"};
+
+        return names[mode];
+    }
+
+    // The table is the same for every mode, it is rebuilt anyway so
+    // the version changes and shown maps get recolored
+    void setColorMode(int mode)
+    {
+        m_dirty |= mode != m_colorMode;
+        m_colorMode = mode;
+    }
+
+    int getColorMode() const
+    {
+        return m_colorMode;
+    }
+
+    // Color values from 0 to range map onto the whole table
+    void setRange(float range)
+    {
+        m_dirty |= range != m_range;
+        m_range = range;
+    }
+
+    float getRange() const
+    {
+        return m_range;
+    }
+
+    ////////////////////////////////////////////////////////////
+    /// Build the equalization histogram from the color values of
+    /// a coarse render of the view, inside points are skipped
+    ////////////////////////////////////////////////////////////
+    void setHistogram(const IterationSample* samples, int count)
+    {
+        m_cdf.assign(PALETTE_BINS, 0.0f);
+
+        int total = 0;
+        for (int i = 0; i < count; ++i)
+        {
+            if (samples[i].color <= 0.0f)
+                continue;
+
+            int bin = static_cast<int>(samples[i].color / m_range *
+                                        PALETTE_BINS);
+            m_cdf[std::max(0, std::min(bin, PALETTE_BINS - 1))] += 1.0f;
+            ++total;
+        }
+
+        // Turn the histogram into a cumulative distribution
+        float sum = 0.0f;
+        for (int i = 0; i < PALETTE_BINS; ++i)
+        {
+            sum += m_cdf[i];
+            m_cdf[i] = total > 0 ? sum / total : (i + 1.0f) / PALETTE_BINS;
+        }
+
+        m_dirty = true;
+    }
+
+    // Rebuild the table and upload it, does nothing if nothing changed
+    void bake()
+    {
+        if (!m_dirty)
+            return;
+
+        for (int i = 0; i < PALETTE_SIZE; ++i)
+        {
+            float t = i / (PALETTE_SIZE - 1.0f);
+
+            if (m_equalize && !m_cdf.empty())
+                t = m_cdf[std::min(static_cast<int>(t * PALETTE_BINS),
+                                   PALETTE_BINS - 1)];
+
+            float rgb[3];
+            evaluate(t, rgb);
+
+            for (int c = 0; c < 3; ++c)
+                m_lut[i * 4 + c] = static_cast<sf::Uint8>(
+                    fmin(fmax(rgb[c], 0.0f), 1.0f) * 255.0f);
+            m_lut[i * 4 + 3] = 255;
+        }
+
+        // Headless users only need lookup()
+        if (m_created)
+            m_texture.update(&m_lut[0]);
+
+        m_dirty = false;
+        ++m_version;
+    }
+
+    // Changes every time the table is rebuilt
+    unsigned int getVersion() const
+    {
+        return m_version;
+    }
+
+    const sf::Texture& getTexture() const
+    {
+        return m_texture;
+    }
+
+    ////////////////////////////////////////////////////////////
+    /// Color a CPU sample the same way the shaders do, spacing is
+    /// the pixel size used for the distance estimate shading
+    ////////////////////////////////////////////////////////////
+    sf::Color lookup(const IterationSample& sample, double spacing,
+                     bool distanceShading) const
+    {
+        float shade = 1.0f;
+        if (distanceShading && sample.color > 0.0f)
+            shade = fmin(fmax(pow(sample.distance / spacing, 0.25), 0.0), 1.0);
+
+        const sf::Uint8* entry;
+        if (m_colorMode == ColorAtomDomain)
+        {
+            entry = getPeriodEntry(sample.atom);
+        }
+        else if (m_colorMode == ColorStripes)
+        {
+            if (sample.color <= 0.0f)
+                return sf::Color::Black;
+
+            entry = getEntry(sample.stripe);
+        }
+        else if (m_colorMode >= ColorTrapPoint)
+        {
+            // Inside points have orbits too
+            float distance = m_colorMode == ColorTrapPoint ? sample.trapPoint :
+                             m_colorMode == ColorTrapLine ? sample.trapLine :
+                                                            sample.trapCross;
+            entry = getEntry(-log10(fmax(distance, 1e-30f)) / TRAP_DECADES);
+        }
+        else if (m_colorMode == ColorPeriod && sample.color <= 0.0f &&
+                  sample.period > 0.0f)
+        {
+            entry = getPeriodEntry(sample.period);
+        }
+        else
+        {
+            // Black if we dont escape
+            if (sample.color <= 0.0f)
+                return sf::Color::Black;
+
+            entry = getEntry(sample.color / m_range);
+        }
+
+        return sf::Color(entry[0] * shade, entry[1] * shade,
+                         entry[2] * shade);
+    }
+
+private :
+
+    // Entry at t in [0, 1], clamped
+    const sf::Uint8* getEntry(float t) const
+    {
+        t = fmin(fmax(t, 0.0f), 1.0f);
+        return &m_lut[static_cast<int>(t * (PALETTE_SIZE - 1)) * 4];
+    }
+
+    // Periods are spread around the table by the golden ratio, the
+    // same as periodColor() in the shaders
+    const sf::Uint8* getPeriodEntry(float period) const
+    {
+        float t = period * 0.618034f;
+        t -= floor(t);
+        return &m_lut[static_cast<int>(t * (PALETTE_SIZE - 1)) * 4];
+    }
+
+    // Color at t in [0, 1] before equalization
+    void evaluate(float t, float* rgb) const
+    {
+        if (m_preset == PaletteCosine)
+        {
+            // Same as the old shader, note the green channel uses B
+            float color = t * m_range;
+            rgb[0] = (-cos(m_coefficients.x * 0.25 * color) + 1.0) / 2.0;
+            rgb[1] = (-cos(m_coefficients.z * 0.25 * color) + 1.0) / 2.0;
+            rgb[2] = (-cos(m_coefficients.y * 0.25 * color) + 1.0) / 2.0;
+            return;
+        }
+
+        static const PaletteStop fire[] = {
+            {0.0f, 0.0f, 0.0f, 0.0f}, {0.3f, 0.7f, 0.0f, 0.0f},
+            {0.6f, 1.0f, 0.6f, 0.0f}, {1.0f, 1.0f, 1.0f, 0.8f}};
+        static const PaletteStop ocean[] = {
+            {0.0f, 0.0f, 0.02f, 0.1f}, {0.4f, 0.0f, 0.3f, 0.6f},
+            {0.7f, 0.2f, 0.8f, 0.9f}, {1.0f, 1.0f, 1.0f, 1.0f}};
+        static const PaletteStop electric[] = {
+            {0.0f, 0.05f, 0.0f, 0.15f}, {0.25f, 0.5f, 0.0f, 0.8f},
+            {0.5f, 0.0f, 0.8f, 1.0f}, {0.75f, 1.0f, 1.0f, 0.3f},
+            {1.0f, 1.0f, 1.0f, 1.0f}};
+        static const PaletteStop grey[] = {
+            {0.0f, 0.0f, 0.0f, 0.0f}, {1.0f, 1.0f, 1.0f, 1.0f}};
+
+        const PaletteStop* stops = grey;
+        int count = 2;
+        switch (m_preset)
+        {
+            case PaletteFire:     stops = fire;     count = 4; break;
+            case PaletteOcean:    stops = ocean;    count = 4; break;
+            case PaletteElectric: stops = electric; count = 5; break;
+            default: break;
+        }
+
+        // Linear interpolation between the two stops around t
+        int i = 1;
+        while (i < count - 1 && stops[i].position < t)
+            ++i;
+
+        const PaletteStop& a = stops[i - 1];
+        const PaletteStop& b = stops[i];
+        float f = fmin(fmax((t - a.position) / (b.position - a.position),
+                            0.0f), 1.0f);
+
+        rgb[0] = a.r + (b.r - a.r) * f;
+        rgb[1] = a.g + (b.g - a.g) * f;
+        rgb[2] = a.b + (b.b - a.b) * f;
+    }
+
+    int m_preset;
+    sf::Vector3f m_coefficients;
+    bool m_equalize;
+    int m_colorMode;
+    float m_range;
+    bool m_dirty;
+    bool m_created;
+    unsigned int m_version;
+
+    std::vector<float> m_cdf;
+    std::vector<sf::Uint8> m_lut;
+    sf::Texture m_texture;
+};
+
+#endif // PALETTE_HPP
@@ -0,0 +1,261 @@
+#ifndef PNGWRITER_HPP
+#define PNGWRITER_HPP
+
+////////////////////////////////////////////////////////////
+// Headers
+////////////////////////////////////////////////////////////
+#include <SFML/System.hpp>
+
+#include <zlib.h>
+
+#include <vector>
+#include <string>
+#include <stdio.h>
+
+////////////////////////////////////////////////////////////
+// PNG encoder that takes the image a few rows at a time, for
+// images too big to hold at once. sf::Image wants every pixel
+// up front, this only keeps the deflate state and one chunk.
+// It writes to a file, or with begin() into memory for the
+// caller to take the bytes and write them where it wants.
+////////////////////////////////////////////////////////////
+
+// Compressed bytes collected before an IDAT chunk is written
+#define PNG_CHUNK_SIZE 65536
+
+class PngWriter
+{
+public :
+
+    PngWriter() :
+    m_file(NULL),
+    m_started(false),
+    m_width(0),
+    m_rowsLeft(0),
+    m_filter(true)
+    {
+    }
+
+    ~PngWriter()
+    {
+        if (m_started)
+            deflateEnd(&m_stream);
+        if (m_file)
+            fclose(m_file);
+    }
+
+    ////////////////////////////////////////////////////////////
+    /// Start an 8 bit RGBA image, rows are then written top to
+    /// bottom. level is the zlib one, 0 stores the rows as they
+    /// are, which is the fastest there is to write and read.
+    ////////////////////////////////////////////////////////////
+    bool open(const std::string& path, int width, int height,
+              int level = Z_DEFAULT_COMPRESSION)
+    {
+        m_file = fopen(path.c_str(), "wb");
+        if (!m_file)
+            return false;
+
+        if (!begin(width, height, level) || !flushOutput())
+        {
+            fclose(m_file);
+            m_file = NULL;
+            return false;
+        }
+
+        return true;
+    }
+
+    // Same as open, the file goes to memory until taken
+    bool begin(int width, int height, int level = Z_DEFAULT_COMPRESSION)
+    {
+        m_width = width;
+        m_rowsLeft = height;
+        m_row.resize(width * 4 + 1);
+        m_previous.clear();
+        m_chunk.resize(PNG_CHUNK_SIZE);
+        m_output.clear();
+
+        // Filtering only helps deflate find matches
+        m_filter = level != Z_NO_COMPRESSION;
+
+        m_stream.zalloc = Z_NULL;
+        m_stream.zfree = Z_NULL;
+        m_stream.opaque = Z_NULL;
+        m_started = deflateInit(&m_stream, level) == Z_OK;
+        if (!m_started)
+            return false;
+
+        m_stream.next_out = &m_chunk[0];
+        m_stream.avail_out = PNG_CHUNK_SIZE;
+
+        static const unsigned char signature[8] =
+            {0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n'};
+        m_output.insert(m_output.end(), signature, signature + 8);
+
+        // Width, height, 8 bits, RGBA, deflate, adaptive filters, no
+        // interlacing
+        unsigned char header[13];
+        putInt(header, width);
+        putInt(header + 4, height);
+        header[8] = 8;
+        header[9] = 6;
+        header[10] = header[11] = header[12] = 0;
+        writeChunk("IHDR", header, 13);
+
+        return true;
+    }
+
+    ////////////////////////////////////////////////////////////
+    /// Append count rows of RGBA pixels. Each row is stored with
+    /// the up filter, which is what makes smooth fractal colors
+    /// compress.
+    ////////////////////////////////////////////////////////////
+    bool write(const sf::Uint8* pixels, int count)
+    {
+        if (!m_started || count > m_rowsLeft)
+            return false;
+
+        std::size_t stride = m_width * 4;
+        for (int y = 0; y < count; ++y)
+        {
+            const sf::Uint8* row = pixels + y * stride;
+
+            m_row[0] = m_filter ? 2 : 0;
+            for (std::size_t i = 0; i < stride; ++i)
+                m_row[i + 1] = row[i] - (m_previous.empty() ? 0 :
+                                                              m_previous[i]);
+
+            if (m_filter)
+                m_previous.assign(row, row + stride);
+            if (!deflateRow(Z_NO_FLUSH))
+                return false;
+        }
+
+        m_rowsLeft -= count;
+        return flushOutput();
+    }
+
+    // Finish the file, false if any of it could not be written
+    bool close()
+    {
+        if (!m_started)
+            return false;
+
+        bool ok = m_rowsLeft == 0 && deflateRow(Z_FINISH);
+        if (ok)
+        {
+            flushChunk();
+            writeChunk("IEND", NULL, 0);
+        }
+
+        deflateEnd(&m_stream);
+        m_started = false;
+        ok = flushOutput() && ok;
+
+        if (m_file)
+        {
+            ok = fclose(m_file) == 0 && ok;
+            m_file = NULL;
+        }
+
+        return ok;
+    }
+
+    // Bytes of the file made since the last call, without a file
+    void takeOutput(std::vector<unsigned char>& bytes)
+    {
+        bytes.clear();
+        bytes.swap(m_output);
+    }
+
+private :
+
+    // Compress m_row, or with Z_FINISH nothing and end the stream
+    bool deflateRow(int flush)
+    {
+        m_stream.next_in = flush == Z_FINISH ? Z_NULL : &m_row[0];
+        m_stream.avail_in = flush == Z_FINISH ? 0 : m_row.size();
+
+        while (true)
+        {
+            int result = deflate(&m_stream, flush);
+            if (result == Z_STREAM_ERROR)
+                return false;
+
+            if (m_stream.avail_out == 0)
+                flushChunk();
+            else if (flush == Z_FINISH ? result == Z_STREAM_END :
+                                         m_stream.avail_in == 0)
+                return true;
+        }
+    }
+
+    void flushChunk()
+    {
+        std::size_t size = PNG_CHUNK_SIZE - m_stream.avail_out;
+        if (size > 0)
+            writeChunk("IDAT", &m_chunk[0], size);
+
+        m_stream.next_out = &m_chunk[0];
+        m_stream.avail_out = PNG_CHUNK_SIZE;
+    }
+
+    void writeChunk(const char* type, const unsigned char* data,
+                    std::size_t size)
+    {
+        unsigned char length[4];
+        putInt(length, size);
+        m_output.insert(m_output.end(), length, length + 4);
+        m_output.insert(m_output.end(), type, type + 4);
+        if (size > 0)
+            m_output.insert(m_output.end(), data, data + size);
+
+        uLong crc = crc32(0L, reinterpret_cast<const Bytef*>(type), 4);
+        if (size > 0)
+            crc = crc32(crc, data, size);
+
+        unsigned char check[4];
+        putInt(check, crc);
+        m_output.insert(m_output.end(), check, check + 4);
+    }
+
+    // Write what was made to the file, if there is one
+    bool flushOutput()
+    {
+        if (!m_file || m_output.empty())
+            return true;
+
+        bool ok = fwrite(&m_output[0], 1, m_output.size(), m_file) ==
+                  m_output.size();
+        m_output.clear();
+
+        return ok;
+    }
+
+    // PNG integers are big endian
+    static void putInt(unsigned char* out, unsigned long value)
+    {
+        out[0] = (value >> 24) & 0xff;
+        out[1] = (value >> 16) & 0xff;
+        out[2] = (value >> 8) & 0xff;
+        out[3] = value & 0xff;
+    }
+
+    FILE* m_file;
+    z_stream m_stream;
+    bool m_started;
+    int m_width;
+    int m_rowsLeft;
+    bool m_filter;
+
+    // Filtered row with its filter byte, the row above it unfiltered
+    std::vector<unsigned char> m_row;
+    std::vector<sf::Uint8> m_previous;
+    std::vector<unsigned char> m_chunk;
+
+    // Finished chunks not written or taken yet
+    std::vector<unsigned char> m_output;
+};
+
+#endif // PNGWRITER_HPP
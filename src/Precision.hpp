@@ -0,0 +1,464 @@
+#ifndef PRECISION_HPP
+#define PRECISION_HPP
+
+////////////////////////////////////////////////////////////
+// Headers
+////////////////////////////////////////////////////////////
+#include "Kernel.hpp"
+#include "DoubleDouble.hpp"
+#include "FixedPoint.hpp"
+
+#include <vector>
+#include <algorithm>
+#include <cmath>
+
+////////////////////////////////////////////////////////////
+// Per tile choice of the number type. A tile gets the cheapest
+// type whose mantissa still tells its pixels apart, judged by
+// the pixel spacing against the size of the coordinates.
+////////////////////////////////////////////////////////////
+
+// Bits kept on top of what separates neighbouring pixels, rounding
+// errors grow with every iteration
+#define PRECISION_GUARD_BITS 8
+
+// Width of the tiles precision is chosen for on the GPU
+#define PRECISION_TILE 64
+
+// Orbits that come this close to 0 compared to the reference lose
+// the digits perturbation relies on (Pauldelbrot's criterion)
+#define PERTURBATION_GLITCH 1e-6
+
+enum Precision
+{
+    PrecisionFloat,
+    PrecisionDouble,
+    PrecisionDoubleDouble,
+    PrecisionPerturbation,
+
+    // CPU only, see FixedPoint.hpp
+    PrecisionFixedPoint,
+
+    PrecisionCount
+};
+
+inline const char* getPrecisionName(int precision)
+{
+    static const char* names[PrecisionCount] =
+        {"Float", "Double", "Double-Double", "Perturbation",
+         "Fixed Point"};
+
+    return names[precision];
+}
+
+////////////////////////////////////////////////////////////
+/// Cheapest precision for points of the given magnitude that
+/// are spacing apart. Past double the plain z^2 + c uses
+/// perturbation around a double-double reference, the almond
+/// bread is not a polynomial in c so it iterates every point in
+/// double-double instead.
+////////////////////////////////////////////////////////////
+inline int choosePrecision(double magnitude, double spacing, bool almond)
+{
+    // Orbits reach |z| = 2 whatever the coordinates are
+    double bits = log(std::max(magnitude, 1.0) / spacing) / log(2.0) +
+                  PRECISION_GUARD_BITS;
+
+    if (bits <= 24.0)
+        return PrecisionFloat;
+    if (bits <= 53.0)
+        return PrecisionDouble;
+
+    return almond ? PrecisionDoubleDouble : PrecisionPerturbation;
+}
+
+// Largest coordinate of a rectangle of the pane
+inline double getTileMagnitude(const KernelParams& params,
+                               int left, int top, int width, int height)
+{
+    double realMin = -params.x + pixelOffset(params, left);
+    double realMax = -params.x + pixelOffset(params, left + width - 1);
+    double imagMin = -params.y - pixelOffset(params, top + height - 1);
+    double imagMax = -params.y - pixelOffset(params, top);
+
+    return std::max(std::max(fabs(realMin), fabs(realMax)),
+                    std::max(fabs(imagMin), fabs(imagMax)));
+}
+
+// Cheapest precision for a rectangle of the pane
+inline int choosePrecision(const KernelParams& params,
+                           int left, int top, int width, int height)
+{
+    return choosePrecision(getTileMagnitude(params, left, top, width, height),
+                           pixelSpacing(params), params.almond);
+}
+
+// Whether the fixed point kernel can take a rectangle of the pane
+inline bool canUseFixedPoint(const KernelParams& params,
+                             int left, int top, int width, int height)
+{
+    double magnitude = getTileMagnitude(params, left, top, width, height);
+    if (magnitude > FIXED_MAX_COORDINATE)
+        return false;
+
+    if (params.julia && std::max(fabs(params.juliaA), fabs(params.juliaB)) >
+                        FIXED_MAX_COORDINATE)
+        return false;
+
+    double bits = log(std::max(magnitude, 1.0) / pixelSpacing(params)) /
+                  log(2.0) + PRECISION_GUARD_BITS;
+
+    return bits <= FIXED_FRACTION_BITS;
+}
+
+////////////////////////////////////////////////////////////
+/// Precision a CPU tile is rendered in. For the plain variant
+/// the fixed point kernel takes over from double-double while
+/// its fraction bits last, at about the speed of double, and
+/// takes every tile it can when the features ask for
+/// KernelFixedPoint. Perturbation stays, it is about as fast
+/// and keeps more digits.
+////////////////////////////////////////////////////////////
+inline int chooseTilePrecision(const KernelParams& params, int features,
+                               int left, int top, int width, int height)
+{
+    int precision = choosePrecision(params, left, top, width, height);
+
+    if ((features & KernelVariants) == KernelPlain &&
+         ((features & KernelFixedPoint) ||
+           precision == PrecisionDoubleDouble) &&
+         canUseFixedPoint(params, left, top, width, height))
+        return PrecisionFixedPoint;
+
+    return precision;
+}
+
+////////////////////////////////////////////////////////////
+/// Orbit of one point of a tile in double-double, stored in
+/// double. Every other pixel only iterates its offset from it.
+////////////////////////////////////////////////////////////
+class ReferenceOrbit
+{
+public :
+
+    // Same arguments as iteratePoint
+    void compute(const KernelParams& params,
+                 const DoubleDouble& startReal, const DoubleDouble& startImag)
+    {
+        DoubleDouble real = startReal, imag = startImag;
+        DoubleDouble cReal = params.julia ? params.juliaA : startReal;
+        DoubleDouble cImag = params.julia ? params.juliaB : startImag;
+
+        m_real.clear();
+        m_imag.clear();
+        m_real.push_back(toDouble(real));
+        m_imag.push_back(toDouble(imag));
+
+        for (float iter = 0.0f; iter < params.maxIterations; ++iter)
+        {
+            iterateStep(real, imag, cReal, cImag, false);
+            m_real.push_back(toDouble(real));
+            m_imag.push_back(toDouble(imag));
+
+            if (toDouble(real * real + imag * imag) >= 4.0)
+                break;
+        }
+    }
+
+    // Orbit of the middle pixel of a rectangle of the pane, the one
+    // renderPerturbedTile measures its offsets from
+    void computeForTile(const KernelParams& params, int left, int top,
+                        int width, int height)
+    {
+        m_centerX = left + (width - 1) / 2.0;
+        m_centerY = top + (height - 1) / 2.0;
+
+        compute(params,
+                DoubleDouble(-params.x) + pixelOffset(params, m_centerX),
+                DoubleDouble(-params.y) - pixelOffset(params, m_centerY));
+    }
+
+    // Pixel the orbit starts at, after computeForTile
+    double getCenterX() const
+    {
+        return m_centerX;
+    }
+
+    double getCenterY() const
+    {
+        return m_centerY;
+    }
+
+    // Points stored, one more than the steps taken
+    int getLength() const
+    {
+        return m_real.size();
+    }
+
+    double getReal(int i) const
+    {
+        return m_real[i];
+    }
+
+    double getImag(int i) const
+    {
+        return m_imag[i];
+    }
+
+private :
+
+    std::vector<double> m_real, m_imag;
+    double m_centerX, m_centerY;
+};
+
+////////////////////////////////////////////////////////////
+/// Iterate a pixel as an offset from the reference, delta is
+/// the pixel minus the reference point. Returns false when the
+/// offset can not be trusted, either because the reference
+/// escaped first or because of a glitch, and the pixel has to
+/// be iterated on its own. z^2 + c only.
+////////////////////////////////////////////////////////////
+template <int Features>
+bool iteratePerturbed(const KernelParams& params, const ReferenceOrbit& orbit,
+                      double deltaReal, double deltaImag,
+                      IterationSample& sample)
+{
+    // The Mandlebrot orbit starts at c, so c moves with the start
+    double dcReal = params.julia ? 0.0 : deltaReal;
+    double dcImag = params.julia ? 0.0 : deltaImag;
+
+    double dReal = params.julia ? 1.0 : 0.0;
+    double dImag = 0.0;
+
+    double r2 = 0.0;
+    float iter = 0.0f;
+
+    InteriorCheck interior;
+    interior.period = 0.0f;
+    if (Features & KernelInterior)
+        interior.start(params, orbit.getReal(0) + deltaReal,
+                       orbit.getImag(0) + deltaImag);
+
+    OrbitTraps traps;
+    if (Features & KernelTraps)
+        traps.start();
+
+    for (; interior.period == 0.0f && iter < params.maxIterations && r2 < 4.0;
+         ++iter)
+    {
+        int n = static_cast<int>(iter);
+        if (n + 1 >= orbit.getLength())
+            return false;
+
+        double refReal = orbit.getReal(n);
+        double refImag = orbit.getImag(n);
+
+        if (Features & KernelDistance)
+            stepDerivative(params, refReal + deltaReal, refImag + deltaImag,
+                           dReal, dImag);
+
+        // delta' = 2*Z*delta + delta^2 + dc
+        double tempReal = 2.0 * (refReal * deltaReal - refImag * deltaImag) +
+                          deltaReal * deltaReal - deltaImag * deltaImag + dcReal;
+        deltaImag = 2.0 * (refReal * deltaImag + refImag * deltaReal) +
+                    2.0 * deltaReal * deltaImag + dcImag;
+        deltaReal = tempReal;
+
+        double nextReal = orbit.getReal(n + 1);
+        double nextImag = orbit.getImag(n + 1);
+        double real = nextReal + deltaReal;
+        double imag = nextImag + deltaImag;
+        r2 = real * real + imag * imag;
+
+        if (r2 < PERTURBATION_GLITCH *
+                  (nextReal * nextReal + nextImag * nextImag))
+            return false;
+
+        if (Features & KernelTraps)
+            traps.update(real, imag);
+
+        if ((Features & KernelInterior) &&
+             interior.update(iter, real, imag, r2))
+            break;
+    }
+
+    sample = finishSample<Features>(params, iter, r2, dReal, dImag, interior,
+                                    traps);
+    return true;
+}
+
+// Perturbation around the pixel orbit was computed for with
+// computeForTile, which may be outside the rectangle. Falls back
+// on double-double for the pixels that can not use it.
+template <int Features>
+void renderPerturbedTile(const KernelParams& params,
+                         const ReferenceOrbit& orbit,
+                         IterationSample* out, int stride,
+                         int left, int top, int width, int height)
+{
+    double centerX = orbit.getCenterX();
+    double centerY = orbit.getCenterY();
+
+    double spacing = pixelSpacing(params);
+
+    for (int y = 0; y < height; ++y)
+    {
+        double deltaImag = (centerY - (top + y)) * spacing;
+        DoubleDouble imag = DoubleDouble(-params.y) -
+                            pixelOffset(params, top + y);
+
+        for (int x = 0; x < width; ++x)
+        {
+            double deltaReal = (left + x - centerX) * spacing;
+            IterationSample& sample = out[y * stride + x];
+
+            if (!iteratePerturbed<Features>(params, orbit, deltaReal,
+                                            deltaImag, sample))
+            {
+                DoubleDouble real = DoubleDouble(-params.x) +
+                                    pixelOffset(params, left + x);
+                sample = iteratePoint<DoubleDouble, Features>(params,
+                                                              real, imag);
+            }
+        }
+    }
+}
+
+// The compiled variant for the distance and interior bits of
+// features, Traps is KernelTraps or KernelPlain and goes with all
+template <int Traps>
+void renderPerturbedVariant(const KernelParams& params, int features,
+                            const ReferenceOrbit& orbit, IterationSample* out,
+                            int stride, int left, int top,
+                            int width, int height)
+{
+    switch (features & (KernelDistance | KernelInterior))
+    {
+        case KernelDistance:
+            renderPerturbedTile<KernelDistance | Traps>(params, orbit, out,
+                                        stride, left, top, width, height);
+            break;
+
+        case KernelInterior:
+            renderPerturbedTile<KernelInterior | Traps>(params, orbit, out,
+                                        stride, left, top, width, height);
+            break;
+
+        case KernelDistance | KernelInterior:
+            renderPerturbedTile<KernelDistance | KernelInterior | Traps>(
+                params, orbit, out, stride, left, top, width, height);
+            break;
+
+        default:
+            renderPerturbedTile<KernelPlain | Traps>(params, orbit, out,
+                                        stride, left, top, width, height);
+            break;
+    }
+}
+
+// Pick the compiled variant for a runtime set of features, around
+// an orbit that is already computed
+inline void renderPerturbedTile(const KernelParams& params, int features,
+                                const ReferenceOrbit& orbit,
+                                IterationSample* out, int stride,
+                                int left, int top, int width, int height)
+{
+    if (features & KernelTraps)
+        renderPerturbedVariant<KernelTraps>(params, features, orbit, out,
+                                            stride, left, top, width, height);
+    else
+        renderPerturbedVariant<KernelPlain>(params, features, orbit, out,
+                                            stride, left, top, width, height);
+}
+
+// Perturbation around the middle of the tile, orbit is scratch
+// space reused so its vectors keep their capacity, NULL uses one
+// of its own
+inline void renderPerturbedTile(const KernelParams& params, int features,
+                                IterationSample* out, int stride,
+                                int left, int top, int width, int height,
+                                ReferenceOrbit* orbit = NULL)
+{
+    ReferenceOrbit ownOrbit;
+    ReferenceOrbit& reference = orbit ? *orbit : ownOrbit;
+
+    reference.computeForTile(params, left, top, width, height);
+    renderPerturbedTile(params, features, reference, out, stride,
+                        left, top, width, height);
+}
+
+////////////////////////////////////////////////////////////
+/// Render a rectangle in a precision picked for the tile it is
+/// part of, perturbation goes around an orbit computed for that
+/// tile. Pieces of a tile rendered this way match the tile
+/// rendered whole.
+////////////////////////////////////////////////////////////
+inline void renderTileIn(int precision, const ReferenceOrbit& orbit,
+                         const KernelParams& params, int features,
+                         IterationSample* out, int stride,
+                         int left, int top, int width, int height)
+{
+    switch (precision)
+    {
+        case PrecisionFixedPoint:
+            renderFixedTile(params, out, stride, left, top, width, height);
+            break;
+
+        case PrecisionDoubleDouble:
+            renderTile<DoubleDouble>(params, features, out, stride,
+                                     left, top, width, height);
+            break;
+
+        case PrecisionPerturbation:
+            renderPerturbedTile(params, features, orbit, out, stride,
+                                left, top, width, height);
+            break;
+
+        default:
+            if ((features & KernelVariants) == KernelPlain)
+                renderPacketTile(params, out, stride, left, top,
+                                 width, height);
+            else
+                renderTile<double>(params, features, out, stride,
+                                   left, top, width, height);
+            break;
+    }
+}
+
+// Precision for a tile, with its orbit computed when it is rendered
+// by perturbation
+inline int prepareTile(const KernelParams& params, int features,
+                       ReferenceOrbit& orbit, int left, int top,
+                       int width, int height)
+{
+    int precision = chooseTilePrecision(params, features, left, top,
+                                        width, height);
+    if (precision == PrecisionPerturbation)
+        orbit.computeForTile(params, left, top, width, height);
+
+    return precision;
+}
+
+////////////////////////////////////////////////////////////
+/// Render a tile with the precision it needs, returns the one
+/// that was picked. Float tiles run the double kernels on the
+/// CPU, where a step costs the same in either type. orbit is
+/// scratch space for perturbation, NULL uses one of its own.
+////////////////////////////////////////////////////////////
+inline int renderTileAuto(const KernelParams& params, int features,
+                          IterationSample* out, int stride,
+                          int left, int top, int width, int height,
+                          ReferenceOrbit* orbit = NULL)
+{
+    ReferenceOrbit ownOrbit;
+    ReferenceOrbit& reference = orbit ? *orbit : ownOrbit;
+
+    int precision = prepareTile(params, features, reference, left, top,
+                                width, height);
+    renderTileIn(precision, reference, params, features, out, stride,
+                 left, top, width, height);
+
+    return precision;
+}
+
+#endif // PRECISION_HPP
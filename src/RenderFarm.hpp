@@ -0,0 +1,679 @@
+#ifndef RENDERFARM_HPP
+#define RENDERFARM_HPP
+
+////////////////////////////////////////////////////////////
+// Headers
+////////////////////////////////////////////////////////////
+#include "Kernel.hpp"
+#include "Precision.hpp"
+#include "IterationMap.hpp"
+
+#include <SFML/Network.hpp>
+#include <SFML/System.hpp>
+
+#include <vector>
+#include <deque>
+#include <string>
+#include <sstream>
+#include <iostream>
+#include <algorithm>
+#include <stdio.h>
+#include <stdlib.h>
+
+#ifndef _WIN32
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <signal.h>
+#include <unistd.h>
+#endif
+
+////////////////////////////////////////////////////////////
+// Batch rendering spread over worker processes
+//
+// The coordinator cuts every frame into tiles and hands them to
+// the workers over TCP. Workers pull a new tile as soon as one is
+// done, and once the queue is empty idle workers duplicate tiles
+// still in flight on slower ones, the first result wins. Tiles of
+// a worker that disconnects go back in the queue, and if no worker
+// is left the coordinator renders the rest itself.
+//
+// Finished rows of tiles are handed on as soon as every row above
+// them is out, so a frame of any size only ever has the rows
+// still being rendered in memory.
+////////////////////////////////////////////////////////////
+
+// Width of the tiles handed to the workers
+#define FARM_TILE 64
+
+// Tiles a worker may have queued, so it never waits on the network
+#define FARM_PIPELINE 2
+
+// How long to go without any worker before rendering locally
+#define FARM_WORKER_TIMEOUT 5000
+
+enum FarmMessage
+{
+    MessageHello,
+    MessageTile,
+    MessageResult,
+    MessageQuit
+};
+
+// A batch render, one or more frames zooming in on the same point
+struct FarmJob
+{
+    KernelParams params;
+    int features;
+
+    // Frame i is rendered at zoom * zoomStep^i
+    int frames;
+    double zoomStep;
+
+    // Frames are written as output, or base_0000.ext for sequences
+    std::string output;
+};
+
+// One tile of one frame
+struct FarmTile
+{
+    int frame;
+    int left, top, width, height;
+};
+
+inline sf::Packet& operator<<(sf::Packet& packet, const KernelParams& params)
+{
+    return packet << params.x << params.y << params.zoom
+                  << params.juliaA << params.juliaB
+                  << params.julia << params.almond << params.logShading
+                  << params.maxIterations << sf::Int32(params.size);
+}
+
+inline sf::Packet& operator>>(sf::Packet& packet, KernelParams& params)
+{
+    sf::Int32 size = 0;
+    packet >> params.x >> params.y >> params.zoom
+           >> params.juliaA >> params.juliaB
+           >> params.julia >> params.almond >> params.logShading
+           >> params.maxIterations >> size;
+    params.size = size;
+    return packet;
+}
+
+// Name of frame i of a job
+inline std::string getFramePath(const FarmJob& job, int frame)
+{
+    if (job.frames <= 1)
+        return job.output;
+
+    std::size_t dot = job.output.find_last_of('.');
+    std::string base = job.output.substr(0, dot);
+    std::string extension = dot == std::string::npos ? "" :
+                                                       job.output.substr(dot);
+
+    char number[16];
+    sprintf(number, "_%04d", frame);
+    return base + number + extension;
+}
+
+inline KernelParams getFrameParams(const FarmJob& job, int frame)
+{
+    KernelParams params = job.params;
+    params.zoom *= pow(job.zoomStep, frame);
+    return params;
+}
+
+////////////////////////////////////////////////////////////
+/// Worker process, renders tiles until told to quit
+////////////////////////////////////////////////////////////
+class RenderWorker
+{
+public :
+
+    // crashAfter > 0 drops the connection after that many tiles,
+    // used to exercise the retry path
+    int run(const std::string& host, unsigned short port, int crashAfter = 0)
+    {
+        sf::TcpSocket socket;
+        if (socket.connect(sf::IpAddress(host), port) != sf::Socket::Done)
+        {
+            std::cerr << "Worker could not connect to " << host << ":"
+                      << port << std::endl;
+            return EXIT_FAILURE;
+        }
+
+        sf::Packet hello;
+        hello << sf::Int32(MessageHello);
+        socket.send(hello);
+
+        std::vector<IterationSample> samples(FARM_TILE * FARM_TILE);
+        int rendered = 0;
+
+        while (true)
+        {
+            sf::Packet packet;
+            if (socket.receive(packet) != sf::Socket::Done)
+                return EXIT_FAILURE;
+
+            sf::Int32 type;
+            packet >> type;
+            if (type == MessageQuit)
+                return EXIT_SUCCESS;
+
+            sf::Int32 id, features, left, top, width, height;
+            KernelParams params;
+            packet >> id >> params >> features >> left >> top
+                   >> width >> height;
+
+            if (!packet || width > FARM_TILE || height > FARM_TILE)
+                return EXIT_FAILURE;
+
+            if (crashAfter > 0 && rendered == crashAfter)
+                return EXIT_FAILURE;
+
+            renderTileAuto(params, features, &samples[0], FARM_TILE,
+                           left, top, width, height);
+            ++rendered;
+
+            sf::Packet result;
+            result << sf::Int32(MessageResult) << id;
+            for (int y = 0; y < height; ++y)
+            {
+                for (int x = 0; x < width; ++x)
+                {
+                    const IterationSample& sample = samples[y * FARM_TILE + x];
+                    result << sample.iterations << sample.color
+                           << sample.distance << sample.atom << sample.period
+                           << sample.stripe << sample.trapPoint
+                           << sample.trapLine << sample.trapCross;
+                }
+            }
+
+            if (socket.send(result) != sf::Socket::Done)
+                return EXIT_FAILURE;
+        }
+    }
+};
+
+////////////////////////////////////////////////////////////
+/// Where the coordinator sends the frames, a band of rows at a
+/// time from the top. Any call returning false aborts the job.
+////////////////////////////////////////////////////////////
+class FrameSink
+{
+public :
+
+    virtual ~FrameSink()
+    {
+    }
+
+    // A frame of params, params.size pixels square, goes to path
+    virtual bool begin(const KernelParams& params, int channels,
+                       const std::string& path) = 0;
+
+    // The next rows, band is as wide as the frame and its rows start
+    // at row top of it. The sink deletes band when done with it.
+    virtual bool write(IterationMap* band, int top) = 0;
+
+    virtual bool end() = 0;
+
+    // Called once after the last frame, sinks that write in the
+    // background return when everything is written
+    virtual bool finish()
+    {
+        return true;
+    }
+};
+
+////////////////////////////////////////////////////////////
+/// Coordinator, owns the tile queue and writes the frames
+////////////////////////////////////////////////////////////
+class RenderCoordinator
+{
+public :
+
+    RenderCoordinator() :
+    m_doneTiles(0),
+    m_nextBand(0)
+    {
+    }
+
+    ~RenderCoordinator()
+    {
+        for (std::size_t i = 0; i < m_bands.size(); ++i)
+            delete m_bands[i];
+    }
+
+    ////////////////////////////////////////////////////////////
+    /// Render job, spawning localWorkers copies of program as
+    /// workers. Other workers can join on the printed port.
+    ////////////////////////////////////////////////////////////
+    bool run(const FarmJob& job, int localWorkers, const std::string& program,
+             FrameSink& sink, int crashAfter = 0)
+    {
+        m_job = job;
+        m_sink = &sink;
+
+        // Every way out goes through shutdown, so no worker outlives
+        // the coordinator
+        bool rendered = render(localWorkers, program, crashAfter);
+        shutdown(!rendered);
+
+        return rendered && writeBands() && m_sink->finish();
+    }
+
+private :
+
+    struct Worker
+    {
+        sf::TcpSocket* socket;
+        std::vector<int> inFlight;
+        int tilesDone;
+    };
+
+    struct TileState
+    {
+        FarmTile tile;
+        bool done;
+        int copies;  // Workers currently rendering it
+        sf::Clock sent;
+    };
+
+    // Hand out and collect every tile, false when the job failed
+    bool render(int localWorkers, const std::string& program, int crashAfter)
+    {
+        if (m_listener.listen(sf::Socket::AnyPort) != sf::Socket::Done)
+            return false;
+
+        unsigned short port = m_listener.getLocalPort();
+        std::cout << "Coordinator listening on port " << port << std::endl;
+
+        buildQueue();
+
+        for (int i = 0; i < localWorkers; ++i)
+            spawnWorker(program, port, i == 0 ? crashAfter : 0);
+
+        m_selector.add(m_listener);
+
+        sf::Clock aloneClock;
+        while (m_doneTiles < m_tiles.size())
+        {
+            if (!m_workers.empty())
+                aloneClock.restart();
+
+            // Nobody to hand the work to, do it here between polls
+            bool alone = aloneClock.getElapsedTime().asMilliseconds() >
+                         FARM_WORKER_TIMEOUT;
+            if (alone && !renderLocally())
+                return false;
+
+            if (!m_selector.wait(alone ? sf::microseconds(1) :
+                                         sf::milliseconds(100)))
+                continue;
+
+            if (m_selector.isReady(m_listener))
+                acceptWorker();
+
+            for (std::size_t i = 0; i < m_workers.size(); )
+            {
+                if (m_selector.isReady(*m_workers[i].socket) &&
+                     !receive(m_workers[i]))
+                {
+                    dropWorker(i);
+                    continue;
+                }
+                ++i;
+            }
+
+            for (std::size_t i = 0; i < m_workers.size(); ++i)
+                dispatch(m_workers[i]);
+
+            if (!writeBands())
+                return false;
+        }
+
+        return true;
+    }
+
+    void buildQueue()
+    {
+        int size = m_job.params.size;
+        for (int frame = 0; frame < m_job.frames; ++frame)
+        {
+            for (int top = 0; top < size; top += FARM_TILE)
+            {
+                for (int left = 0; left < size; left += FARM_TILE)
+                {
+                    TileState state;
+                    state.tile.frame = frame;
+                    state.tile.left = left;
+                    state.tile.top = top;
+                    state.tile.width = std::min(FARM_TILE, size - left);
+                    state.tile.height = std::min(FARM_TILE, size - top);
+                    state.done = false;
+                    state.copies = 0;
+
+                    m_pending.push_back(m_tiles.size());
+                    m_tiles.push_back(state);
+                }
+            }
+        }
+
+        // Tiles are queued a row at a time, so bands finish in order
+        m_bandsPerFrame = (size + FARM_TILE - 1) / FARM_TILE;
+        m_bandTiles.assign(m_job.frames * m_bandsPerFrame, 0);
+        m_bands.assign(m_bandTiles.size(), NULL);
+    }
+
+    void spawnWorker(const std::string& program, unsigned short port,
+                     int crashAfter)
+    {
+#ifndef _WIN32
+        std::ostringstream portText, crashText;
+        portText << port;
+        crashText << crashAfter;
+
+        pid_t pid = fork();
+        if (pid == 0)
+        {
+            std::string portString = portText.str();
+            std::string crashString = crashText.str();
+            execl(program.c_str(), program.c_str(), "--worker", "127.0.0.1",
+                  portString.c_str(), "--crash-after", crashString.c_str(),
+                  (char*)NULL);
+            _exit(EXIT_FAILURE);
+        }
+        else if (pid > 0)
+        {
+            m_children.push_back(pid);
+        }
+#else
+        std::cerr << "Start workers by hand with: " << program
+                  << " --worker 127.0.0.1 " << port << std::endl;
+#endif
+    }
+
+    void acceptWorker()
+    {
+        Worker worker;
+        worker.socket = new sf::TcpSocket;
+        worker.tilesDone = 0;
+
+        if (m_listener.accept(*worker.socket) != sf::Socket::Done)
+        {
+            delete worker.socket;
+            return;
+        }
+
+        m_selector.add(*worker.socket);
+        m_workers.push_back(worker);
+    }
+
+    // Put the tiles of a lost worker back at the front of the queue
+    void dropWorker(std::size_t index)
+    {
+        Worker& worker = m_workers[index];
+        std::cerr << "Worker lost, requeueing " << worker.inFlight.size()
+                  << " tiles" << std::endl;
+
+        for (std::size_t i = 0; i < worker.inFlight.size(); ++i)
+        {
+            TileState& state = m_tiles[worker.inFlight[i]];
+            if (--state.copies == 0 && !state.done)
+                m_pending.push_front(worker.inFlight[i]);
+        }
+
+        m_selector.remove(*worker.socket);
+        delete worker.socket;
+        m_workers.erase(m_workers.begin() + index);
+    }
+
+    // Pick the next tile, stealing the oldest one in flight when empty
+    bool nextTile(const Worker& worker, int& id)
+    {
+        while (!m_pending.empty())
+        {
+            id = m_pending.front();
+            m_pending.pop_front();
+            if (!m_tiles[id].done)
+                return true;
+        }
+
+        float oldest = 0.0f;
+        bool found = false;
+        for (std::size_t i = 0; i < m_tiles.size(); ++i)
+        {
+            TileState& state = m_tiles[i];
+            if (state.done || state.copies != 1 ||
+                 std::find(worker.inFlight.begin(), worker.inFlight.end(),
+                           static_cast<int>(i)) != worker.inFlight.end())
+                continue;
+
+            float age = state.sent.getElapsedTime().asSeconds();
+            if (age > oldest)
+            {
+                oldest = age;
+                id = i;
+                found = true;
+            }
+        }
+
+        return found;
+    }
+
+    void dispatch(Worker& worker)
+    {
+        int id;
+        while (worker.inFlight.size() < FARM_PIPELINE && nextTile(worker, id))
+        {
+            TileState& state = m_tiles[id];
+            const FarmTile& tile = state.tile;
+
+            sf::Packet packet;
+            packet << sf::Int32(MessageTile) << sf::Int32(id)
+                   << getFrameParams(m_job, tile.frame)
+                   << sf::Int32(m_job.features)
+                   << sf::Int32(tile.left) << sf::Int32(tile.top)
+                   << sf::Int32(tile.width) << sf::Int32(tile.height);
+
+            if (worker.socket->send(packet) != sf::Socket::Done)
+            {
+                m_pending.push_front(id);
+                return;
+            }
+
+            if (state.copies++ == 0)
+                state.sent.restart();
+            worker.inFlight.push_back(id);
+        }
+    }
+
+    bool receive(Worker& worker)
+    {
+        sf::Packet packet;
+        if (worker.socket->receive(packet) != sf::Socket::Done)
+            return false;
+
+        sf::Int32 type;
+        packet >> type;
+        if (type == MessageHello)
+            return true;
+
+        sf::Int32 id;
+        packet >> id;
+        if (type != MessageResult || id < 0 ||
+             id >= static_cast<sf::Int32>(m_tiles.size()))
+            return false;
+
+        std::vector<int>::iterator it =
+            std::find(worker.inFlight.begin(), worker.inFlight.end(), id);
+        if (it != worker.inFlight.end())
+            worker.inFlight.erase(it);
+
+        TileState& state = m_tiles[id];
+        --state.copies;
+        ++worker.tilesDone;
+
+        // A stolen tile may already be in
+        if (state.done)
+            return true;
+
+        const FarmTile& tile = state.tile;
+        std::vector<IterationSample> samples(tile.width * tile.height);
+        for (std::size_t i = 0; i < samples.size(); ++i)
+            packet >> samples[i].iterations >> samples[i].color
+                   >> samples[i].distance >> samples[i].atom
+                   >> samples[i].period >> samples[i].stripe
+                   >> samples[i].trapPoint >> samples[i].trapLine
+                   >> samples[i].trapCross;
+
+        if (!packet)
+            return false;
+
+        storeTile(id, &samples[0]);
+        return true;
+    }
+
+    // Last resort when there are no workers
+    bool renderLocally()
+    {
+        int id;
+        Worker none;
+        if (!nextTile(none, id))
+            return true;
+
+        const FarmTile& tile = m_tiles[id].tile;
+        std::vector<IterationSample> samples(tile.width * tile.height);
+        renderTileAuto(getFrameParams(m_job, tile.frame), m_job.features,
+                       &samples[0], tile.width, tile.left, tile.top,
+                       tile.width, tile.height);
+
+        storeTile(id, &samples[0]);
+        return writeBands();
+    }
+
+    void storeTile(int id, const IterationSample* samples)
+    {
+        TileState& state = m_tiles[id];
+        const FarmTile& tile = state.tile;
+
+        int index = getBandIndex(tile.frame, tile.top);
+        IterationMap*& band = m_bands[index];
+        if (!band)
+        {
+            int size = m_job.params.size;
+            band = new IterationMap;
+            band->create(getFrameParams(m_job, tile.frame), size,
+                         std::min(FARM_TILE, size - tile.top),
+                         getFeatureChannels(m_job.features));
+        }
+
+        band->store(tile.left, 0, tile.width, tile.height,
+                    samples, tile.width);
+
+        state.done = true;
+        ++m_bandTiles[index];
+        ++m_doneTiles;
+    }
+
+    int getBandIndex(int frame, int top) const
+    {
+        return frame * m_bandsPerFrame + top / FARM_TILE;
+    }
+
+    // Hand finished bands on in order and free them
+    bool writeBands()
+    {
+        int size = m_job.params.size;
+        int tilesPerBand = (size + FARM_TILE - 1) / FARM_TILE;
+
+        while (m_nextBand < m_bands.size() &&
+               m_bandTiles[m_nextBand] == tilesPerBand)
+        {
+            int frame = m_nextBand / m_bandsPerFrame;
+            int top = (m_nextBand % m_bandsPerFrame) * FARM_TILE;
+            std::string path = getFramePath(m_job, frame);
+
+            bool ok = true;
+            if (top == 0)
+                ok = m_sink->begin(getFrameParams(m_job, frame),
+                                   getFeatureChannels(m_job.features), path);
+
+            if (ok)
+                ok = m_sink->write(m_bands[m_nextBand], top);
+            else
+                delete m_bands[m_nextBand];
+
+            m_bands[m_nextBand] = NULL;
+            ++m_nextBand;
+
+            bool last = top + FARM_TILE >= size;
+            if (ok && last)
+                ok = m_sink->end();
+
+            if (!ok)
+            {
+                std::cout << "Could not write " << path << std::endl;
+                return false;
+            }
+        }
+
+        return true;
+    }
+
+    ////////////////////////////////////////////////////////////
+    /// Tell the workers to quit and reap the spawned ones. After
+    /// a failure the spawned workers are also terminated, some may
+    /// not have connected yet and would never hear the quit.
+    ////////////////////////////////////////////////////////////
+    void shutdown(bool failed)
+    {
+        for (std::size_t i = 0; i < m_workers.size(); ++i)
+        {
+            sf::Packet quit;
+            quit << sf::Int32(MessageQuit);
+            m_workers[i].socket->send(quit);
+
+            std::cout << "Worker " << i << " rendered "
+                      << m_workers[i].tilesDone << " tiles" << std::endl;
+            delete m_workers[i].socket;
+        }
+
+        m_workers.clear();
+        m_selector.clear();
+        m_listener.close();
+
+#ifndef _WIN32
+        for (std::size_t i = 0; i < m_children.size(); ++i)
+        {
+            if (failed)
+                kill(m_children[i], SIGTERM);
+            waitpid(m_children[i], NULL, 0);
+        }
+
+        m_children.clear();
+#endif
+    }
+
+    FarmJob m_job;
+    FrameSink* m_sink;
+
+    sf::TcpListener m_listener;
+    sf::SocketSelector m_selector;
+    std::vector<Worker> m_workers;
+
+    std::vector<TileState> m_tiles;
+    std::deque<int> m_pending;
+    std::size_t m_doneTiles;
+
+    // Rows of tiles of every frame, frame major
+    int m_bandsPerFrame;
+    std::vector<int> m_bandTiles;
+    std::vector<IterationMap*> m_bands;
+    std::size_t m_nextBand;
+
+#ifndef _WIN32
+    std::vector<pid_t> m_children;
+#endif
+};
+
+#endif // RENDERFARM_HPP
@@ -0,0 +1,370 @@
+#ifndef RENDERER_HPP
+#define RENDERER_HPP
+
+////////////////////////////////////////////////////////////
+// Headers
+////////////////////////////////////////////////////////////
+#include "Kernel.hpp"
+#include "Precision.hpp"
+#include "IterationMap.hpp"
+#include "ViewCache.hpp"
+#include "Threads.hpp"
+
+#include <SFML/System.hpp>
+
+#include <vector>
+#include <algorithm>
+
+////////////////////////////////////////////////////////////
+// Multithreaded CPU renderer, fills an IterationMap in the
+// background one square tile at a time, each in the precision
+// it needs. A render can be cancelled between tiles when its
+// view is no longer the one on screen.
+////////////////////////////////////////////////////////////
+
+// Width of the tiles handed to the threads
+#define RENDER_TILE 64
+
+// Scratch memory of one render thread
+struct TileScratch
+{
+    std::vector<IterationSample> samples;
+    ReferenceOrbit orbit;
+};
+
+////////////////////////////////////////////////////////////
+/// Scratch handed out to the render threads and taken back
+/// when they finish, so the next render starts with buffers
+/// that already have their full size instead of new ones
+////////////////////////////////////////////////////////////
+class TilePool : sf::NonCopyable
+{
+public :
+
+    ~TilePool()
+    {
+        for (std::size_t i = 0; i < m_free.size(); ++i)
+            delete m_free[i];
+    }
+
+    // Scratch with room for at least samples samples
+    TileScratch* acquire(std::size_t samples)
+    {
+        TileScratch* scratch = NULL;
+        {
+            sf::Lock lock(m_mutex);
+            if (!m_free.empty())
+            {
+                scratch = m_free.back();
+                m_free.pop_back();
+            }
+        }
+
+        if (!scratch)
+            scratch = new TileScratch;
+
+        if (scratch->samples.size() < samples)
+            scratch->samples.resize(samples);
+
+        return scratch;
+    }
+
+    void release(TileScratch* scratch)
+    {
+        sf::Lock lock(m_mutex);
+        m_free.push_back(scratch);
+    }
+
+private :
+
+    sf::Mutex m_mutex;
+    std::vector<TileScratch*> m_free;
+};
+
+////////////////////////////////////////////////////////////
+/// Renders are numbered by a generation that start() and
+/// cancel() bump. A thread takes its tile together with the
+/// generation, and when that is no longer current by the time
+/// the tile is done the tile is dropped instead of stored, so
+/// nothing ever waits for a thread to leave its tile. The
+/// threads then go on with the tiles of the next render, or
+/// end when there are none and are launched again by start().
+////////////////////////////////////////////////////////////
+class TileRenderer : sf::NonCopyable
+{
+public :
+
+    TileRenderer() :
+    m_map(NULL),
+    m_generation(0),
+    m_tileCount(0),
+    m_nextTile(0),
+    m_doneTiles(0),
+    m_cancelled(false)
+    {
+    }
+
+    ~TileRenderer()
+    {
+        cancel();
+        wait();
+
+        for (std::size_t i = 0; i < m_workers.size(); ++i)
+        {
+            delete m_workers[i]->thread;
+            delete m_workers[i];
+        }
+    }
+
+    ////////////////////////////////////////////////////////////
+    /// Start filling map, which must already be created for
+    /// params. Tiles that are inside in parent, a render of a
+    /// view covering this one, start with their border and are
+    /// filled when it is inside too. parent is only read here.
+    /// Returns at once, even while threads are still in a tile
+    /// of the render before.
+    ////////////////////////////////////////////////////////////
+    void start(const KernelParams& params, int features, IterationMap& map,
+               const IterationMap* parent = NULL)
+    {
+        unsigned int count;
+        {
+            sf::Lock lock(m_mutex);
+
+            ++m_generation;
+            m_params = params;
+            m_features = features;
+            m_map = &map;
+
+            m_tilesX = (map.getWidth() + RENDER_TILE - 1) / RENDER_TILE;
+            m_tileCount = m_tilesX *
+                          ((map.getHeight() + RENDER_TILE - 1) / RENDER_TILE);
+            m_nextTile = 0;
+            m_doneTiles = 0;
+            m_cancelled = false;
+            m_finishedTiles.assign(m_tileCount, false);
+
+            m_insideTiles.assign(m_tileCount, false);
+            if (parent && canFillInside(params, features))
+            {
+                for (int tile = 0; tile < m_tileCount; ++tile)
+                {
+                    int left, top, width, height;
+                    getTile(tile, left, top, width, height);
+                    m_insideTiles[tile] = isInsideInParent(*parent, params,
+                                                  left, top, width, height);
+                }
+            }
+
+            count = std::min<unsigned int>(getCoreCount(), m_tileCount);
+            while (m_workers.size() < count)
+            {
+                Worker* worker = new Worker;
+                worker->renderer = this;
+                worker->thread = new sf::Thread(&TileRenderer::run, worker);
+                worker->running = false;
+                m_workers.push_back(worker);
+            }
+        }
+
+        // Threads still running pick the new tiles up themselves,
+        // the ones that ended are joined, which is immediate, and
+        // launched again
+        for (unsigned int i = 0; i < count; ++i)
+        {
+            {
+                sf::Lock lock(m_mutex);
+                if (m_workers[i]->running)
+                    continue;
+
+                m_workers[i]->running = true;
+            }
+
+            m_workers[i]->thread->launch();
+        }
+    }
+
+    // Block until the threads have ended, after the current render
+    // is complete unless it was cancelled
+    void wait()
+    {
+        for (std::size_t i = 0; i < m_workers.size(); ++i)
+            m_workers[i]->thread->wait();
+    }
+
+    ////////////////////////////////////////////////////////////
+    /// Stop the current render without waiting for the threads.
+    /// The tiles that are done stay in the map, the others are
+    /// left as they were, and the threads never store into the
+    /// map again once this returns.
+    ////////////////////////////////////////////////////////////
+    void cancel()
+    {
+        sf::Lock lock(m_mutex);
+        m_cancelled = true;
+        ++m_generation;
+    }
+
+    ////////////////////////////////////////////////////////////
+    /// Fill the tiles a cancelled render did not get to from
+    /// preview, a map of the same view at any size, so that the
+    /// map can stand in for its render until a better one is done
+    ////////////////////////////////////////////////////////////
+    void fillCancelled(const IterationMap& preview)
+    {
+        // Nothing of the render changes until the next start()
+        double scaleX = preview.getWidth() / (double)m_map->getWidth();
+        double scaleY = preview.getHeight() / (double)m_map->getHeight();
+
+        std::vector<IterationSample> row(RENDER_TILE);
+        for (int tile = 0; tile < m_tileCount; ++tile)
+        {
+            if (m_finishedTiles[tile])
+                continue;
+
+            int left, top, width, height;
+            getTile(tile, left, top, width, height);
+
+            for (int y = top; y < top + height; ++y)
+            {
+                int sourceY = std::min(static_cast<int>((y + 0.5) * scaleY),
+                                       preview.getHeight() - 1);
+
+                for (int x = 0; x < width; ++x)
+                {
+                    int sourceX = std::min(static_cast<int>(
+                                               (left + x + 0.5) * scaleX),
+                                           preview.getWidth() - 1);
+                    row[x] = preview.getSample(sourceX, sourceY);
+                }
+
+                m_map->store(left, y, width, 1, &row[0], RENDER_TILE);
+            }
+        }
+    }
+
+    bool isDone()
+    {
+        sf::Lock lock(m_mutex);
+        return m_doneTiles == m_tileCount;
+    }
+
+    float getProgress()
+    {
+        sf::Lock lock(m_mutex);
+        return m_tileCount > 0 ? m_doneTiles / (float)m_tileCount : 1.0f;
+    }
+
+private :
+
+    // A render thread, launched again for a render after the one
+    // it ended in
+    struct Worker
+    {
+        TileRenderer* renderer;
+        sf::Thread* thread;
+        bool running;
+    };
+
+    // A tile with the render it belongs to, copied so that start()
+    // can set up the next render while the tile is drawn
+    struct Tile
+    {
+        KernelParams params;
+        int features;
+        IterationMap* map;
+        unsigned int generation;
+        int index;
+        int left, top, width, height;
+        bool inside;
+    };
+
+    static void run(Worker* worker)
+    {
+        worker->renderer->work(*worker);
+    }
+
+    void work(Worker& worker)
+    {
+        TileScratch* scratch = m_pool.acquire(RENDER_TILE * RENDER_TILE);
+
+        Tile tile;
+        while (nextTile(worker, tile))
+        {
+            if (tile.inside)
+                renderFilledTile(tile.params, tile.features,
+                                 &scratch->samples[0], RENDER_TILE,
+                                 tile.left, tile.top, tile.width, tile.height,
+                                 &scratch->orbit);
+            else
+                renderTileAuto(tile.params, tile.features,
+                               &scratch->samples[0], RENDER_TILE,
+                               tile.left, tile.top, tile.width, tile.height,
+                               &scratch->orbit);
+
+            // Stored under the lock so that a cancelled render, whose
+            // map may be handed on or deleted, is never written to
+            sf::Lock lock(m_mutex);
+            if (tile.generation != m_generation)
+                continue;
+
+            tile.map->store(tile.left, tile.top, tile.width, tile.height,
+                            &scratch->samples[0], RENDER_TILE);
+            m_finishedTiles[tile.index] = true;
+            ++m_doneTiles;
+        }
+
+        m_pool.release(scratch);
+    }
+
+    void getTile(int tile, int& left, int& top, int& width, int& height)
+    {
+        left = (tile % m_tilesX) * RENDER_TILE;
+        top = (tile / m_tilesX) * RENDER_TILE;
+        width = std::min(RENDER_TILE, m_map->getWidth() - left);
+        height = std::min(RENDER_TILE, m_map->getHeight() - top);
+    }
+
+    // Next tile of the current render, false once the thread is
+    // to end
+    bool nextTile(Worker& worker, Tile& tile)
+    {
+        sf::Lock lock(m_mutex);
+        if (m_cancelled || m_nextTile >= m_tileCount)
+        {
+            worker.running = false;
+            return false;
+        }
+
+        tile.params = m_params;
+        tile.features = m_features;
+        tile.map = m_map;
+        tile.generation = m_generation;
+        tile.index = m_nextTile++;
+        tile.inside = m_insideTiles[tile.index];
+        getTile(tile.index, tile.left, tile.top, tile.width, tile.height);
+
+        return true;
+    }
+
+    KernelParams m_params;
+    int m_features;
+    IterationMap* m_map;
+
+    sf::Mutex m_mutex;
+    unsigned int m_generation;
+    int m_tilesX;
+    int m_tileCount;
+    int m_nextTile;
+    int m_doneTiles;
+    bool m_cancelled;
+    std::vector<bool> m_finishedTiles;
+
+    // Tiles the parent render says are inside
+    std::vector<bool> m_insideTiles;
+
+    std::vector<Worker*> m_workers;
+    TilePool m_pool;
+};
+
+#endif // RENDERER_HPP
@@ -0,0 +1,162 @@
+#ifndef SESSION_HPP
+#define SESSION_HPP
+
+////////////////////////////////////////////////////////////
+// Headers
+////////////////////////////////////////////////////////////
+#include <SFML/Graphics.hpp>
+
+#include <map>
+#include <string>
+#include <vector>
+#include <sstream>
+#include <fstream>
+#include <stdio.h>
+
+////////////////////////////////////////////////////////////
+// Saved layout and view, a plain "key = value" text file so
+// bookmarks can be edited by hand
+////////////////////////////////////////////////////////////
+class Session
+{
+public :
+
+    void clear()
+    {
+        m_values.clear();
+    }
+
+    void setValue(const std::string& key, const std::string& value)
+    {
+        m_values[key] = value;
+    }
+
+    bool getValue(const std::string& key, std::string& value) const
+    {
+        std::map<std::string, std::string>::const_iterator it =
+            m_values.find(key);
+        if (it == m_values.end())
+            return false;
+
+        value = it->second;
+        return true;
+    }
+
+    // Frames are written with enough digits to come back exactly
+    void setFrame(const std::string& key, const sf::Vector3<double>& frame)
+    {
+        char temp[128];
+        sprintf(temp, "%.17g %.17g %.17g", frame.x, frame.y, frame.z);
+        setValue(key, temp);
+    }
+
+    bool getFrame(const std::string& key, sf::Vector3<double>& frame) const
+    {
+        std::string value;
+        if (!getValue(key, value))
+            return false;
+
+        std::istringstream stream(value);
+        return !(stream >> frame.x >> frame.y >> frame.z).fail();
+    }
+
+    void setDouble(const std::string& key, double value)
+    {
+        char temp[64];
+        sprintf(temp, "%.17g", value);
+        setValue(key, temp);
+    }
+
+    bool getDouble(const std::string& key, double& value) const
+    {
+        std::string text;
+        if (!getValue(key, text))
+            return false;
+
+        std::istringstream stream(text);
+        return !(stream >> value).fail();
+    }
+
+    void setFloat(const std::string& key, float value)
+    {
+        char temp[64];
+        sprintf(temp, "%.9g", value);
+        setValue(key, temp);
+    }
+
+    bool getFloat(const std::string& key, float& value) const
+    {
+        std::string text;
+        if (!getValue(key, text))
+            return false;
+
+        std::istringstream stream(text);
+        return !(stream >> value).fail();
+    }
+
+    void setBool(const std::string& key, bool value)
+    {
+        setValue(key, value ? "1" : "0");
+    }
+
+    bool getBool(const std::string& key, bool& value) const
+    {
+        float number;
+        if (!getFloat(key, number))
+            return false;
+
+        value = number != 0.0f;
+        return true;
+    }
+
+    bool saveToFile(const std::string& path) const
+    {
+        std::ofstream file(path.c_str());
+        if (!file)
+            return false;
+
+        std::map<std::string, std::string>::const_iterator it;
+        for (it = m_values.begin(); it != m_values.end(); ++it)
+            file << it->first << " = " << it->second << "\n";
+
+        return file.good();
+    }
+
+    bool loadFromFile(const std::string& path)
+    {
+        std::ifstream file(path.c_str());
+        if (!file)
+            return false;
+
+        clear();
+
+        std::string line;
+        while (std::getline(file, line))
+        {
+            std::size_t equals = line.find('=');
+            if (line.empty() || line[0] == '#' || equals == std::string::npos)
+                continue;
+
+            setValue(trim(line.substr(0, equals)),
+                     trim(line.substr(equals + 1)));
+        }
+
+        return true;
+    }
+
+private :
+
+    static std::string trim(const std::string& text)
+    {
+        std::size_t first = text.find_first_not_of(" \t\r");
+        if (first == std::string::npos)
+            return "";
+
+        std::size_t last = text.find_last_not_of(" \t\r");
+        return text.substr(first, last - first + 1);
+    }
+
+    std::map<std::string, std::string> m_values;
+};
+
+#endif // SESSION_HPP
@@ -2,20 +2,41 @@
 // Headers
 ////////////////////////////////////////////////////////////
 // First our files
+#include "Kernel.hpp"
+#include "Precision.hpp"
+#include "Palette.hpp"
 #include "Effect.hpp"
 #include "MenuItem.hpp"
+#include "JuliaHint.hpp"
+#include "Interior.hpp"
 #include "Julia.hpp"
 #include "Mandlebrot.hpp"
+#include "Buddhabrot.hpp"
+#include "JuliaAtlas.hpp"
+#include "Mandelbulb.hpp"
+#include "Session.hpp"
+#include "RenderFarm.hpp"
+#include "ExpMap.hpp"
+#include "Memory.hpp"
+#include "Golden.hpp"
+#include "FrameWriter.hpp"
+#include "EventLog.hpp"
 
 // Then the SFML libraries
 #include <SFML/Graphics.hpp>
 
 // Lastly all the necessary standards
 #include <vector>
+#include <algorithm>
 #include <cmath>
 #include <stdio.h>
 #include <iostream>
 #include <fstream>
+#include <string>
+#include <stdlib.h>
+#include <string.h>
+#include <new>
+#include <cfloat>
 
 // Useful constant
 #define PI 3.14159265
@@ -23,10 +44,94 @@
 // Make the effect's font available
 const sf::Font* Effect::s_font = NULL;
 
+// Mouse buttons held down, see Effect::trackButtons
+bool Effect::s_buttons[sf::Mouse::ButtonCount] = {false};
+
+// Shader uniform names, see Effect.hpp
+const std::string Uniform::Palette("Palette");
+const std::string Uniform::ColorRange("ColorRange");
+const std::string Uniform::ColorMode("ColorMode");
+const std::string Uniform::InteriorDetection("InteriorDetection");
+const std::string Uniform::ComponentCount("ComponentCount");
+const std::string Uniform::OrbitTraps("OrbitTraps");
+const std::string Uniform::MaxIterations("MaxIterations");
+const std::string Uniform::LogShading("LogShading");
+const std::string Uniform::Zoom("Zoom");
+const std::string Uniform::Almond("Almond");
+const std::string Uniform::DistanceEstimation("DistanceEstimation");
+const std::string Uniform::Julia("Julia");
+const std::string Uniform::JuliaA("JuliaA");
+const std::string Uniform::JuliaB("JuliaB");
+const std::string Uniform::Xcenter("Xcenter");
+const std::string Uniform::Ycenter("Ycenter");
+const std::string Uniform::CenterLow("CenterLow");
+const std::string Uniform::JuliaLow("JuliaLow");
+const std::string Uniform::TrapRadius("TrapRadius");
+const std::string Uniform::TrapCenter("TrapCenter");
+const std::string Uniform::PaneOrigin("PaneOrigin");
+const std::string Uniform::PaneSize("PaneSize");
+
+volatile unsigned long AllocationCounter::s_count = 0;
+
+#ifndef NDEBUG
+// Debug builds count every allocation, the status line shows how many
+// the last frame made
+void* operator new(std::size_t size)
+{
+    AllocationCounter::add();
+
+    void* memory = malloc(size > 0 ? size : 1);
+    if (!memory)
+        throw std::bad_alloc();
+
+    return memory;
+}
+
+void* operator new[](std::size_t size)
+{
+    return operator new(size);
+}
+
+void operator delete(void* memory) throw()
+{
+    free(memory);
+}
+
+void operator delete[](void* memory) throw()
+{
+    free(memory);
+}
+#endif
+
 // Keep track of our UI elements for easy drawing
 std::vector<Slider*> sliders;
 std::vector<Checkbox*> checkboxes;
 
+// Command line modes
+int exportMap(int argc, char* argv[]);
+int renderBatch(int argc, char* argv[]);
+int runWorker(int argc, char* argv[]);
+int renderExpMap(int argc, char* argv[]);
+int expMapFrames(int argc, char* argv[]);
+int runGolden(int argc, char* argv[]);
+bool checkGoldenShaders(const std::string& directory);
+
+// Sessions and bookmarks
+void captureSession(Session& session, Effect* mandelbrot, Julia* julia,
+                    int palettePreset, int colorMode);
+void applySession(const Session& session, Effect* mandelbrot, Julia* julia,
+                  int& palettePreset, int& colorMode);
+bool saveBookmark(int slot, Effect* mandelbrot, Julia* julia,
+                  int palettePreset, int colorMode);
+bool loadBookmark(int slot, Effect* mandelbrot, Julia* julia,
+                  int& palettePreset, int& colorMode);
+
+// Width of the iteration maps cached with each bookmark
+#define BOOKMARK_THUMBNAIL 240
+
+// Width of the images R renders with the shaders, 8K
+#define PRINT_SIZE 7680
+
 // UI Mouse events
 void onMenuMousePress(sf::Event event);
 void onMenuMouseMove(sf::Event event);
@@ -40,14 +145,64 @@ void onMenuMouseRelease(sf::Event event);
 ////////////////////////////////////////////////////////////
 int main(int argc, char* argv[])
 {
+    // Headless modes
+    if (argc > 1 && std::string(argv[1]) == "--export")
+        return exportMap(argc, argv);
+    if (argc > 1 && std::string(argv[1]) == "--render")
+        return renderBatch(argc, argv);
+    if (argc > 1 && std::string(argv[1]) == "--worker")
+        return runWorker(argc, argv);
+    if (argc > 1 && std::string(argv[1]) == "--expmap")
+        return renderExpMap(argc, argv);
+    if (argc > 1 && std::string(argv[1]) == "--expmap-frames")
+        return expMapFrames(argc, argv);
+    if (argc > 1 && std::string(argv[1]) == "--golden")
+        return runGolden(argc, argv);
+
+    // Input logs, --record writes the events of this run and --replay
+    // plays a log back in a hidden window and reports the latency
+    std::string recordPath, replayPath, reportPath;
+    for (int i = 1; i + 1 < argc; ++i)
+    {
+        std::string arg = argv[i];
+        if (arg == "--record")
+            recordPath = argv[++i];
+        else if (arg == "--replay")
+            replayPath = argv[++i];
+        else if (arg == "--report")
+            reportPath = argv[++i];
+    }
+
+    EventRecorder recorder;
+    if (!recordPath.empty() && !recorder.open(recordPath))
+    {
+        std::cerr << "Could not write " << recordPath << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    EventPlayer player;
+    bool replaying = !replayPath.empty();
+    if (replaying && !player.loadFromFile(replayPath))
+    {
+        std::cerr << "Could not read " << replayPath << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    LatencyMeter latency;
+
     // Create the openGl rendering context, not actually necessary
     sf::ContextSettings contextSettings;
 
     // Create the main window
-    sf::RenderWindow window(sf::VideoMode(1920, 1080), "SFML Shader", 
+    sf::RenderWindow window(sf::VideoMode(2 * PANE_SIZE,
+                                    PANE_SIZE + MENU_HEIGHT), "SFML Shader", 
                                     sf::Style::Default, contextSettings);
     window.setVerticalSyncEnabled(true);
 
+    // A replay still draws every frame, just not on screen
+    if (replaying)
+        window.setVisible(false);
+
     // Load our font for all of the text
     sf::Font font;
     if (!font.loadFromFile("resources/sansation.ttf"))
@@ -62,17 +217,29 @@ int main(int argc, char* argv[])
     // Create the fractals, and keep individual handles
     Julia * julia = new Julia;
     Mandlebrot * mandelbrot = new Mandlebrot;
+    Buddhabrot * buddhabrot = new Buddhabrot;
+    JuliaAtlas * atlas = new JuliaAtlas;
+    Mandelbulb * bulb = new Mandelbulb;
 
     // Store the fractals in a vector for easy manipulation later
     effects.push_back(mandelbrot);
     effects.push_back(julia);
 
+    // Everything that can be shown in the right pane, only the one
+    // in effects[1] is updated and drawn
+    std::vector<Effect*> rightPanes;
+    rightPanes.push_back(julia);
+    rightPanes.push_back(buddhabrot);
+    rightPanes.push_back(atlas);
+    rightPanes.push_back(bulb);
+
     // Keep track of the effect that the mouse is currently hovering over
     std::size_t currentEffect = 0;
 
     // Initialize them the effects, this loads the shaders from file
-    for (std::size_t i = 0; i < effects.size(); ++i)
-        effects[i]->load();
+    effects[0]->load();
+    for (std::size_t i = 0; i < rightPanes.size(); ++i)
+        rightPanes[i]->load();
 
     ////////////////
     // Checkboxes //
@@ -88,10 +255,9 @@ int main(int argc, char* argv[])
     checkboxCheckTexture.setSmooth(true);
 
     // Create the sprite for our checkbox check symbol
-    sf::Sprite * checkboxCheck = new sf::Sprite(checkboxCheckTexture);
-    checkboxCheck->setPosition(0, 520);
-    checkboxCheck->scale(sf::Vector2f(0.2f, 0.2f));
-    checkboxCheck->setColor(sf::Color(160, 0, 0));
+    sf::Sprite checkboxCheck(checkboxCheckTexture);
+    checkboxCheck.scale(sf::Vector2f(0.2f, 0.2f));
+    checkboxCheck.setColor(sf::Color(160, 0, 0));
 
     // Load our box texture for the checkbox
     sf::Texture checkboxTexture;
@@ -103,52 +269,91 @@ int main(int argc, char* argv[])
     checkboxTexture.setSmooth(true);
 
     // Create the sprite for our checkboxes
-    sf::Sprite * checkbox = new sf::Sprite(checkboxTexture);
-    checkbox->setPosition(0, 520);
-    checkbox->scale(sf::Vector2f(0.15f, 0.15f));
+    sf::Sprite checkbox(checkboxTexture);
+    checkbox.scale(sf::Vector2f(0.15f, 0.15f));
 
 
 
     // Make the checkboxes
 
     // Log log enable
-    sf::Text* logText = new sf::Text("Log Shading", font, 20);
-    logText->setColor(sf::Color(80, 80, 80));
+    sf::Text logText("Log Shading", font, 20);
+    logText.setColor(sf::Color(80, 80, 80));
 
     Checkbox * logCheckbox = new Checkbox(checkbox, checkboxCheck,
                                             logText, "LogShading");
-    logCheckbox->setPosition(10, 980);
+    logCheckbox->setPosition(10, PANE_SIZE + 20);
     logCheckbox->setChecked(true);
 
 
     // Iterations scaling
-    sf::Text* iterationsText = new sf::Text("Scale Iterations", font, 20);
-    iterationsText->setColor(sf::Color(80, 80, 80));
+    sf::Text iterationsText("Scale Iterations", font, 20);
+    iterationsText.setColor(sf::Color(80, 80, 80));
 
     Checkbox * iterCheckbox = new Checkbox(checkbox, checkboxCheck, 
                                             iterationsText, "ScaleIterations");
-    iterCheckbox->setPosition(300, 980);
+    iterCheckbox->setPosition(300, PANE_SIZE + 20);
     iterCheckbox->setChecked(true);
 
 
     // Almond bread
-    sf::Text* almondBreadText = new sf::Text("Almond Bread", font, 20);
-    almondBreadText->setColor(sf::Color(80, 80, 80));
+    sf::Text almondBreadText("Almond Bread", font, 20);
+    almondBreadText.setColor(sf::Color(80, 80, 80));
 
     Checkbox * almondBread = new Checkbox(checkbox, checkboxCheck, 
                                             almondBreadText, "AlmondBread");
-    almondBread->setPosition(600, 980);
+    almondBread->setPosition(600, PANE_SIZE + 20);
     almondBread->setChecked(false);
 
 
     // Emulate double precision
-    sf::Text* emulateDoubleText = new sf::Text("Emulate Double", font, 20);
-    emulateDoubleText->setColor(sf::Color(80, 80, 80));
+    sf::Text emulateDoubleText("Emulate Double", font, 20);
+    emulateDoubleText.setColor(sf::Color(80, 80, 80));
 
     Checkbox * emulateDouble = new Checkbox(checkbox, checkboxCheck, 
                                             emulateDoubleText, "EmulateDouble");
-    emulateDouble->setPosition(900, 980);
+    emulateDouble->setPosition(900, PANE_SIZE + 20);
     emulateDouble->setChecked(false);
+
+
+    // Distance estimation
+    sf::Text distanceText("Distance Estimation", font, 20);
+    distanceText.setColor(sf::Color(80, 80, 80));
+
+    Checkbox * distanceEstimation = new Checkbox(checkbox, checkboxCheck,
+                                            distanceText, "DistanceEstimation");
+    distanceEstimation->setPosition(10, PANE_SIZE + 55);
+    distanceEstimation->setChecked(false);
+
+
+    // Histogram equalized palette
+    sf::Text equalizeText("Equalize Palette", font, 20);
+    equalizeText.setColor(sf::Color(80, 80, 80));
+
+    Checkbox * equalize = new Checkbox(checkbox, checkboxCheck,
+                                            equalizeText, "EqualizePalette");
+    equalize->setPosition(300, PANE_SIZE + 55);
+    equalize->setChecked(false);
+
+
+    // Skip and stop interior points early
+    sf::Text interiorText("Interior Detection", font, 20);
+    interiorText.setColor(sf::Color(80, 80, 80));
+
+    Checkbox * interiorDetection = new Checkbox(checkbox, checkboxCheck,
+                                            interiorText, "InteriorDetection");
+    interiorDetection->setPosition(600, PANE_SIZE + 55);
+    interiorDetection->setChecked(false);
+
+
+    // Float or emulated double per tile, whichever the zoom needs
+    sf::Text autoPrecisionText("Auto Precision", font, 20);
+    autoPrecisionText.setColor(sf::Color(80, 80, 80));
+
+    Checkbox * autoPrecision = new Checkbox(checkbox, checkboxCheck,
+                                            autoPrecisionText, "AutoPrecision");
+    autoPrecision->setPosition(900, PANE_SIZE + 55);
+    autoPrecision->setChecked(true);
     
 
     /////////////
@@ -163,22 +368,22 @@ int main(int argc, char* argv[])
         return EXIT_FAILURE;
     }
     sliderButtonTexture.setSmooth(true);
-    sf::Sprite * sliderButton = new sf::Sprite(sliderButtonTexture);
-    sliderButton->scale(sf::Vector2f(0.5f, 0.5f));
+    sf::Sprite sliderButton(sliderButtonTexture);
+    sliderButton.scale(sf::Vector2f(0.5f, 0.5f));
 
     // Make the sliders
     Slider * redSlider = new Slider(sliderButton, 100, "Red Coefficient");
-    redSlider->setPosition(1400, 980);
+    redSlider->setPosition(2 * PANE_SIZE - 520, PANE_SIZE + 20);
     redSlider->setColor(sf::Color(190, 40, 40));
     redSlider->setValue(0.1);
 
     Slider * blueSlider = new Slider(sliderButton, 100, "Blue Coefficient");
-    blueSlider->setPosition(1400, 1000);
+    blueSlider->setPosition(2 * PANE_SIZE - 520, PANE_SIZE + 40);
     blueSlider->setColor(sf::Color(40, 190, 40));
     blueSlider->setValue(0.32);
 
     Slider * greenSlider = new Slider(sliderButton, 100, "Green Coefficient");
-    greenSlider->setPosition(1400, 1020);
+    greenSlider->setPosition(2 * PANE_SIZE - 520, PANE_SIZE + 60);
     greenSlider->setColor(sf::Color(40, 40, 190));
     greenSlider->setValue(0.48);
 
@@ -191,6 +396,10 @@ int main(int argc, char* argv[])
     checkboxes.push_back(almondBread);
     checkboxes.push_back(iterCheckbox);
     checkboxes.push_back(emulateDouble);
+    checkboxes.push_back(distanceEstimation);
+    checkboxes.push_back(equalize);
+    checkboxes.push_back(interiorDetection);
+    checkboxes.push_back(autoPrecision);
 
     // Populate sliders vector
     sliders.push_back(redSlider);
@@ -199,34 +408,81 @@ int main(int argc, char* argv[])
 
     // Create the instructions text
     sf::Text instructions("Press escape to quit.", font, 20);
-    instructions.setPosition(1720, 1050);
+    instructions.setPosition(2 * PANE_SIZE - 200, PANE_SIZE + 90);
     instructions.setColor(sf::Color(80, 80, 80));
 
     // Create the color coefficients text
     sf::Text colorLabel("Color Coefficients:", font, 20);
-    colorLabel.setPosition(1200, 980);
+    colorLabel.setPosition(2 * PANE_SIZE - 720, PANE_SIZE + 20);
     colorLabel.setColor(sf::Color(80, 80, 80));
 
+    // Create the status text, only rebuilt when it changes
+    CachedText description;
+    description.getText().setFont(font);
+    description.getText().setCharacterSize(20);
+    description.getText().setPosition(10, PANE_SIZE + 90);
+    description.getText().setColor(sf::Color(0, 80, 80));
+
+#ifndef NDEBUG
+    // Heap allocations of the last frame
+    unsigned long frameAllocations = 0;
+#endif
+
     // Create the separators
     sf::RectangleShape bottomSeparator;
-    bottomSeparator.setPosition(0.,1080.-120.);
-    bottomSeparator.setSize(sf::Vector2f(1920.,1.));
+    bottomSeparator.setPosition(0., PANE_SIZE);
+    bottomSeparator.setSize(sf::Vector2f(2 * PANE_SIZE, 1.));
     bottomSeparator.setFillColor(sf::Color(12, 12, 12));
 
     // Keep track of the current mouse coordinates
     float mouseX = 0.0, mouseY = 0.0;
 
     // Keep track of the frame of the current fractal
-    sf::Vector3f currentFrame;
+    sf::Vector3<double> currentFrame;
+
+    // Palette used by both fractals
+    int palettePreset = PaletteCosine;
+    int colorMode = ColorEscape;
+
+    // Pick up where the last run left off, logs start from the default
+    // view so they replay the same anywhere
+    Session lastSession;
+    if (!recorder.isOpen() && !replaying &&
+         lastSession.loadFromFile("last.session"))
+        applySession(lastSession, mandelbrot, julia, palettePreset,
+                     colorMode);
 
     // Start the game loop
     sf::Clock clock;
     while (window.isOpen())
     {
-        // Process events
+#ifndef NDEBUG
+        unsigned long frameStart = AllocationCounter::getCount();
+#endif
+
+        // Process events, a replay drops what the hidden window gets
+        // and feeds in the logged ones that are due
         sf::Event event;
-        while (window.pollEvent(event))
+        LoggedEvent logged;
+        if (replaying)
+            while (window.pollEvent(event)) {}
+
+        sf::Int64 now = clock.getElapsedTime().asMicroseconds();
+        while (replaying ? player.poll(now, logged) : window.pollEvent(event))
         {
+            if (replaying)
+            {
+                event = logged.event;
+                latency.onEvent(logged);
+            }
+            else
+            {
+                recorder.write(clock.getElapsedTime().asMicroseconds(),
+                               event);
+            }
+
+            Effect::trackButtons(event);
+
             // Close window: exit
             if (event.type == sf::Event::Closed)
                 window.close();
@@ -253,6 +509,144 @@ int main(int argc, char* argv[])
                         effects[currentEffect]->setFrame(currentFrame);
                         break;
 
+                    // Back to the render a shown map was zoomed in from
+                    case sf::Keyboard::BackSpace:
+                        effects[currentEffect]->zoomOut();
+                        break;
+
+                    // Toggle the orbit density view in the right pane
+                    case sf::Keyboard::B:
+                        if (effects[1] == buddhabrot)
+                        {
+                            buddhabrot->pause();
+                            effects[1] = julia;
+                        }
+                        else
+                        {
+                            bulb->pause();
+                            effects[1] = buddhabrot;
+                        }
+                        break;
+
+                    // Zoom the Julia out to its bounding radius
+                    case sf::Keyboard::F:
+                        julia->fitToHint();
+                        break;
+
+                    // Toggle the grid of Julia thumbnails in the right pane
+                    case sf::Keyboard::A:
+                        if (effects[1] == atlas)
+                            effects[1] = julia;
+                        else
+                        {
+                            buddhabrot->pause();
+                            bulb->pause();
+                            effects[1] = atlas;
+                        }
+                        break;
+
+                    // Cycle the right pane through the Mandelbulb, the
+                    // Mandelbox and back to the Julia
+                    case sf::Keyboard::M:
+                        if (effects[1] != bulb)
+                        {
+                            buddhabrot->pause();
+                            bulb->setShape(ShapeMandelbulb);
+                            effects[1] = bulb;
+                        }
+                        else if (bulb->getShape() == ShapeMandelbulb)
+                            bulb->setShape(ShapeMandelbox);
+                        else
+                        {
+                            bulb->pause();
+                            effects[1] = julia;
+                        }
+                        break;
+
+                    // Save the raw render of the current fractal
+                    case sf::Keyboard::S:
+                        effects[currentEffect]->saveIterationMap(
+                            effects[currentEffect]->getName() + ".fxim");
+                        break;
+
+                    // Bring a saved render back without recomputing it
+                    case sf::Keyboard::L:
+                        if (effects[currentEffect]->loadIterationMap(
+                             effects[currentEffect]->getName() + ".fxim"))
+                        {
+                            // The checkboxes would change the view again
+                            almondBread->setChecked(
+                                effects[currentEffect]->getAlmond());
+                            logCheckbox->setChecked(
+                                effects[currentEffect]->getLogShading());
+                        }
+                        break;
+
+                    // Export the loaded render with the current palette
+                    case sf::Keyboard::E:
+                        effects[currentEffect]->exportImage(
+                            effects[currentEffect]->getName() + ".png");
+                        break;
+
+                    // Render the current view with the shaders at print
+                    // size, this holds the window for a few seconds
+                    case sf::Keyboard::R:
+                        effects[currentEffect]->renderImage(
+                            effects[currentEffect]->getName() + "-print.png",
+                            PRINT_SIZE);
+                        break;
+
+                    // Bookmarks, control saves and a plain press jumps
+                    case sf::Keyboard::Num1:
+                    case sf::Keyboard::Num2:
+                    case sf::Keyboard::Num3:
+                    case sf::Keyboard::Num4:
+                    case sf::Keyboard::Num5:
+                    case sf::Keyboard::Num6:
+                    case sf::Keyboard::Num7:
+                    case sf::Keyboard::Num8:
+                    case sf::Keyboard::Num9:
+                    {
+                        int slot = event.key.code - sf::Keyboard::Num1 + 1;
+                        if (event.key.control)
+                        {
+                            if (!saveBookmark(slot, mandelbrot, julia,
+                                              palettePreset, colorMode))
+                                std::cerr << "Could not save bookmark "
+                                          << slot << std::endl;
+                        }
+                        else if (!loadBookmark(slot, mandelbrot, julia,
+                                               palettePreset, colorMode))
+                            std::cerr << "Could not load bookmark " << slot
+                                      << std::endl;
+                        break;
+                    }
+
+                    // Cycle through the palette presets
+                    case sf::Keyboard::P:
+                        palettePreset = (palettePreset + 1) %
+                                            PalettePresetCount;
+                        break;
+
+                    // Cycle through escape time, atom domains, periods,
+                    // stripes and the orbit traps
+                    case sf::Keyboard::C:
+                        colorMode = (colorMode + 1) % ColorModeCount;
+                        break;
+
+                    // Show the precision every tile is rendered in
+                    case sf::Keyboard::D:
+                        mandelbrot->setShowPrecision(
+                                            !mandelbrot->getShowPrecision());
+                        julia->setShowPrecision(mandelbrot->getShowPrecision());
+                        break;
+
+                    // Switch between the Buddhabrot and the Nebulabrot
+                    case sf::Keyboard::N:
+                        buddhabrot->setNebulabrot(
+                                            !buddhabrot->getNebulabrot());
+                        break;
+
                     default:
                         break;
                 }
@@ -266,7 +660,7 @@ int main(int argc, char* argv[])
             // Handle mouse pressed events
             if (event.type == sf::Event::MouseButtonPressed)
             {
-                if (event.mouseButton.y > 960.)
+                if (event.mouseButton.y > PANE_SIZE)
                 {
                     onMenuMousePress(event);
                 }
@@ -279,20 +673,38 @@ int main(int argc, char* argv[])
                     if (event.mouseButton.button == sf::Mouse::Left && 
                          currentEffect == 0)
                     {
-                        sf::Vector3f frame;
+                        sf::Vector3<double> frame;
                         // Rebase the mouse coordinates
-                        float mx = event.mouseButton.x;
-                        float my = 960.0-event.mouseButton.y;
+                        double mx = event.mouseButton.x;
+                        double my = PANE_SIZE-event.mouseButton.y;
 
                         // Get the current frame
-                        frame = sf::Vector3f(effects[0]->getFrame());
+                        frame = effects[0]->getFrame();
 
                         // Transform the mouse to imaginary coordinates
-                        float real = ((mx)*frame.z)/960.0 - frame.z/2.0-frame.x;
-                        float imag = ((my)*frame.z)/960.0 - frame.z/2.0-frame.y;
+                        double real = ((mx)*frame.z)/PANE_SIZE -
+                                      frame.z/2.0-frame.x;
+                        double imag = ((my)*frame.z)/PANE_SIZE -
+                                      frame.z/2.0-frame.y;
+
+                        // Update the julia fractal with new C values, a
+                        // loaded Mandlebrot map already knows about C
+                        IterationSample known;
+                        julia->setJuliaC(sf::Vector2<double>(real, imag),
+                            effects[0]->findSample(real, imag,
+                                julia->getMaxIterations(), known) ?
+                                &known : NULL);
+                        julia->setDragging(true);
+                    }
 
-                        // Update the julia fractal with new C values
-                        julia->setJuliaC(sf::Vector2f(real, imag));
+                    // Picking a thumbnail brings its Julia back up
+                    sf::Vector2<double> atlasC;
+                    if (event.mouseButton.button == sf::Mouse::Left &&
+                         effects[1] == atlas && atlas->getC(sf::Vector2f(
+                          event.mouseButton.x, event.mouseButton.y), atlasC))
+                    {
+                        julia->setJuliaC(atlasC);
+                        effects[1] = julia;
                     }
                 }
             }
@@ -300,8 +712,12 @@ int main(int argc, char* argv[])
             // Handle mouse released events
             if (event.type == sf::Event::MouseButtonReleased)
             {
+                // Back to the full Julia render once C stops moving
+                if (event.mouseButton.button == sf::Mouse::Left)
+                    julia->setDragging(false);
+
                 // Inform the current effect
-                if (event.mouseButton.y < 960. || 
+                if (event.mouseButton.y < PANE_SIZE || 
                      effects[currentEffect]->isInteracting())
 
                     effects[currentEffect]->mouseButtonReleased(event);
@@ -313,7 +729,10 @@ int main(int argc, char* argv[])
             // Handle mouse moved events
             if (event.type == sf::Event::MouseMoved)
             {
-                if (event.mouseMove.y > 960.)
+                atlas->setHover(sf::Vector2f(event.mouseMove.x,
+                                             event.mouseMove.y));
+
+                if (event.mouseMove.y > PANE_SIZE)
                 {
                     onMenuMouseMove(event);
                 }
@@ -321,21 +740,27 @@ int main(int argc, char* argv[])
                 {
                     effects[currentEffect]->mouseMoved(event);
 
-                    if (sf::Mouse::isButtonPressed(sf::Mouse::Left) && 
+                    if (Effect::isButtonDown(sf::Mouse::Left) && 
                          currentEffect == 0)
                     {
-                        sf::Vector3f frame;
-                        float mx = event.mouseMove.x;
-                        float my = 960.0-event.mouseMove.y;
+                        sf::Vector3<double> frame;
+                        double mx = event.mouseMove.x;
+                        double my = PANE_SIZE-event.mouseMove.y;
 
-                        frame = sf::Vector3f(effects[0]->getFrame());
+                        frame = effects[0]->getFrame();
 
                         // Transform the mouse to imaginary coordinates
-                        float real = ((mx)*frame.z)/960.0 - frame.z/2.0-frame.x;
-                        float imag = ((my)*frame.z)/960.0 - frame.z/2.0-frame.y;
+                        double real = ((mx)*frame.z)/PANE_SIZE -
+                                      frame.z/2.0-frame.x;
+                        double imag = ((my)*frame.z)/PANE_SIZE -
+                                      frame.z/2.0-frame.y;
 
                         // Update the julia with new C values
-                        julia->setJuliaC(sf::Vector2f(real, imag));
+                        IterationSample known;
+                        julia->setJuliaC(sf::Vector2<double>(real, imag),
+                            effects[0]->findSample(real, imag,
+                                julia->getMaxIterations(), known) ?
+                                &known : NULL);
                     }
                     else
                     {
@@ -347,6 +772,9 @@ int main(int argc, char* argv[])
             }
         }
         
+        // The atlas covers whatever the Mandlebrot shows
+        atlas->setRegion(mandelbrot->getKernelParams());
+
         // Update the parameters for each of the fractals
         for (std::size_t i = 0; i < effects.size(); ++i)
         {
@@ -355,6 +783,13 @@ int main(int argc, char* argv[])
             effects[i]->setLogShading(logCheckbox->isChecked());
             effects[i]->setIterationScaling(iterCheckbox->isChecked());
             effects[i]->setEmulated(emulateDouble->isChecked());
+            effects[i]->setAutoPrecision(autoPrecision->isChecked());
+            effects[i]->setDistanceEstimation(
+                                        distanceEstimation->isChecked());
+            effects[i]->setPalettePreset(palettePreset);
+            effects[i]->setEqualize(equalize->isChecked());
+            effects[i]->setInteriorDetection(interiorDetection->isChecked());
+            effects[i]->setColorMode(colorMode);
             effects[i]->setColoring(sf::Vector3f(redSlider->getValue(),
                                                   greenSlider->getValue(), 
                                                    blueSlider->getValue()));
@@ -372,22 +807,27 @@ int main(int argc, char* argv[])
         currentFrame = effects[currentEffect]->getFrame();
 
         // Get the C values of the current Julia
-        sf::Vector2f juliaC = julia->getJuliaC();
+        sf::Vector2<double> juliaC = julia->getJuliaC();
 
         // Calculate the number of iterations
-        int maxItValue=70;
-        if (iterCheckbox->isChecked())
-            maxItValue = sqrt(2.*sqrt(fabs(1.-sqrt(5./currentFrame.z))))*66.5;
+        int maxItValue = effects[currentEffect]->getMaxIterations();
 
-        // Create the status string
-        sprintf(temp,"X: %f Y: %f Zoom: %f A: %f B: %f Iterations: %d", 
+        // Create the status string, %f of a large value has no bound
+        // so it is cut to the buffer
+        snprintf(temp, sizeof(temp), "X: %f Y: %f Zoom: %f A: %f B: %f "
+                 "Iterations: %d Palette: %s Color: %s",
                  currentFrame.x, currentFrame.y, currentFrame.z, 
-                  juliaC.x, juliaC.y, maxItValue);
+                  juliaC.x, juliaC.y, maxItValue,
+                   Palette::getPresetName(palettePreset),
+                    Palette::getColorModeName(colorMode));
+
+#ifndef NDEBUG
+        std::size_t length = strlen(temp);
+        snprintf(temp + length, sizeof(temp) - length, " Allocations: %lu",
+                 frameAllocations);
+#endif
 
-        // Draw the status text
-        sf::Text description(temp, font, 20);
-        description.setPosition(10, 1050);
-        description.setColor(sf::Color(0, 80, 80));
+        description.setString(temp);
 
         // Draw the text
         window.draw(instructions);
@@ -407,12 +847,12 @@ int main(int argc, char* argv[])
         if (!effects[currentEffect]->isInteracting())
         {
             // We are over the mandelbrot
-            if (mouseX < 960 && mouseY < 960)
+            if (mouseX < PANE_SIZE && mouseY < PANE_SIZE)
             {
                 currentEffect = 0;
             }
             // We are over the julia
-            else if (mouseX > 960 && mouseY < 960)
+            else if (mouseX > PANE_SIZE && mouseY < PANE_SIZE)
             {
                 currentEffect = 1;
             }
@@ -420,11 +860,46 @@ int main(int argc, char* argv[])
 
         // Finally, display the rendered frame on screen
         window.display();
+
+#ifndef NDEBUG
+        frameAllocations = AllocationCounter::getCount() - frameStart;
+#endif
+
+        if (replaying)
+        {
+            sf::Int64 shown = clock.getElapsedTime().asMicroseconds();
+            latency.onFrame(shown, effects[0]->isComplete() &&
+                                   effects[1]->isComplete());
+
+            // Done once every event is answered, or given up on
+            if (player.isFinished() && (latency.isSettled() ||
+                 shown > player.getEndTime() + REPLAY_SETTLE_TIME))
+                window.close();
+        }
+    }
+
+    if (replaying)
+    {
+        latency.writeSummary(std::cout);
+
+        if (!reportPath.empty())
+        {
+            std::ofstream report(reportPath.c_str());
+            latency.writeEvents(report);
+        }
+    }
+    else
+    {
+        // Remember the layout and view for next time
+        captureSession(lastSession, mandelbrot, julia, palettePreset,
+                       colorMode);
+        lastSession.saveToFile("last.session");
     }
 
     // Delete the effects
-    for (std::size_t i = 0; i < effects.size(); ++i)
-        delete effects[i];
+    delete effects[0];
+    for (std::size_t i = 0; i < rightPanes.size(); ++i)
+        delete rightPanes[i];
     // And the checkboxes
     for (std::size_t i = 0; i < checkboxes.size(); ++i)
         delete checkboxes[i];
@@ -435,6 +910,819 @@ int main(int argc, char* argv[])
     return EXIT_SUCCESS;
 }
 
+////////////////////////////////////////////////////////////
+/// Color a saved iteration map into an image without a window
+///
+/// shader --export <map.fxim> <image.png> [palette] [--equalize]
+///        [--atoms | --periods | --stripes | --trap point|line|cross]
+///
+/// The stripes and traps need a map rendered with --traps.
+///
+////////////////////////////////////////////////////////////
+int exportMap(int argc, char* argv[])
+{
+    if (argc < 4)
+    {
+        std::cerr << "Usage: " << argv[0] << " --export <map.fxim> "
+                  << "<image.png> [palette] [--equalize] "
+                  << "[--atoms | --periods | --stripes | "
+                  << "--trap point|line|cross]" << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    IterationMap map;
+    if (!map.loadFromFile(argv[2]))
+    {
+        std::cerr << "Could not load " << argv[2] << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    // Same defaults as the sliders
+    Palette palette;
+    palette.setCoefficients(sf::Vector3f(0.1, 0.48, 0.32));
+    palette.setRange(map.getParams().maxIterations + 2.0);
+
+    for (int i = 4; i < argc; ++i)
+    {
+        std::string arg = argv[i];
+        if (arg == "--equalize")
+            palette.setEqualize(true);
+        else if (arg == "--atoms")
+            palette.setColorMode(ColorAtomDomain);
+        else if (arg == "--periods")
+            palette.setColorMode(ColorPeriod);
+        else if (arg == "--stripes")
+            palette.setColorMode(ColorStripes);
+        else if (arg == "--trap" && i + 1 < argc)
+        {
+            std::string trap = argv[++i];
+            if (trap == "point")
+                palette.setColorMode(ColorTrapPoint);
+            else if (trap == "line")
+                palette.setColorMode(ColorTrapLine);
+            else if (trap == "cross")
+                palette.setColorMode(ColorTrapCross);
+            else
+            {
+                std::cerr << "Unknown trap " << trap << std::endl;
+                return EXIT_FAILURE;
+            }
+        }
+        else
+            palette.setPreset(atoi(argv[i]) % PalettePresetCount);
+    }
+
+    if (palette.getEqualize())
+        map.fillHistogram(palette);
+
+    palette.bake();
+
+    std::vector<sf::Uint8> pixels;
+    map.colorize(palette, pixels);
+
+    sf::Image image;
+    image.create(map.getWidth(), map.getHeight(), &pixels[0]);
+    if (!image.saveToFile(argv[3]))
+        return EXIT_FAILURE;
+
+    return EXIT_SUCCESS;
+}
+
+////////////////////////////////////////////////////////////
+/// Render frames on a farm of worker processes without a window
+///
+/// shader --render <out.png|out.fxim> [--frame x y zoom]
+///        [--julia a b] [--almond] [--distance] [--interior] [--traps]
+///        [--fixed] [--size n] [--iterations n] [--frames n]
+///        [--zoom-step f] [--workers n] [--compression n]
+///        [--crash-after n]
+///
+/// --fixed renders every plain tile it can in fixed point, so the
+/// frames come out the same whichever machines worked on them.
+/// --compression is the zlib level of images, 0 writes them
+/// uncompressed which is fastest when they are only an
+/// intermediate step.
+///
+////////////////////////////////////////////////////////////
+int renderBatch(int argc, char* argv[])
+{
+    if (argc < 3)
+    {
+        std::cerr << "Usage: " << argv[0] << " --render <out.png|out.fxim> "
+                  << "[--frame x y zoom] [--julia a b] [--almond] "
+                  << "[--distance] [--interior] [--traps] [--fixed] "
+                  << "[--size n] [--iterations n] [--frames n] "
+                  << "[--zoom-step f] [--workers n] [--compression n]"
+                  << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    // Same starting view as the Mandlebrot pane
+    FarmJob job;
+    job.params.x = 0.0;
+    job.params.y = 0.0;
+    job.params.zoom = 4.0;
+    job.params.juliaA = 0.0;
+    job.params.juliaB = 0.0;
+    job.params.julia = false;
+    job.params.almond = false;
+    job.params.logShading = true;
+    job.params.maxIterations = 70.0f;
+    job.params.size = PANE_SIZE;
+    job.features = KernelPlain;
+    job.frames = 1;
+    job.zoomStep = 0.5;
+    job.output = argv[2];
+
+    int workers = std::max<int>(getCoreCount(), 1);
+    int crashAfter = 0;
+    int compression = Z_DEFAULT_COMPRESSION;
+    bool iterationsSet = false;
+
+    for (int i = 3; i < argc; ++i)
+    {
+        std::string arg = argv[i];
+        bool more = i + 1 < argc;
+
+        if (arg == "--frame" && i + 3 < argc)
+        {
+            job.params.x = atof(argv[++i]);
+            job.params.y = atof(argv[++i]);
+            job.params.zoom = atof(argv[++i]);
+        }
+        else if (arg == "--julia" && i + 2 < argc)
+        {
+            job.params.julia = true;
+            job.params.juliaA = atof(argv[++i]);
+            job.params.juliaB = atof(argv[++i]);
+        }
+        else if (arg == "--almond")
+            job.params.almond = true;
+        else if (arg == "--distance")
+            job.features |= KernelDistance;
+        else if (arg == "--interior")
+            job.features |= KernelInterior;
+        else if (arg == "--traps")
+            job.features |= KernelTraps;
+        else if (arg == "--fixed")
+            job.features |= KernelFixedPoint;
+        else if (arg == "--size" && more)
+            job.params.size = std::max(atoi(argv[++i]), 1);
+        else if (arg == "--iterations" && more)
+        {
+            job.params.maxIterations = atof(argv[++i]);
+            iterationsSet = true;
+        }
+        else if (arg == "--frames" && more)
+            job.frames = std::max(atoi(argv[++i]), 1);
+        else if (arg == "--zoom-step" && more)
+            job.zoomStep = atof(argv[++i]);
+        else if (arg == "--workers" && more)
+            workers = std::max(atoi(argv[++i]), 0);
+        else if (arg == "--crash-after" && more)
+            crashAfter = atoi(argv[++i]);
+        else if (arg == "--compression" && more)
+            compression = std::min(std::max(atoi(argv[++i]), 0), 9);
+        else
+        {
+            std::cerr << "Unknown option " << arg << std::endl;
+            return EXIT_FAILURE;
+        }
+    }
+
+    // The almond transform is not analytic, it has no distance estimate
+    if (job.params.almond)
+        job.features &= ~KernelDistance;
+
+    // Deep zoom movies need the same iteration scaling as the window
+    if (!iterationsSet && job.frames > 1)
+    {
+        double zoom = job.params.zoom * pow(job.zoomStep, job.frames - 1);
+        job.params.maxIterations = std::max(70.0,
+            sqrt(2 * sqrt(fabs(1 - sqrt(5 / zoom)))) * 66.5);
+    }
+
+    // Frames go out a row of tiles at a time, any --size fits in memory,
+    // and are colored, encoded and written while the rest renders
+    FrameWriter writer(compression);
+    RenderCoordinator coordinator;
+    if (!coordinator.run(job, workers, argv[0], writer, crashAfter))
+        return EXIT_FAILURE;
+
+    return EXIT_SUCCESS;
+}
+
+////////////////////////////////////////////////////////////
+/// Worker half of --render, started by the coordinator or by
+/// hand on another machine
+///
+/// shader --worker <host> <port> [--crash-after n]
+///
+////////////////////////////////////////////////////////////
+int runWorker(int argc, char* argv[])
+{
+    if (argc < 4)
+    {
+        std::cerr << "Usage: " << argv[0] << " --worker <host> <port>"
+                  << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    int crashAfter = 0;
+    if (argc > 5 && std::string(argv[4]) == "--crash-after")
+        crashAfter = atoi(argv[5]);
+
+    RenderWorker worker;
+    return worker.run(argv[2], atoi(argv[3]), crashAfter);
+}
+
+////////////////////////////////////////////////////////////
+/// Render the exponential map of a zoom into the center of a
+/// frame, size is the width of the frames it will be turned into
+///
+/// shader --expmap <strip.fxim> [--frame x y zoom] [--end-zoom z]
+///        [--julia a b] [--almond] [--distance] [--interior] [--traps]
+///        [--size n] [--width n] [--iterations n]
+///
+////////////////////////////////////////////////////////////
+int renderExpMap(int argc, char* argv[])
+{
+    if (argc < 3)
+    {
+        std::cerr << "Usage: " << argv[0] << " --expmap <strip.fxim> "
+                  << "[--frame x y zoom] [--end-zoom z] [--julia a b] "
+                  << "[--almond] [--distance] [--interior] [--traps] "
+                  << "[--size n] [--width n] [--iterations n]" << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    // Same starting view as the Mandlebrot pane
+    KernelParams params;
+    params.x = 0.0;
+    params.y = 0.0;
+    params.zoom = 4.0;
+    params.juliaA = 0.0;
+    params.juliaB = 0.0;
+    params.julia = false;
+    params.almond = false;
+    params.logShading = true;
+    params.maxIterations = 0.0f;
+    params.size = 0;
+
+    int features = KernelPlain;
+    double endZoom = 1e-10;
+    int size = PANE_SIZE;
+
+    for (int i = 3; i < argc; ++i)
+    {
+        std::string arg = argv[i];
+        bool more = i + 1 < argc;
+
+        if (arg == "--frame" && i + 3 < argc)
+        {
+            params.x = atof(argv[++i]);
+            params.y = atof(argv[++i]);
+            params.zoom = atof(argv[++i]);
+        }
+        else if (arg == "--end-zoom" && more)
+            endZoom = atof(argv[++i]);
+        else if (arg == "--julia" && i + 2 < argc)
+        {
+            params.julia = true;
+            params.juliaA = atof(argv[++i]);
+            params.juliaB = atof(argv[++i]);
+        }
+        else if (arg == "--almond")
+            params.almond = true;
+        else if (arg == "--distance")
+            features |= KernelDistance;
+        else if (arg == "--interior")
+            features |= KernelInterior;
+        else if (arg == "--traps")
+            features |= KernelTraps;
+        else if (arg == "--size" && more)
+            size = std::max(atoi(argv[++i]), 1);
+        else if (arg == "--width" && more)
+            params.size = std::max(atoi(argv[++i]), 1);
+        else if (arg == "--iterations" && more)
+            params.maxIterations = atof(argv[++i]);
+        else
+        {
+            std::cerr << "Unknown option " << arg << std::endl;
+            return EXIT_FAILURE;
+        }
+    }
+
+    // The almond transform is not analytic, it has no distance estimate
+    if (params.almond)
+        features &= ~KernelDistance;
+
+    if (endZoom <= 0.0 || endZoom >= params.zoom)
+    {
+        std::cerr << "The end zoom has to be inside the frame" << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    // Around the edge of a frame a strip pixel is as wide as a frame
+    // pixel at pi times the frame width, further in it is narrower
+    if (params.size == 0)
+        params.size = static_cast<int>(ceil(PI * size));
+
+    // The deepest frame needs the most, the same scaling as the window
+    if (params.maxIterations <= 0.0f)
+        params.maxIterations = std::max(70.0,
+            sqrt(2 * sqrt(fabs(1 - sqrt(5 / endZoom)))) * 66.5);
+
+    IterationMap strip;
+    strip.create(params, params.size, getExpMapRows(params, endZoom, size),
+                 getFeatureChannels(features));
+
+    ExpMapRenderer renderer;
+    renderer.render(params, features, strip);
+
+    if (!strip.saveToFile(argv[2]))
+    {
+        std::cerr << "Could not write " << argv[2] << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    std::cout << "Wrote " << argv[2] << " (" << strip.getWidth() << "x"
+              << strip.getHeight() << ")" << std::endl;
+    return EXIT_SUCCESS;
+}
+
+////////////////////////////////////////////////////////////
+/// Turn an exponential map back into the frames of its zoom,
+/// by default every frame down to the deepest the strip holds
+///
+/// shader --expmap-frames <strip.fxim> <out.png|out.fxim>
+///        [--frames n] [--zoom-step f] [--size n] [--compression n]
+///
+////////////////////////////////////////////////////////////
+int expMapFrames(int argc, char* argv[])
+{
+    if (argc < 4)
+    {
+        std::cerr << "Usage: " << argv[0] << " --expmap-frames <strip.fxim> "
+                  << "<out.png|out.fxim> [--frames n] [--zoom-step f] "
+                  << "[--size n] [--compression n]" << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    IterationMap strip;
+    if (!strip.loadFromFile(argv[2]) ||
+         strip.getLayout() != LayoutExponential)
+    {
+        std::cerr << "Could not load the strip " << argv[2] << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    // Frame names and spacing work like --render
+    FarmJob job;
+    job.params = strip.getParams();
+    job.frames = 0;
+    job.zoomStep = 0.5;
+    job.output = argv[3];
+
+    int size = PANE_SIZE;
+    int compression = Z_DEFAULT_COMPRESSION;
+
+    for (int i = 4; i < argc; ++i)
+    {
+        std::string arg = argv[i];
+        bool more = i + 1 < argc;
+
+        if (arg == "--frames" && more)
+            job.frames = std::max(atoi(argv[++i]), 1);
+        else if (arg == "--zoom-step" && more)
+            job.zoomStep = atof(argv[++i]);
+        else if (arg == "--size" && more)
+            size = std::max(atoi(argv[++i]), 1);
+        else if (arg == "--compression" && more)
+            compression = std::min(std::max(atoi(argv[++i]), 0), 9);
+        else
+        {
+            std::cerr << "Unknown option " << arg << std::endl;
+            return EXIT_FAILURE;
+        }
+    }
+
+    if (job.zoomStep <= 0.0 || job.zoomStep >= 1.0)
+    {
+        std::cerr << "The zoom step has to be between 0 and 1" << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    // The innermost row is half a pixel of the deepest frame
+    double endZoom = 2.0 * size *
+                     getExpMapRowRadius(job.params, strip.getHeight() - 1);
+    if (job.frames == 0)
+        job.frames = 1 + static_cast<int>(log(endZoom / job.params.zoom) /
+                                          log(job.zoomStep));
+
+    int channels = 0;
+    for (int c = ChannelDistance; c < ChannelCount; ++c)
+        if (strip.hasChannel(c))
+            channels |= 1 << c;
+
+    // The next frame is resampled while the last ones are written
+    FrameWriter writer(compression);
+    for (int i = 0; i < job.frames; ++i)
+    {
+        IterationMap* frame = new IterationMap;
+        resampleExpMap(strip, job.params.zoom * pow(job.zoomStep, i), size,
+                       *frame);
+
+        std::string path = getFramePath(job, i);
+        if (!writer.begin(frame->getParams(), channels, path) ||
+             !writer.write(frame, 0) || !writer.end())
+        {
+            std::cout << "Could not write " << path << std::endl;
+            return EXIT_FAILURE;
+        }
+    }
+
+    return writer.finish() ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+////////////////////////////////////////////////////////////
+/// Golden image regression check of the CPU kernels. update
+/// renders the references into an existing directory, check
+/// renders everything again and fails on any kernel that moved
+/// off its references, leaving a heatmap of the changed pixels
+/// next to them. check also compares the shaders when it can.
+///
+/// shader --golden <check|update> [directory]
+///
+////////////////////////////////////////////////////////////
+int runGolden(int argc, char* argv[])
+{
+    std::string mode = argc > 2 ? argv[2] : "";
+    if (mode != "check" && mode != "update")
+    {
+        std::cerr << "Usage: " << argv[0] << " --golden <check|update> "
+                  << "[directory]" << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    std::string directory = argc > 3 ? argv[3] : "golden";
+    bool update = mode == "update";
+    bool passed = true;
+
+    int count;
+    const GoldenView* views = getGoldenViews(count);
+    for (int v = 0; v < count; ++v)
+    {
+        const GoldenView& view = views[v];
+        KernelParams params = getGoldenParams(view, GOLDEN_SIZE);
+        int channels = getFeatureChannels(view.features);
+
+        // Everything is also measured against the most precise kernel
+        IterationMap exact;
+        exact.create(params, GOLDEN_SIZE, GOLDEN_SIZE, channels);
+        renderGolden(GoldenDoubleDouble, params, view.features, exact);
+
+        for (int backend = 0; backend < GoldenBackendCount; ++backend)
+        {
+            if (!canRunGolden(backend, params, view.features))
+                continue;
+
+            IterationMap map;
+            map.create(params, GOLDEN_SIZE, GOLDEN_SIZE, channels);
+            renderGolden(backend, params, view.features, map);
+
+            std::string path = getGoldenPath(directory, view.name, backend);
+            if (update)
+            {
+                if (!map.saveToFile(path))
+                {
+                    std::cerr << "Could not write " << path << std::endl;
+                    return EXIT_FAILURE;
+                }
+
+                std::cout << "Wrote " << path << std::endl;
+                continue;
+            }
+
+            IterationMap reference;
+            if (!reference.loadFromFile(path) ||
+                 reference.getWidth() != GOLDEN_SIZE ||
+                 reference.getHeight() != GOLDEN_SIZE ||
+                 reference.getParams() != params)
+            {
+                std::cerr << "Missing or outdated " << path << std::endl;
+                passed = false;
+                continue;
+            }
+
+            std::vector<sf::Uint8> heatmap;
+            GoldenResult error = compareGolden(map, exact, heatmap);
+            GoldenResult result = compareGolden(map, reference, heatmap);
+
+            double pixels = GOLDEN_SIZE * GOLDEN_SIZE;
+            bool ok = result.mismatches <= GOLDEN_BUDGET * pixels;
+
+            char line[256];
+            sprintf(line, "%-12s %-14s %6.2f%% changed (max %.3g)  "
+                    "%6.2f%% off double-double  %s", view.name,
+                    getGoldenBackendName(backend),
+                    100.0 * result.mismatches / pixels, result.maxDifference,
+                    100.0 * error.mismatches / pixels, ok ? "ok" : "FAILED");
+            std::cout << line << std::endl;
+
+            if (!ok)
+            {
+                passed = false;
+
+                std::string heatmapPath =
+                    path.substr(0, path.size() - 5) + "-diff.png";
+
+                sf::Image image;
+                image.create(GOLDEN_SIZE, GOLDEN_SIZE, &heatmap[0]);
+                if (image.saveToFile(heatmapPath))
+                    std::cout << "  see " << heatmapPath << std::endl;
+            }
+        }
+    }
+
+    if (!update && !checkGoldenShaders(directory))
+        passed = false;
+
+    return passed ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+////////////////////////////////////////////////////////////
+/// Draw the golden views with the float and double-single
+/// shaders and compare their colors to the CPU kernel of the
+/// same precision. The shaders run with the cap of the window,
+/// so the CPU side is rendered again rather than read from the
+/// references. Passes with a message when there is no OpenGL.
+////////////////////////////////////////////////////////////
+bool checkGoldenShaders(const std::string& directory)
+{
+#if !defined(_WIN32) && !defined(__APPLE__)
+    // SFML aborts when it can not open the X display
+    if (!getenv("DISPLAY"))
+    {
+        std::cout << "GLSL shaders skipped, no display to create an "
+                  << "OpenGL context on" << std::endl;
+        return true;
+    }
+#endif
+
+    Mandlebrot mandelbrot;
+    Julia julia;
+    mandelbrot.load();
+    julia.load();
+
+    std::vector<sf::Uint8> pixels;
+    if (!mandelbrot.renderShader(false, GOLDEN_SIZE, pixels))
+    {
+        std::cout << "GLSL shaders skipped, no OpenGL context with "
+                  << "shaders and render textures" << std::endl;
+        return true;
+    }
+
+    bool passed = true;
+
+    int count;
+    const GoldenView* views = getGoldenViews(count);
+    for (int v = 0; v < count; ++v)
+    {
+        const GoldenView& view = views[v];
+        Effect* effect = view.julia ? static_cast<Effect*>(&julia) :
+                                      &mandelbrot;
+
+        // Julia C is hinted with the cap, it must be set first
+        effect->setIterationScaling(true);
+        effect->setKernelParams(getGoldenParams(view, GOLDEN_SIZE));
+        effect->setDistanceEstimation((view.features & KernelDistance) != 0);
+        effect->setInteriorDetection((view.features & KernelInterior) != 0);
+        effect->setColorMode((view.features & KernelTraps) ? ColorStripes :
+                                                             ColorEscape);
+        effect->setEqualize(false);
+        effect->update();
+
+        KernelParams params = effect->getKernelParams();
+        params.size = GOLDEN_SIZE;
+        int features = effect->getFeatures();
+
+        for (int shader = 0; shader < GoldenShaderCount; ++shader)
+        {
+            int backend = getGoldenShaderBackend(shader);
+            if (!canRunGolden(backend, params, features))
+                continue;
+
+            const char* name = getGoldenShaderName(shader);
+            if (!effect->renderShader(shader == GoldenShaderEmulated,
+                                      GOLDEN_SIZE, pixels))
+            {
+                std::cerr << "Could not draw " << view.name << " with "
+                          << name << std::endl;
+                passed = false;
+                continue;
+            }
+
+            IterationMap map;
+            map.create(params, GOLDEN_SIZE, GOLDEN_SIZE,
+                       getFeatureChannels(features));
+            renderGolden(backend, params, features, map);
+
+            std::vector<sf::Uint8> reference, heatmap;
+            map.colorize(effect->getPalette(), reference);
+            GoldenResult result = compareGoldenPixels(pixels, reference,
+                                                      heatmap);
+
+            double total = GOLDEN_SIZE * GOLDEN_SIZE;
+            bool ok = result.mismatches <= GOLDEN_SHADER_BUDGET * total;
+
+            char line[256];
+            sprintf(line, "%-12s %-18s %6.2f%% changed (max %.3g)  "
+                    "against %s  %s", view.name, name,
+                    100.0 * result.mismatches / total, result.maxDifference,
+                    getGoldenBackendName(backend), ok ? "ok" : "FAILED");
+            std::cout << line << std::endl;
+
+            if (!ok)
+            {
+                passed = false;
+
+                std::string heatmapPath =
+                    getGoldenShaderPath(directory, view.name, shader);
+
+                sf::Image image;
+                image.create(GOLDEN_SIZE, GOLDEN_SIZE, &heatmap[0]);
+                if (image.saveToFile(heatmapPath))
+                    std::cout << "  see " << heatmapPath << std::endl;
+            }
+        }
+    }
+
+    return passed;
+}
+
+// Store everything needed to come back to the current layout and view
+void captureSession(Session& session, Effect* mandelbrot, Julia* julia,
+                    int palettePreset, int colorMode)
+{
+    session.clear();
+
+    session.setFrame("mandlebrot.frame", mandelbrot->getFrame());
+    session.setFrame("julia.frame", julia->getFrame());
+
+    sf::Vector2<double> juliaC = julia->getJuliaC();
+    session.setDouble("julia.a", juliaC.x);
+    session.setDouble("julia.b", juliaC.y);
+
+    session.setValue("formula", mandelbrot->getAlmond() ? "almond" : "z^2+c");
+    session.setFloat("palette", palettePreset);
+    session.setFloat("color", colorMode);
+
+    for (std::size_t i = 0; i < checkboxes.size(); ++i)
+        session.setBool("checkbox." + checkboxes[i]->getName(),
+                        checkboxes[i]->isChecked());
+
+    for (std::size_t i = 0; i < sliders.size(); ++i)
+        session.setFloat("slider." + sliders[i]->getName(),
+                         sliders[i]->getValue());
+}
+
+// Whether value is a number and not an infinity, false for NaN
+bool isFinite(double value)
+{
+    return value >= -DBL_MAX && value <= DBL_MAX;
+}
+
+// Frame from a session, false when it is missing or no usable view
+bool getSessionFrame(const Session& session, const std::string& key,
+                     sf::Vector3<double>& frame)
+{
+    sf::Vector3<double> value;
+    if (!session.getFrame(key, value) || !isFinite(value.x) ||
+         !isFinite(value.y) || !isFinite(value.z) || value.z <= 0.0)
+        return false;
+
+    frame = value;
+    return true;
+}
+
+// Index in [0, count) from a session, false when missing or out of range
+bool getSessionIndex(const Session& session, const std::string& key,
+                     int count, int& index)
+{
+    float value;
+    if (!session.getFloat(key, value) || !(value >= 0.0f && value < count))
+        return false;
+
+    index = static_cast<int>(value);
+    return true;
+}
+
+////////////////////////////////////////////////////////////
+/// Restore a session, anything missing from it is left alone
+/// and so is anything out of range, the file may have been
+/// edited by hand
+////////////////////////////////////////////////////////////
+void applySession(const Session& session, Effect* mandelbrot, Julia* julia,
+                  int& palettePreset, int& colorMode)
+{
+    sf::Vector3<double> frame;
+    if (getSessionFrame(session, "mandlebrot.frame", frame))
+        mandelbrot->setFrame(frame);
+    if (getSessionFrame(session, "julia.frame", frame))
+        julia->setFrame(frame);
+
+    sf::Vector2<double> juliaC = julia->getJuliaC();
+    double value;
+    if (session.getDouble("julia.a", value) && isFinite(value))
+        juliaC.x = value;
+    if (session.getDouble("julia.b", value) && isFinite(value))
+        juliaC.y = value;
+    julia->setJuliaC(juliaC);
+
+    getSessionIndex(session, "palette", PalettePresetCount, palettePreset);
+    getSessionIndex(session, "color", ColorModeCount, colorMode);
+
+    for (std::size_t i = 0; i < checkboxes.size(); ++i)
+    {
+        bool checked;
+        if (session.getBool("checkbox." + checkboxes[i]->getName(), checked))
+            checkboxes[i]->setChecked(checked);
+    }
+
+    for (std::size_t i = 0; i < sliders.size(); ++i)
+    {
+        // Sliders run from 0 to 1, NaN fails both compares
+        float value;
+        if (session.getFloat("slider." + sliders[i]->getName(), value) &&
+             value == value)
+            sliders[i]->setValue(std::min(std::max(value, 0.0f), 1.0f));
+    }
+
+    // The formula wins over the checkbox it is drawn from
+    std::string formula;
+    if (session.getValue("formula", formula))
+    {
+        for (std::size_t i = 0; i < checkboxes.size(); ++i)
+            if (checkboxes[i]->getName() == "AlmondBread")
+                checkboxes[i]->setChecked(formula == "almond");
+    }
+}
+
+std::string getBookmarkPath(int slot, const std::string& suffix)
+{
+    std::ostringstream path;
+    path << "bookmark" << slot << suffix;
+    return path.str();
+}
+
+////////////////////////////////////////////////////////////
+/// Save the session along with small iteration maps of both
+/// views. A refinement in progress makes way for the maps, a
+/// save in progress keeps a map from being written and the
+/// bookmark is reported as not saved.
+////////////////////////////////////////////////////////////
+bool saveBookmark(int slot, Effect* mandelbrot, Julia* julia,
+                  int palettePreset, int colorMode)
+{
+    Session session;
+    captureSession(session, mandelbrot, julia, palettePreset, colorMode);
+    bool saved = session.saveToFile(getBookmarkPath(slot, ".session"));
+
+    saved &= mandelbrot->saveIterationMap(
+                 getBookmarkPath(slot, ".mandlebrot.fxim"),
+                 BOOKMARK_THUMBNAIL);
+    saved &= julia->saveIterationMap(getBookmarkPath(slot, ".julia.fxim"),
+                                     BOOKMARK_THUMBNAIL);
+
+    return saved;
+}
+
+////////////////////////////////////////////////////////////
+/// Jump to a bookmark. The cached maps are up on the very next
+/// frame and full size renders replace them in the background,
+/// so deep locations never start from a cold render. refine()
+/// cancels a refinement of the view left, and waits out a save.
+////////////////////////////////////////////////////////////
+bool loadBookmark(int slot, Effect* mandelbrot, Julia* julia,
+                  int& palettePreset, int& colorMode)
+{
+    Session session;
+    if (!session.loadFromFile(getBookmarkPath(slot, ".session")))
+        return false;
+
+    applySession(session, mandelbrot, julia, palettePreset, colorMode);
+
+    if (mandelbrot->loadIterationMap(
+         getBookmarkPath(slot, ".mandlebrot.fxim")))
+        mandelbrot->refine();
+
+    if (julia->loadIterationMap(getBookmarkPath(slot, ".julia.fxim")))
+        julia->refine();
+
+    return true;
+}
+
 // Update all relevant effects on a mouse press event
 void onMenuMousePress(sf::Event event)
 {
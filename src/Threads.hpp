@@ -0,0 +1,178 @@
+#ifndef THREADS_HPP
+#define THREADS_HPP
+
+////////////////////////////////////////////////////////////
+// Headers
+////////////////////////////////////////////////////////////
+#include <SFML/System.hpp>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <unistd.h>
+#include <pthread.h>
+#endif
+
+////////////////////////////////////////////////////////////
+// Small helpers shared by the CPU engines
+////////////////////////////////////////////////////////////
+
+// Number of cores to spread CPU work over
+inline unsigned int getCoreCount()
+{
+#ifdef _WIN32
+    SYSTEM_INFO info;
+    GetSystemInfo(&info);
+    long count = info.dwNumberOfProcessors;
+#else
+    long count = sysconf(_SC_NPROCESSORS_ONLN);
+#endif
+
+    return count > 0 ? static_cast<unsigned int>(count) : 1;
+}
+
+// xorshift64* generator, one per thread since rand() is shared
+class Random
+{
+public :
+
+    explicit Random(sf::Uint64 seed = 1)
+    {
+        setSeed(seed);
+    }
+
+    void setSeed(sf::Uint64 seed)
+    {
+        // Zero is the one state xorshift can not leave
+        m_state = seed ? seed : 0x9E3779B97F4A7C15ULL;
+    }
+
+    sf::Uint64 next()
+    {
+        m_state ^= m_state >> 12;
+        m_state ^= m_state << 25;
+        m_state ^= m_state >> 27;
+        return m_state * 2685821657736338717ULL;
+    }
+
+    // Uniform in [0, 1)
+    double uniform()
+    {
+        return (next() >> 11) * (1.0 / 9007199254740992.0);
+    }
+
+    // Uniform in [low, high)
+    double uniform(double low, double high)
+    {
+        return low + (high - low) * uniform();
+    }
+
+private :
+
+    sf::Uint64 m_state;
+};
+
+////////////////////////////////////////////////////////////
+/// Lets a thread sleep until another one has something for it,
+/// which SFML has no condition variable for. It counts calls to
+/// notify() and keeps its own lock, so it works next to any
+/// sf::Mutex: a waiting thread takes a ticket, checks whatever
+/// it waits for under the mutex that guards it, and if it has
+/// to wait, wait(ticket) returns as soon as notify() was called
+/// since the ticket was taken. A notify() in between is not lost.
+////////////////////////////////////////////////////////////
+class Condition : sf::NonCopyable
+{
+public :
+
+    Condition() :
+    m_count(0)
+    {
+#ifdef _WIN32
+        InitializeCriticalSection(&m_lock);
+        InitializeConditionVariable(&m_condition);
+#else
+        pthread_mutex_init(&m_lock, NULL);
+        pthread_cond_init(&m_condition, NULL);
+#endif
+    }
+
+    ~Condition()
+    {
+#ifdef _WIN32
+        DeleteCriticalSection(&m_lock);
+#else
+        pthread_cond_destroy(&m_condition);
+        pthread_mutex_destroy(&m_lock);
+#endif
+    }
+
+    unsigned int getTicket()
+    {
+        lock();
+        unsigned int count = m_count;
+        unlock();
+
+        return count;
+    }
+
+    // Block until notify() is called after ticket was taken
+    void wait(unsigned int ticket)
+    {
+        lock();
+        while (m_count == ticket)
+        {
+#ifdef _WIN32
+            SleepConditionVariableCS(&m_condition, &m_lock, INFINITE);
+#else
+            pthread_cond_wait(&m_condition, &m_lock);
+#endif
+        }
+        unlock();
+    }
+
+    // Wake every waiting thread
+    void notify()
+    {
+        lock();
+        ++m_count;
+#ifdef _WIN32
+        WakeAllConditionVariable(&m_condition);
+#else
+        pthread_cond_broadcast(&m_condition);
+#endif
+        unlock();
+    }
+
+private :
+
+    void lock()
+    {
+#ifdef _WIN32
+        EnterCriticalSection(&m_lock);
+#else
+        pthread_mutex_lock(&m_lock);
+#endif
+    }
+
+    void unlock()
+    {
+#ifdef _WIN32
+        LeaveCriticalSection(&m_lock);
+#else
+        pthread_mutex_unlock(&m_lock);
+#endif
+    }
+
+    unsigned int m_count;
+
+#ifdef _WIN32
+    CRITICAL_SECTION m_lock;
+    CONDITION_VARIABLE m_condition;
+#else
+    pthread_mutex_t m_lock;
+    pthread_cond_t m_condition;
+#endif
+};
+
+#endif // THREADS_HPP
@@ -0,0 +1,326 @@
+#ifndef VIEWCACHE_HPP
+#define VIEWCACHE_HPP
+
+////////////////////////////////////////////////////////////
+// Headers
+////////////////////////////////////////////////////////////
+#include "Kernel.hpp"
+#include "Precision.hpp"
+#include "IterationMap.hpp"
+
+#include <SFML/System.hpp>
+
+#include <deque>
+#include <algorithm>
+#include <cmath>
+
+////////////////////////////////////////////////////////////
+// Renders of recent views, so zooming into a map starts from
+// the part of it that is still on screen and zooming back out
+// needs no render at all. A parent is any cached map whose view
+// covers the new one, the finest of them is used.
+////////////////////////////////////////////////////////////
+
+// Finished renders kept, a 960 wide map with every channel is 18 MB
+#define VIEW_CACHE_LEVELS 6
+
+// Whether parent shows the same fractal and every point of child
+inline bool coversView(const KernelParams& parent, const KernelParams& child)
+{
+    if (parent.julia != child.julia || parent.almond != child.almond ||
+         (parent.julia && (parent.juliaA != child.juliaA ||
+                            parent.juliaB != child.juliaB)))
+        return false;
+
+    double margin = (parent.zoom - child.zoom) * 0.5;
+    return margin >= 0.0 && fabs(parent.x - child.x) <= margin &&
+           fabs(parent.y - child.y) <= margin;
+}
+
+// Width of a pixel of map in the plane
+inline double getPixelSpacing(const IterationMap& map)
+{
+    return map.getParams().zoom / map.getWidth();
+}
+
+// Pixel column of parent at column x of child
+inline double getParentColumn(const KernelParams& parent,
+                              const KernelParams& child, double x)
+{
+    double offset = (x / child.size - 0.5) * child.zoom +
+                    parent.x - child.x;
+
+    return (offset / parent.zoom + 0.5) * parent.size;
+}
+
+// Pixel row of parent at row y of child, rows go down while
+// imaginary parts go up
+inline double getParentRow(const KernelParams& parent,
+                           const KernelParams& child, double y)
+{
+    double offset = (y / child.size - 0.5) * child.zoom -
+                    (parent.y - child.y);
+
+    return (offset / parent.zoom + 0.5) * parent.size;
+}
+
+////////////////////////////////////////////////////////////
+/// The part of parent covered by params, about as many pixels
+/// wide as parent has there and scaled up when drawn. Each
+/// pixel takes the nearest parent sample.
+////////////////////////////////////////////////////////////
+inline void cropView(const IterationMap& parent, const KernelParams& params,
+                     IterationMap& preview)
+{
+    const KernelParams& parentParams = parent.getParams();
+
+    KernelParams cropParams = params;
+    int size = static_cast<int>(ceil(params.zoom / parentParams.zoom *
+                                     parent.getWidth()));
+    cropParams.size = std::min(std::max(size, 1), params.size);
+
+    int channels = 0;
+    for (int c = ChannelDistance; c < ChannelCount; ++c)
+        if (parent.hasChannel(c))
+            channels |= 1 << c;
+
+    preview.create(cropParams, cropParams.size, cropParams.size, channels);
+
+    std::vector<IterationSample> row(cropParams.size);
+    for (int y = 0; y < cropParams.size; ++y)
+    {
+        double parentY = getParentRow(parentParams, cropParams, y + 0.5);
+        int sourceY = std::min(static_cast<int>(parentY),
+                               parent.getHeight() - 1);
+
+        for (int x = 0; x < cropParams.size; ++x)
+        {
+            double parentX = getParentColumn(parentParams, cropParams,
+                                             x + 0.5);
+            int sourceX = std::min(static_cast<int>(parentX),
+                                   parent.getWidth() - 1);
+
+            row[x] = parent.getSample(std::max(sourceX, 0),
+                                      std::max(sourceY, 0));
+        }
+
+        preview.store(0, y, cropParams.size, 1, &row[0], cropParams.size);
+    }
+}
+
+////////////////////////////////////////////////////////////
+/// Whether parent has nothing but inside pixels over a tile of
+/// params, with a ring of one parent pixel around it so that
+/// detail between parent pixels at the tile edge is not missed
+////////////////////////////////////////////////////////////
+inline bool isInsideInParent(const IterationMap& parent,
+                             const KernelParams& params,
+                             int left, int top, int width, int height)
+{
+    const KernelParams& parentParams = parent.getParams();
+
+    int x0 = static_cast<int>(floor(getParentColumn(parentParams, params,
+                                                    left))) - 1;
+    int x1 = static_cast<int>(ceil(getParentColumn(parentParams, params,
+                                                   left + width))) + 1;
+    int y0 = static_cast<int>(floor(getParentRow(parentParams, params,
+                                                 top))) - 1;
+    int y1 = static_cast<int>(ceil(getParentRow(parentParams, params,
+                                                top + height))) + 1;
+
+    if (x0 < 0 || y0 < 0 || x1 > parent.getWidth() ||
+         y1 > parent.getHeight())
+        return false;
+
+    for (int y = y0; y < y1; ++y)
+    {
+        const float* color = parent.getRow(ChannelColor, y);
+        for (int x = x0; x < x1; ++x)
+            if (color[x] > 0.0f)
+                return false;
+    }
+
+    return true;
+}
+
+// Whether inside regions of a render can be filled from their border.
+// Inside samples of the interior kernel differ in period and atom,
+// those of the trap kernel in their traps, and the almond transform
+// is not analytic so its sets may have holes.
+inline bool canFillInside(const KernelParams& params, int features)
+{
+    return !(features & (KernelInterior | KernelTraps)) && !params.almond;
+}
+
+////////////////////////////////////////////////////////////
+/// Render a tile that is expected to be inside. Points that do
+/// not escape within the cap form a set without holes, so when
+/// the whole border stays inside so does everything it encloses
+/// and only the border is iterated. Otherwise the rest of the
+/// tile is rendered too. The precision and reference orbit are
+/// the ones of the whole tile, so every pixel comes out as in
+/// an unhinted render. Returns whether the tile was filled.
+////////////////////////////////////////////////////////////
+inline bool renderFilledTile(const KernelParams& params, int features,
+                             IterationSample* out, int stride,
+                             int left, int top, int width, int height,
+                             ReferenceOrbit* orbit = NULL)
+{
+    if (width < 3 || height < 3)
+    {
+        renderTileAuto(params, features, out, stride, left, top,
+                       width, height, orbit);
+        return false;
+    }
+
+    ReferenceOrbit ownOrbit;
+    ReferenceOrbit& reference = orbit ? *orbit : ownOrbit;
+    int precision = prepareTile(params, features, reference, left, top,
+                                width, height);
+
+    int right = width - 1, bottom = height - 1;
+    IterationSample* lastRow = out + bottom * stride;
+    IterationSample* middle = out + stride;
+
+    renderTileIn(precision, reference, params, features, out, stride,
+                 left, top, width, 1);
+    renderTileIn(precision, reference, params, features, lastRow, stride,
+                 left, top + bottom, width, 1);
+    renderTileIn(precision, reference, params, features, middle, stride,
+                 left, top + 1, 1, height - 2);
+    renderTileIn(precision, reference, params, features, middle + right,
+                 stride, left + right, top + 1, 1, height - 2);
+
+    bool inside = true;
+    for (int x = 0; x < width && inside; ++x)
+        inside = out[x].color <= 0.0f && lastRow[x].color <= 0.0f;
+    for (int y = 1; y < bottom && inside; ++y)
+        inside = out[y * stride].color <= 0.0f &&
+                 out[y * stride + right].color <= 0.0f;
+
+    if (!inside)
+    {
+        renderTileIn(precision, reference, params, features, middle + 1,
+                     stride, left + 1, top + 1, width - 2, height - 2);
+        return false;
+    }
+
+    for (int y = 1; y < bottom; ++y)
+        std::fill(out + y * stride + 1, out + y * stride + right, out[0]);
+
+    return true;
+}
+
+////////////////////////////////////////////////////////////
+/// The last VIEW_CACHE_LEVELS finished renders, owned by the
+/// cache while they are in it
+////////////////////////////////////////////////////////////
+class ViewCache : sf::NonCopyable
+{
+public :
+
+    ~ViewCache()
+    {
+        clear();
+    }
+
+    // Keep a finished render, a cached render of the same view and the
+    // oldest one past VIEW_CACHE_LEVELS are dropped
+    void insert(IterationMap* map)
+    {
+        for (std::size_t i = 0; i < m_levels.size(); ++i)
+        {
+            if (m_levels[i]->getParams() == map->getParams())
+            {
+                delete m_levels[i];
+                m_levels.erase(m_levels.begin() + i);
+                break;
+            }
+        }
+
+        m_levels.push_back(map);
+        if (m_levels.size() > VIEW_CACHE_LEVELS)
+        {
+            delete m_levels.front();
+            m_levels.pop_front();
+        }
+    }
+
+    // A render of exactly params with at least channels, handed back to
+    // the caller, or NULL
+    IterationMap* take(const KernelParams& params, int channels)
+    {
+        for (std::size_t i = 0; i < m_levels.size(); ++i)
+        {
+            IterationMap* map = m_levels[i];
+            if (map->getParams() == params && map->getWidth() == params.size &&
+                 hasChannels(*map, channels))
+            {
+                m_levels.erase(m_levels.begin() + i);
+                return map;
+            }
+        }
+
+        return NULL;
+    }
+
+    // The newest render that covers more than params, or NULL
+    IterationMap* takeOuter(const KernelParams& params)
+    {
+        for (std::size_t i = m_levels.size(); i-- > 0;)
+        {
+            IterationMap* map = m_levels[i];
+            if (map->getParams().zoom > params.zoom &&
+                 coversView(map->getParams(), params))
+            {
+                m_levels.erase(m_levels.begin() + i);
+                return map;
+            }
+        }
+
+        return NULL;
+    }
+
+    // The cached render with the smallest pixels that covers params,
+    // stays in the cache
+    const IterationMap* findParent(const KernelParams& params) const
+    {
+        const IterationMap* parent = NULL;
+        for (std::size_t i = 0; i < m_levels.size(); ++i)
+        {
+            const IterationMap* map = m_levels[i];
+            if (map->getLayout() != LayoutGrid ||
+                 !coversView(map->getParams(), params))
+                continue;
+
+            if (!parent || getPixelSpacing(*map) < getPixelSpacing(*parent))
+                parent = map;
+        }
+
+        return parent;
+    }
+
+    void clear()
+    {
+        for (std::size_t i = 0; i < m_levels.size(); ++i)
+            delete m_levels[i];
+
+        m_levels.clear();
+    }
+
+private :
+
+    static bool hasChannels(const IterationMap& map, int channels)
+    {
+        for (int c = 0; c < ChannelCount; ++c)
+            if ((channels & (1 << c)) && !map.hasChannel(c))
+                return false;
+
+        return true;
+    }
+
+    // Oldest first
+    std::deque<IterationMap*> m_levels;
+};
+
+#endif // VIEWCACHE_HPP
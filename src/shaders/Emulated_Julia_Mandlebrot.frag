@@ -11,14 +11,52 @@ uniform float Ycenter;
 uniform float JuliaA;
 uniform float JuliaB;
 
-uniform float R;
-uniform float G;
-uniform float B;
+// What Xcenter, Ycenter, JuliaA and JuliaB lost to float rounding,
+// the view is kept in double
+uniform vec2 CenterLow;
+uniform vec2 JuliaLow;
+
+// Where the pane is, its bottom left corner in gl_FragCoord units,
+// and how many pixels wide it is. Offscreen renders move the
+// corner to draw any part of a larger image.
+uniform vec2 PaneOrigin;
+uniform float PaneSize;
+
+// Attracting cycle point of the Julia, orbits that come within
+// TrapRadius of it never escape. 0 turns the test off.
+uniform float TrapRadius;
+uniform vec2 TrapCenter;
+
+// Colors are looked up in a table that is baked once per frame
+uniform sampler2D Palette;
+uniform float ColorRange;
 
 // Interface Parameters
 uniform bool Almond;
 uniform bool LogShading;
 uniform bool Julia;
+uniform bool DistanceEstimation;
+
+// Stop orbits that come back to themselves and track atom domains
+uniform bool InteriorDetection;
+
+// Disks known to be inside components of the Mandlebrot, xy is the
+// nucleus, z the radius and w the period. Keep the size in sync with
+// INTERIOR_COMPONENTS. Counts are floats, like every other uniform.
+uniform vec4 Components[16];
+uniform float ComponentCount;
+
+// Follow the orbit for the stripe and trap colorings, the same as
+// OrbitTraps on the CPU
+uniform bool OrbitTraps;
+
+// 0 escape time, 1 atom domains, 2 escape time with interior periods,
+// 3 stripes, 4 point trap, 5 line trap, 6 cross trap
+uniform float ColorMode;
+
+// Same as in Kernel.hpp and Palette.hpp
+#define STRIPE_DENSITY 5.0
+#define TRAP_DECADES 4.0
 
 out vec4 FragColor;
 
@@ -109,47 +147,111 @@ vec2 ds_set(float a)
  return z;
 }
 
+// Table color at t in [0, 1], the table is PALETTE_SIZE (4096) wide
+vec3 paletteColor(float t)
+{
+  return texture(Palette, vec2((clamp(t, 0.0, 1.0) * 4095.0 + 0.5)
+                               / 4096.0, 0.5)).rgb;
+}
+
+// Periods and atom domains get colors spread around the table
+vec3 periodColor(float period)
+{
+  return texture(Palette, vec2((fract(period * 0.618034) * 4095.0 + 0.5)
+                               / 4096.0, 0.5)).rgb;
+}
+
 /////////////////
 // Main Shader //
 /////////////////
 void main()
 {
-  vec2 xCo = ds_mul(ds_mul(ds_set(gl_FragCoord.x),ds_set(Zoom)),ds_set(1.0/960.0));
-  vec2 yCo = ds_mul(ds_mul(ds_set(gl_FragCoord.y-120),ds_set(Zoom)),ds_set(1.0/960.0));
+  vec2 pane = gl_FragCoord.xy - PaneOrigin;
+  vec2 xCo = ds_mul(ds_mul(ds_set(pane.x),ds_set(Zoom)),ds_set(1.0/PaneSize));
+  vec2 yCo = ds_mul(ds_mul(ds_set(pane.y),ds_set(Zoom)),ds_set(1.0/PaneSize));
 
-  if (Julia)
-  {
-    // Adjust for the julia's position
-    xCo = ds_mul(ds_mul(ds_set(gl_FragCoord.x-960),ds_set(Zoom)),ds_set(1.0/960.0));
-  }
-
-  vec2 real = ds_sub(ds_sub(xCo, ds_set(Zoom/2.0)), ds_set(Xcenter));
-  vec2 imag = ds_sub(ds_sub(yCo, ds_set(Zoom/2.0)), ds_set(Ycenter));
+  vec2 real = ds_sub(ds_sub(xCo, ds_set(Zoom/2.0)),
+                    vec2(Xcenter, CenterLow.x));
+  vec2 imag = ds_sub(ds_sub(yCo, ds_set(Zoom/2.0)),
+                    vec2(Ycenter, CenterLow.y));
 
   vec2 Creal = real;
   vec2 Cimag = imag;
 
   if (Julia)
   {
-    Creal = ds_set(JuliaA);
-    Cimag = ds_set(JuliaB);
+    Creal = vec2(JuliaA, JuliaLow.x);
+    Cimag = vec2(JuliaB, JuliaLow.y);
   }
 
   vec2 r2 = ds_set(0.0);
 
+  // Derivative for the distance estimate, it does not need the extra
+  // precision so it is kept in plain floats
+  vec2 dz = Julia ? vec2(1.0, 0.0) : vec2(0.0, 0.0);
+  // The almond transform is not analytic, it has no complex derivative
+  // to estimate the distance with
+  bool distance = DistanceEstimation && !Almond;
+
   // Useful constants
   vec2 negOne = ds_set(-1.0);
   vec2 one = ds_set(1.0);
   vec2 ptOne = ds_set(0.1);
   vec2 two = ds_set(2.0);
 
-  float iter;
+  float iter = 0.0;
   vec2 tempreal;
 
   vec2 radius = ds_set(4.0);
 
-  for (iter = 0.0; iter < MaxIterations; ++iter)
+  // Interior checks, the distances are small so the periodicity test
+  // subtracts in double-single and keeps the high part
+  float period = 0.0;
+  float atom = Julia ? 0.0 : 1.0;
+  float minR2 = Julia ? 4.0 : real.x * real.x + imag.x * imag.x;
+  vec2 checkReal = real;
+  vec2 checkImag = imag;
+  float checkIter = 0.0;
+  float nextCheck = 1.0;
+  float epsilon = Zoom / PaneSize * 1e-3;
+
+  // Closest to the origin (squared), the real axis and either axis,
+  // and the stripe sum with its last term
+  float trapPoint = 4.0;
+  float trapLine = 4.0;
+  float trapCross = 4.0;
+  float stripeSum = 0.0;
+  float stripeLast = 0.0;
+  float stripeCount = 0.0;
+
+  if (InteriorDetection && !Julia && !Almond)
+  {
+    // Main cardioid and period two bulb
+    float q = (Creal.x - 0.25) * (Creal.x - 0.25) + Cimag.x * Cimag.x;
+    if (q * (q + (Creal.x - 0.25)) < 0.25 * Cimag.x * Cimag.x)
+      period = 1.0;
+    else if ((Creal.x + 1.0) * (Creal.x + 1.0) + Cimag.x * Cimag.x < 0.0625)
+      period = 2.0;
+
+    for (int i = 0; i < 16 && float(i) < ComponentCount && period == 0.0;
+         ++i)
+    {
+      vec2 offset = vec2(ds_sub(Creal, ds_set(Components[i].x)).x,
+                         ds_sub(Cimag, ds_set(Components[i].y)).x);
+      if (length(offset) < Components[i].z)
+        period = Components[i].w;
+    }
+  }
+
+  for (; period == 0.0 && iter < MaxIterations; ++iter)
   {
+    if (distance)
+    {
+      dz = 2.0 * vec2(real.x * dz.x - imag.x * dz.y, real.x * dz.y + imag.x * dz.x);
+      if (!Julia)
+        dz.x += 1.0;
+    }
+
     tempreal = real;
     real = ds_add(ds_sub(ds_mul(tempreal, tempreal), ds_mul(imag, imag)), Creal);
     imag = ds_add(ds_mul(ds_mul(imag, tempreal), two), Cimag);
@@ -163,15 +265,63 @@ void main()
     }
 
     r2 = ds_add(ds_mul(real, real), ds_mul(imag, imag));
+
+    // The escaping point counts too, and traps are far coarser than a
+    // float so the high parts will do
+    if (OrbitTraps)
+    {
+      vec2 z = vec2(real.x, imag.x);
+      trapPoint = min(trapPoint, dot(z, z));
+      trapLine = min(trapLine, abs(z.y));
+      trapCross = min(trapCross, min(abs(z.x), abs(z.y)));
+      stripeLast = 0.5 * sin(STRIPE_DENSITY * atan(z.y, z.x)) + 0.5;
+      stripeSum += stripeLast;
+      stripeCount += 1.0;
+    }
+
     if (ds_compare(r2, radius) > 0.0)
       break;
+
+    // The trap is far coarser than a float, the high parts will do
+    vec2 trap = vec2(real.x, imag.x) - TrapCenter;
+    if (dot(trap, trap) < TrapRadius * TrapRadius)
+      break;
+
+    if (InteriorDetection)
+    {
+      if (r2.x < minR2)
+      {
+        minR2 = r2.x;
+        atom = iter + (Julia ? 1.0 : 2.0);
+      }
+
+      vec2 d = vec2(ds_sub(real, checkReal).x, ds_sub(imag, checkImag).x);
+      if (dot(d, d) < epsilon * epsilon)
+      {
+        period = iter + 1.0 - checkIter;
+        break;
+      }
+
+      if (iter + 1.0 == nextCheck)
+      {
+        checkReal = real;
+        checkImag = imag;
+        checkIter = nextCheck;
+        nextCheck *= 2.0;
+      }
+    }
   }
 
+  // The main components are inside their own atom domain
+  if (period > 0.0 && iter == 0.0)
+    atom = period;
+
 
   // Base the color on the number of iterations
   float color;
   
-  if (ds_compare(r2, ds_set(4.0)) < 0.0)
+  bool inside = ds_compare(r2, ds_set(4.0)) < 0.0;
+  if (inside)
     color = 0.0;
   else
   {
@@ -180,9 +330,42 @@ void main()
     else
       color = iter;
   }
+
+  // Darken the pixels that are within a pixel of the boundary
+  float shade = 1.0;
+  if (distance && !inside)
+  {
+    float modulus = length(vec2(real.x, imag.x));
+    float dist = 0.5 * modulus * log(modulus) / length(dz);
+    shade = clamp(pow(dist / (Zoom / PaneSize), 0.25), 0.0, 1.0);
+  }
   
-  FragColor = vec4((-cos(R*0.25*color)+1.0)/2.0, 
-            (-cos(B*0.25*color)+1.0)/2.0, 
-            (-cos(G*0.25*color)+1.0)/2.0,
-               1.0);
+  // One lookup, the table is PALETTE_SIZE (4096) entries wide
+  vec3 rgb = vec3(0.0);
+  if (!inside)
+    rgb = paletteColor(color / ColorRange);
+
+  if (ColorMode == 1.0)
+    rgb = periodColor(atom);
+  else if (ColorMode == 2.0 && inside && period > 0.0)
+    rgb = periodColor(period);
+  else if (ColorMode == 3.0 && !inside)
+  {
+    // Mean of the stripes with and without the last point, blended
+    // by how far past the bailout the orbit went
+    float last = stripeSum / stripeCount;
+    float previous = stripeCount > 1.0 ?
+                     (stripeSum - stripeLast) / (stripeCount - 1.0) : last;
+    float blend = clamp(log2(log(r2.x) / log(4.0)), 0.0, 1.0);
+    rgb = paletteColor(mix(last, previous, blend));
+  }
+  else if (ColorMode >= 4.0)
+  {
+    // Inside points have orbits too
+    float trap = ColorMode == 4.0 ? sqrt(trapPoint) :
+                 ColorMode == 5.0 ? trapLine : trapCross;
+    rgb = paletteColor(-log(max(trap, 1e-30)) / log(10.0) / TRAP_DECADES);
+  }
+
+  FragColor = vec4(shade * rgb, 1.0);
 }
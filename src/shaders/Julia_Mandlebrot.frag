@@ -11,26 +11,73 @@ uniform float Ycenter;
 uniform float JuliaA;
 uniform float JuliaB;
 
-// Coloring coefficients
-uniform float R;
-uniform float G;
-uniform float B;
+// Where the pane is, its bottom left corner in gl_FragCoord units,
+// and how many pixels wide it is. Offscreen renders move the
+// corner to draw any part of a larger image.
+uniform vec2 PaneOrigin;
+uniform float PaneSize;
+
+// Attracting cycle point of the Julia, orbits that come within
+// TrapRadius of it never escape. 0 turns the test off.
+uniform float TrapRadius;
+uniform vec2 TrapCenter;
+
+// Colors are looked up in a table that is baked once per frame
+uniform sampler2D Palette;
+uniform float ColorRange;
 
 // Interface Parameters
 uniform bool Almond;
 uniform bool LogShading;
 uniform bool Julia;
+uniform bool DistanceEstimation;
+
+// Stop orbits that come back to themselves and track atom domains
+uniform bool InteriorDetection;
+
+// Disks known to be inside components of the Mandlebrot, xy is the
+// nucleus, z the radius and w the period. Keep the size in sync with
+// INTERIOR_COMPONENTS. Counts are floats, like every other uniform.
+uniform vec4 Components[16];
+uniform float ComponentCount;
+
+// Follow the orbit for the stripe and trap colorings, the same as
+// OrbitTraps on the CPU
+uniform bool OrbitTraps;
+
+// 0 escape time, 1 atom domains, 2 escape time with interior periods,
+// 3 stripes, 4 point trap, 5 line trap, 6 cross trap
+uniform float ColorMode;
+
+// Same as in Kernel.hpp and Palette.hpp
+#define STRIPE_DENSITY 5.0
+#define TRAP_DECADES 4.0
 
 // Color that pixel
 out vec4 FragColor;
 
+// Table color at t in [0, 1], the table is PALETTE_SIZE (4096) wide
+vec3 paletteColor(float t)
+{
+  return texture(Palette, vec2((clamp(t, 0.0, 1.0) * 4095.0 + 0.5)
+                               / 4096.0, 0.5)).rgb;
+}
+
+// Periods and atom domains get colors spread around the table
+vec3 periodColor(float period)
+{
+  return texture(Palette, vec2((fract(period * 0.618034) * 4095.0 + 0.5)
+                               / 4096.0, 0.5)).rgb;
+}
+
 void main()
 {
   // Convert our coordinate in fragment shader XY plane to
   // coordinates in the fractal's coordinate system
   // Props to Aaron for deriving this equation.
-  float real = (gl_FragCoord.x*Zoom)/960.0 - Zoom/2.0 - Xcenter;
-  float imag = ((gl_FragCoord.y-120)*Zoom)/960.0 - Zoom/2.0 - Ycenter;
+  vec2 pane = gl_FragCoord.xy - PaneOrigin;
+  float real = (pane.x*Zoom)/PaneSize - Zoom/2.0 - Xcenter;
+  float imag = (pane.y*Zoom)/PaneSize - Zoom/2.0 - Ycenter;
 
   // Initialize the C values for the mandelbrot
   float Creal = real;
@@ -39,13 +86,6 @@ void main()
   // If this is tha Julia set, adjust C accordingly
   if (Julia)
   {
-    // We need to change the coordinate coversion because the
-    // view port is located differently for the Julia
-    // There is a better way, but I could not find anyone who had
-    // done it with SFML
-    real = ((gl_FragCoord.x-960)*Zoom)/960.0 - Zoom/2.0 - Xcenter;
-    imag = ((gl_FragCoord.y-120)*Zoom)/960.0 - Zoom/2.0 - Ycenter;
-
     // Set out C for the Julia set
     Creal = JuliaA;
     Cimag = JuliaB;
@@ -53,12 +93,61 @@ void main()
 
   // r2 holds the current length squared
   float r2 = 0.0;
+  // Derivative for the distance estimate, dz/dz0 for the Julia
+  // and dz/dc for the Mandlebrot
+  vec2 dz = Julia ? vec2(1.0, 0.0) : vec2(0.0, 0.0);
+  // The almond transform is not analytic, it has no complex derivative
+  // to estimate the distance with
+  bool distance = DistanceEstimation && !Almond;
   // Keep track of our iteration count
-  float iter;
+  float iter = 0.0;
+
+  // Interior checks, the atom domain counts z1 = c for the Mandlebrot
+  float period = 0.0;
+  float atom = Julia ? 0.0 : 1.0;
+  float minR2 = Julia ? 4.0 : real * real + imag * imag;
+  vec2 check = vec2(real, imag);
+  float checkIter = 0.0;
+  float nextCheck = 1.0;
+  float epsilon = Zoom / PaneSize * 1e-3;
+
+  // Closest to the origin (squared), the real axis and either axis,
+  // and the stripe sum with its last term
+  float trapPoint = 4.0;
+  float trapLine = 4.0;
+  float trapCross = 4.0;
+  float stripeSum = 0.0;
+  float stripeLast = 0.0;
+  float stripeCount = 0.0;
+
+  if (InteriorDetection && !Julia && !Almond)
+  {
+    // Main cardioid and period two bulb
+    float q = (Creal - 0.25) * (Creal - 0.25) + Cimag * Cimag;
+    if (q * (q + (Creal - 0.25)) < 0.25 * Cimag * Cimag)
+      period = 1.0;
+    else if ((Creal + 1.0) * (Creal + 1.0) + Cimag * Cimag < 0.0625)
+      period = 2.0;
+
+    for (int i = 0; i < 16 && float(i) < ComponentCount && period == 0.0;
+         ++i)
+    {
+      if (length(vec2(Creal, Cimag) - Components[i].xy) < Components[i].z)
+        period = Components[i].w;
+    }
+  }
 
   // Iterate!
-  for (iter = 0.0; iter < MaxIterations && r2 < 4.0; ++iter)
+  for (; period == 0.0 && iter < MaxIterations && r2 < 4.0; ++iter)
   {
+    // dz' = 2*z*dz (+ 1 for the Mandlebrot)
+    if (distance)
+    {
+      dz = 2.0 * vec2(real * dz.x - imag * dz.y, real * dz.y + imag * dz.x);
+      if (!Julia)
+        dz.x += 1.0;
+    }
+
     // Standard maths
     float tempreal = real;
     real = (tempreal * tempreal) - (imag * imag) + Creal;
@@ -90,13 +179,58 @@ void main()
 
     // Update the length of the current vector
     r2 = (real * real) + (imag * imag);
+
+    if (OrbitTraps)
+    {
+      trapPoint = min(trapPoint, r2);
+      trapLine = min(trapLine, abs(imag));
+      trapCross = min(trapCross, min(abs(real), abs(imag)));
+      stripeLast = 0.5 * sin(STRIPE_DENSITY * atan(imag, real)) + 0.5;
+      stripeSum += stripeLast;
+      stripeCount += 1.0;
+    }
+
+    // Caught by the attracting cycle, no need to go to MaxIterations
+    vec2 trap = vec2(real, imag) - TrapCenter;
+    if (dot(trap, trap) < TrapRadius * TrapRadius)
+      break;
+
+    if (InteriorDetection)
+    {
+      if (r2 < minR2)
+      {
+        minR2 = r2;
+        atom = iter + (Julia ? 1.0 : 2.0);
+      }
+
+      // Back within a fraction of a pixel of the saved point, the
+      // saved point moves at every power of two (Brent)
+      vec2 d = vec2(real, imag) - check;
+      if (dot(d, d) < epsilon * epsilon)
+      {
+        period = iter + 1.0 - checkIter;
+        break;
+      }
+
+      if (iter + 1.0 == nextCheck)
+      {
+        check = vec2(real, imag);
+        checkIter = nextCheck;
+        nextCheck *= 2.0;
+      }
+    }
   }
 
+  // The main components are inside their own atom domain
+  if (period > 0.0 && iter == 0.0)
+    atom = period;
+
   // Base the color on the number of iterations
   float color;
   
   // Black if we dont escape
-  if (r2 < 4.0)
+  bool inside = r2 < 4.0;
+  if (inside)
     color = 0.0;
   else
   {
@@ -106,10 +240,44 @@ void main()
     else
       color = iter;
   }
+
+  // Darken the pixels that are within a pixel of the boundary, this
+  // keeps the thin filaments that the iteration count misses
+  float shade = 1.0;
+  if (distance && !inside)
+  {
+    float modulus = sqrt(r2);
+    float dist = 0.5 * modulus * log(modulus) / length(dz);
+    shade = clamp(pow(dist / (Zoom / PaneSize), 0.25), 0.0, 1.0);
+  }
   
-  FragColor = vec4((-cos(R*0.25*color)+1.0)/2.0, 
-            (-cos(B*0.25*color)+1.0)/2.0, 
-            (-cos(G*0.25*color)+1.0)/2.0, 
-               1.0);
+  // One lookup, the table is PALETTE_SIZE (4096) entries wide
+  vec3 rgb = vec3(0.0);
+  if (!inside)
+    rgb = paletteColor(color / ColorRange);
+
+  if (ColorMode == 1.0)
+    rgb = periodColor(atom);
+  else if (ColorMode == 2.0 && inside && period > 0.0)
+    rgb = periodColor(period);
+  else if (ColorMode == 3.0 && !inside)
+  {
+    // Mean of the stripes with and without the last point, blended
+    // by how far past the bailout the orbit went
+    float last = stripeSum / stripeCount;
+    float previous = stripeCount > 1.0 ?
+                     (stripeSum - stripeLast) / (stripeCount - 1.0) : last;
+    float blend = clamp(log2(log(r2) / log(4.0)), 0.0, 1.0);
+    rgb = paletteColor(mix(last, previous, blend));
+  }
+  else if (ColorMode >= 4.0)
+  {
+    // Inside points have orbits too
+    float trap = ColorMode == 4.0 ? sqrt(trapPoint) :
+                 ColorMode == 5.0 ? trapLine : trapCross;
+    rgb = paletteColor(-log(max(trap, 1e-30)) / log(10.0) / TRAP_DECADES);
+  }
+
+  FragColor = vec4(shade * rgb, 1.0);
 
 }